@@ -0,0 +1,130 @@
+/*
+ * Multi-draw batching of TriangleSoup meshes in a GeometryArena
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "BatchRenderer.hpp"
+#include "GeometryArena.hpp"
+#include "TriangleSoup.hpp"
+
+BatchRenderer::BatchRenderer() : commandbuffer_(0), useindirect_(true), draws_(0), calls_(0) {}
+
+BatchRenderer::~BatchRenderer() {
+    if (glIsBuffer(commandbuffer_)) {
+        glDeleteBuffers(1, &commandbuffer_);
+    }
+}
+
+void BatchRenderer::setUseIndirect(bool use) { useindirect_ = use; }
+
+bool BatchRenderer::usesIndirect() const {
+    return useindirect_ && (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect);
+}
+
+int BatchRenderer::drawCount() const { return draws_; }
+
+int BatchRenderer::callCount() const { return calls_; }
+
+bool BatchRenderer::add(TriangleSoup& mesh) {
+    if (!mesh.isReady() || !mesh.arena_) {
+        return false;
+    }
+    if (mesh.layout_.position == VertexFormat::Position::Unorm16 ||
+        mesh.layout_.texcoord == VertexFormat::Texcoord::Unorm16) {
+        return false;
+    }
+
+    // Few arenas are in use at a time, so a linear search is fine
+    Batch* batch = nullptr;
+    for (Batch& b : batches_) {
+        if (b.arena == mesh.arena_.get()) {
+            batch = &b;
+            break;
+        }
+    }
+    if (!batch) {
+        batches_.push_back(Batch{mesh.arena_.get(), {}});
+        batch = &batches_.back();
+    }
+
+    // The ranges of the current level of detail
+    const GeometryArena::Block& block = mesh.arena_->block(mesh.arenablock_);
+    size_t begin, end;
+    mesh.lodRanges(begin, end);
+    for (size_t r = begin; r < end; r++) {
+        const TriangleSoup::IndexRange& range = mesh.ranges_[r];
+        DrawElementsIndirectCommand command;
+        command.count = static_cast<GLuint>(range.count);
+        command.instancecount = 1;
+        command.firstindex = static_cast<GLuint>(block.firstindex + range.first);
+        command.basevertex = block.firstvertex + range.basevertex;
+        command.baseinstance = 0;
+        batch->commands.push_back(command);
+    }
+    return true;
+}
+
+void BatchRenderer::render() {
+    const bool indirect = usesIndirect();
+    draws_ = 0;
+    calls_ = 0;
+
+    // Put the commands of all batches in one buffer, each batch after the previous one
+    if (indirect) {
+        size_t total = 0;
+        for (const Batch& batch : batches_) {
+            total += batch.commands.size();
+        }
+        if (commandbuffer_ == 0) {
+            glGenBuffers(1, &commandbuffer_);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandbuffer_);
+        // Reallocate every frame, so the driver need not wait for the previous frame's commands
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                     static_cast<GLsizeiptr>(total * sizeof(DrawElementsIndirectCommand)),
+                     nullptr, GL_STREAM_DRAW);
+        size_t offset = 0;
+        for (const Batch& batch : batches_) {
+            const size_t bytes = batch.commands.size() * sizeof(DrawElementsIndirectCommand);
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, static_cast<GLintptr>(offset),
+                            static_cast<GLsizeiptr>(bytes), batch.commands.data());
+            offset += bytes;
+        }
+    }
+
+    size_t offset = 0;
+    for (Batch& batch : batches_) {
+        if (batch.commands.empty()) {
+            continue;
+        }
+        const GLsizei drawcount = static_cast<GLsizei>(batch.commands.size());
+        glBindVertexArray(batch.arena->vao());
+        if (indirect) {
+            // (mode, index type, offset in the indirect buffer, draw count, stride)
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)offset, drawcount,
+                                        0);
+            offset += batch.commands.size() * sizeof(DrawElementsIndirectCommand);
+        } else {
+            // The same draws, with the command fields as separate arrays
+            counts_.clear();
+            offsets_.clear();
+            basevertices_.clear();
+            for (const DrawElementsIndirectCommand& command : batch.commands) {
+                counts_.push_back(static_cast<GLsizei>(command.count));
+                offsets_.push_back((void*)(command.firstindex * sizeof(GLushort)));
+                basevertices_.push_back(command.basevertex);
+            }
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES, counts_.data(), GL_UNSIGNED_SHORT,
+                                          offsets_.data(), drawcount, basevertices_.data());
+        }
+        draws_ += drawcount;
+        calls_++;
+        batch.commands.clear();
+    }
+    glBindVertexArray(0);
+    if (indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+}
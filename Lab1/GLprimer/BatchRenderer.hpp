@@ -0,0 +1,85 @@
+/*
+ * Draw many TriangleSoup meshes with a few OpenGL calls.
+ *
+ * Usage: Calling TriangleSoup::render() for each object costs a VAO bind and a draw call per
+ *        mesh, which limits the frame rate long before the GPU is busy when there are
+ *        thousands of objects. A BatchRenderer instead collects the meshes to draw with add(),
+ *        and render() draws all meshes that share a GeometryArena (that is, a vertex format)
+ *        with a single call.
+ *
+ *        Each queued mesh becomes one DrawElementsIndirectCommand per index range. When the
+ *        context supports it (OpenGL 4.3 or ARB_multi_draw_indirect), the commands are put in
+ *        a GL_DRAW_INDIRECT_BUFFER and drawn with glMultiDrawElementsIndirect(). Otherwise
+ *        the same commands are drawn with glMultiDrawElementsBaseVertex(), which is core in
+ *        OpenGL 3.3. setUseIndirect(false) selects the fallback also where indirect drawing
+ *        is available, to compare the two.
+ *
+ *        Only meshes in a GeometryArena can be batched (see TriangleSoup::setUseArena()).
+ *        All meshes in a batch are drawn with the same uniforms, so their vertex format must
+ *        not need a decoding of its own: positions and texcoords stored as unorm16 are
+ *        relative to each mesh and are rejected by add(). Call setDecodeUniforms() of any
+ *        of the meshes, or leave the shader defaults, before render().
+ *
+ *        The queue is emptied by render(), so add the meshes to draw again for every frame.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <vector>
+
+class GeometryArena;
+class TriangleSoup;
+
+class BatchRenderer {
+public:
+    BatchRenderer();
+    ~BatchRenderer();
+
+    BatchRenderer(const BatchRenderer&) = delete;
+    BatchRenderer& operator=(const BatchRenderer&) = delete;
+
+    /* Use glMultiDrawElementsIndirect() when the context supports it (the default), or
+       always use glMultiDrawElementsBaseVertex() */
+    void setUseIndirect(bool use);
+
+    // returns true if render() draws with glMultiDrawElementsIndirect()
+    bool usesIndirect() const;
+
+    /* Queue a mesh for the next render(). Returns false, and queues nothing, if the mesh is
+       not in a GeometryArena or its vertex format needs decoding uniforms of its own. */
+    bool add(TriangleSoup& mesh);
+
+    /* Draw all queued meshes, with one multi-draw call per arena, and empty the queue */
+    void render();
+
+    // returns the number of draws and of multi-draw calls made by the last render()
+    int drawCount() const;
+    int callCount() const;
+
+private:
+    // The layout that glMultiDrawElementsIndirect() reads from the buffer
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instancecount;
+        GLuint firstindex;
+        GLint basevertex;
+        GLuint baseinstance;
+    };
+
+    // The queued draws for the meshes in one arena
+    struct Batch {
+        const GeometryArena* arena;
+        std::vector<DrawElementsIndirectCommand> commands;
+    };
+
+    std::vector<Batch> batches_;           // Kept between frames, to reuse the memory
+    std::vector<GLsizei> counts_;          // Arguments for glMultiDrawElementsBaseVertex()
+    std::vector<const void*> offsets_;
+    std::vector<GLint> basevertices_;
+    GLuint commandbuffer_;                 // GL_DRAW_INDIRECT_BUFFER, 0 when not created
+    bool useindirect_;
+    int draws_;
+    int calls_;
+};
@@ -0,0 +1,637 @@
+/*
+ * Timing comparison of the number parsing in NumberParser.hpp against the C library, of the
+ * OBJ loaders in ObjReader.hpp, and of the parallel loader for all thread counts from 1 to
+ * the number of hardware threads, with and without welding. Also the vertex cache statistics
+ * of the welded meshes before and after the reordering in MeshOptimizer.hpp, and the time and
+ * error of the simplification in MeshSimplifier.hpp, how many triangles the meshlets in
+ * Meshlets.hpp let the CPU cull, the build and ray query times of the BVH in Bvh.hpp, and the
+ * time, size and error of the two spheres in Primitives.hpp, and the index counts of triangle
+ * strips from meshopt::stripify() and primitives::sphereStrip()
+ *
+ * Usage: tnm046-bench [file.obj ...]
+ *        Without arguments, the meshes shipped in meshes/ are used. Run it from the
+ *        source directory, like the lab executable. No OpenGL context is needed.
+ *
+ * This code is in the public domain.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Bvh.hpp"
+#include "MappedFile.hpp"
+#include "Meshlets.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "NumberParser.hpp"
+#include "ObjReader.hpp"
+#include "Primitives.hpp"
+#include "ThreadPool.hpp"
+
+namespace {
+
+const int repetitions = 10;
+
+struct Mesh {
+    std::vector<float> vertexarray;
+    std::vector<unsigned int> indexarray;
+    obj::Counts counts;
+};
+
+using Reader = std::function<bool(const std::string&, Mesh&)>;
+
+// Run a reader a number of times, return the fastest time in milliseconds
+double timeReader(const Reader& reader, const std::string& filename, Mesh& mesh) {
+    double best = 1.0e30;
+    for (int i = 0; i < repetitions; i++) {
+        const auto starttime = std::chrono::steady_clock::now();
+        if (!reader(filename, mesh)) {
+            return -1.0;
+        }
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - starttime;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+bool identical(const Mesh& a, const Mesh& b) {
+    return a.vertexarray == b.vertexarray && a.indexarray == b.indexarray;
+}
+
+void benchmarkLoaders(const std::string& filename) {
+    Mesh reference;
+    Mesh mesh;
+
+    const double scanftime = timeReader(
+        [](const std::string& f, Mesh& m) {
+            return obj::readScanf(f, m.vertexarray, m.indexarray, m.counts);
+        },
+        filename, reference);
+    if (scanftime < 0.0) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+
+    const double mappedtime = timeReader(
+        [](const std::string& f, Mesh& m) {
+            return obj::readMapped(f, m.vertexarray, m.indexarray, m.counts);
+        },
+        filename, mesh);
+
+    printf("%-24s %7d faces  scanf %8.2f ms  mapped %8.2f ms  speedup %5.2fx  %s\n",
+           filename.c_str(), reference.counts.faces, scanftime, mappedtime,
+           scanftime / mappedtime, identical(reference, mesh) ? "identical" : "MISMATCH");
+}
+
+void benchmarkThreads(const std::string& filename) {
+    Mesh reference;
+    const double mappedtime = timeReader(
+        [](const std::string& f, Mesh& m) {
+            return obj::readMapped(f, m.vertexarray, m.indexarray, m.counts);
+        },
+        filename, reference);
+    if (mappedtime < 0.0) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+
+    printf("%-24s %7d faces  mapped %8.2f ms\n", filename.c_str(), reference.counts.faces,
+           mappedtime);
+    const int maxthreads = ThreadPool::instance().size();
+    for (int threads = 1; threads <= maxthreads; threads++) {
+        Mesh mesh;
+        const double paralleltime = timeReader(
+            [threads](const std::string& f, Mesh& m) {
+                return obj::readParallel(f, m.vertexarray, m.indexarray, m.counts, threads);
+            },
+            filename, mesh);
+        printf("%24s %2d threads  parallel %8.2f ms  speedup %5.2fx  %s\n", "", threads,
+               paralleltime, mappedtime / paralleltime,
+               identical(reference, mesh) ? "identical" : "MISMATCH");
+    }
+}
+
+void benchmarkWelding(const std::string& filename) {
+    Mesh reference;
+    const double mappedtime = timeReader(
+        [](const std::string& f, Mesh& m) {
+            return obj::readMapped(f, m.vertexarray, m.indexarray, m.counts, true);
+        },
+        filename, reference);
+    if (mappedtime < 0.0) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+
+    Mesh mesh;
+    const double paralleltime = timeReader(
+        [](const std::string& f, Mesh& m) {
+            return obj::readParallel(f, m.vertexarray, m.indexarray, m.counts, 0, true);
+        },
+        filename, mesh);
+
+    printf("%-24s %7d -> %7zu vertices  mapped %8.2f ms  parallel %8.2f ms  %s\n",
+           filename.c_str(), 3 * reference.counts.faces, reference.vertexarray.size() / 8,
+           mappedtime, paralleltime, identical(reference, mesh) ? "identical" : "MISMATCH");
+}
+
+// Time a function, return the fastest of a number of runs in milliseconds
+double timeFunction(const std::function<void()>& function) {
+    double best = 1.0e30;
+    for (int i = 0; i < repetitions; i++) {
+        const auto starttime = std::chrono::steady_clock::now();
+        function();
+        const std::chrono::duration<double, std::milli> elapsed =
+            std::chrono::steady_clock::now() - starttime;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+void benchmarkOptimizer(const std::string& filename) {
+    Mesh mesh;
+    if (!obj::readMapped(filename, mesh.vertexarray, mesh.indexarray, mesh.counts, true)) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+    const int numvertices = static_cast<int>(mesh.vertexarray.size() / 8);
+    const meshopt::CacheStats before = meshopt::analyzeVertexCache(mesh.indexarray, numvertices);
+
+    std::vector<unsigned int> indexarray;
+    const double optimizetime = timeFunction([&]() {
+        indexarray = mesh.indexarray;
+        meshopt::optimizeVertexCache(indexarray, numvertices);
+    });
+    const meshopt::CacheStats after = meshopt::analyzeVertexCache(indexarray, numvertices);
+
+    // The overdraw optimization gives up a little of the vertex cache locality
+    const std::vector<unsigned int> cacheorder = indexarray;
+    const double overdrawtime = timeFunction([&]() {
+        indexarray = cacheorder;
+        meshopt::optimizeOverdraw(mesh.vertexarray, indexarray);
+    });
+    const meshopt::CacheStats overdraw = meshopt::analyzeVertexCache(indexarray, numvertices);
+
+    printf("%-24s ACMR %6.3f -> %6.3f  ATVR %6.3f -> %6.3f  %8.2f ms  "
+           "overdraw ACMR %6.3f  %8.2f ms\n",
+           filename.c_str(), before.acmr, after.acmr, before.atvr, after.atvr, optimizetime,
+           overdraw.acmr, overdrawtime);
+}
+
+// Simplify to half the triangles, and then to half of that, as TriangleSoup::buildLODs() does
+void benchmarkSimplifier(const std::string& filename) {
+    Mesh mesh;
+    if (!obj::readMapped(filename, mesh.vertexarray, mesh.indexarray, mesh.counts, true)) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+    std::vector<unsigned int> half;
+    std::vector<unsigned int> quarter;
+    float halferror = 0.0f;
+    float quartererror = 0.0f;
+    const double simplifytime = timeFunction([&]() {
+        halferror = meshopt::simplify(mesh.vertexarray, mesh.indexarray,
+                                      mesh.indexarray.size() / 6 * 3, 1.0e30f, half);
+        quartererror = meshopt::simplify(mesh.vertexarray, half, half.size() / 6 * 3, 1.0e30f,
+                                         quarter);
+    });
+    printf("%-24s %7zu -> %7zu (error %9.3g) -> %7zu (error %9.3g)  %8.2f ms\n",
+           filename.c_str(), mesh.indexarray.size() / 3, half.size() / 3, halferror,
+           quarter.size() / 3, halferror + quartererror, simplifytime);
+}
+
+/*
+ * Check that the cone apex of each meshlet is behind the planes of all its triangles, which
+ * the back face test of cullMeshlets() relies on. Returns the number of meshlets where it is
+ * in front of one, by more than rounding.
+ */
+size_t conesInFront(const Mesh& mesh, const std::vector<unsigned int>& indexarray,
+                    const std::vector<meshopt::Meshlet>& meshlets) {
+    size_t infront = 0;
+    for (const meshopt::Meshlet& meshlet : meshlets) {
+        if (meshlet.conecutoff >= 1.0f) {
+            continue;  // No cone, the meshlet is never culled as back facing
+        }
+        bool behind = true;
+        for (size_t i = meshlet.firstindex; i < meshlet.firstindex + meshlet.indexcount; i += 3) {
+            const float* p0 = &mesh.vertexarray[8 * static_cast<size_t>(indexarray[i])];
+            const float* p1 = &mesh.vertexarray[8 * static_cast<size_t>(indexarray[i + 1])];
+            const float* p2 = &mesh.vertexarray[8 * static_cast<size_t>(indexarray[i + 2])];
+            double u[3], v[3], d[3];
+            for (int c = 0; c < 3; c++) {
+                u[c] = static_cast<double>(p1[c]) - p0[c];
+                v[c] = static_cast<double>(p2[c]) - p0[c];
+                d[c] = static_cast<double>(meshlet.coneapex[c]) - p0[c];
+            }
+            const double n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2],
+                                 u[0] * v[1] - u[1] * v[0]};
+            const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (length > 0.0 &&
+                (n[0] * d[0] + n[1] * d[1] + n[2] * d[2]) / length > 1.0e-4 * meshlet.radius) {
+                behind = false;
+            }
+        }
+        infront += behind ? 0 : 1;
+    }
+    return infront;
+}
+
+/*
+ * Build meshlets, and cull them for views of the mesh from the six axis directions, with a
+ * parallel projection that fits the mesh. About half of the triangles face away in each view.
+ */
+void benchmarkMeshlets(const std::string& filename) {
+    Mesh mesh;
+    if (!obj::readMapped(filename, mesh.vertexarray, mesh.indexarray, mesh.counts, true)) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+    std::vector<unsigned int> indexarray;
+    std::vector<meshopt::Meshlet> meshlets;
+    const double buildtime = timeFunction([&]() {
+        indexarray = mesh.indexarray;
+        meshopt::buildMeshlets(mesh.vertexarray, indexarray, meshlets);
+    });
+
+    float lo[3] = {1.0e30f, 1.0e30f, 1.0e30f};
+    float hi[3] = {-1.0e30f, -1.0e30f, -1.0e30f};
+    for (size_t i = 0; i < mesh.vertexarray.size(); i += 8) {
+        for (size_t c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], mesh.vertexarray[i + c]);
+            hi[c] = std::max(hi[c], mesh.vertexarray[i + c]);
+        }
+    }
+    const float center[3] = {0.5f * (lo[0] + hi[0]), 0.5f * (lo[1] + hi[1]),
+                             0.5f * (lo[2] + hi[2])};
+    const float size = 0.5f * std::max({hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1.0e-6f});
+
+    // Right, up and towards the camera, for each view
+    const float axes[6][3][3] = {
+        {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},  {{-1, 0, 0}, {0, 1, 0}, {0, 0, -1}},
+        {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}}, {{0, 0, 1}, {0, 1, 0}, {-1, 0, 0}},
+        {{1, 0, 0}, {0, 0, -1}, {0, 1, 0}}, {{1, 0, 0}, {0, 0, 1}, {0, -1, 0}}};
+    size_t culled = 0;
+    size_t total = 0;
+    std::vector<unsigned char> visible;
+    double culltime = 0.0;
+    for (const auto& axis : axes) {
+        // Column major, clip space z increases away from the camera
+        float mvp[16] = {0.0f};
+        for (int row = 0; row < 3; row++) {
+            const float sign = row == 2 ? -1.0f : 1.0f;
+            for (int j = 0; j < 3; j++) {
+                mvp[4 * j + row] = sign * axis[row][j] / size;
+                mvp[12 + row] -= sign * axis[row][j] / size * center[j];
+            }
+        }
+        mvp[15] = 1.0f;
+        meshopt::MeshletCullStats stats;
+        culltime += timeFunction([&]() { stats = meshopt::cullMeshlets(meshlets, mvp, visible); });
+        culled += stats.culledindices;
+        total += stats.culledindices + stats.visibleindices;
+    }
+    const size_t infront = conesInFront(mesh, indexarray, meshlets);
+    printf("%-24s %7zu triangles  %5zu meshlets  %8.2f ms  culled %5.1f%%  %8.3f ms per view  ",
+           filename.c_str(), indexarray.size() / 3, meshlets.size(), buildtime,
+           100.0 * static_cast<double>(culled) / static_cast<double>(std::max(total, size_t(1))),
+           culltime / 6.0);
+    if (infront == 0) {
+        printf("cones ok\n");
+    } else {
+        printf("APEX IN FRONT in %zu meshlets\n", infront);
+    }
+}
+
+// The distance to the nearest hit of a ray by testing every triangle, as a reference for the BVH
+bool intersectAll(const Mesh& mesh, const double* origin, const double* direction,
+                  double& distance) {
+    bool found = false;
+    for (size_t i = 0; i < mesh.indexarray.size(); i += 3) {
+        const float* p0 = &mesh.vertexarray[8 * static_cast<size_t>(mesh.indexarray[i])];
+        const float* p1 = &mesh.vertexarray[8 * static_cast<size_t>(mesh.indexarray[i + 1])];
+        const float* p2 = &mesh.vertexarray[8 * static_cast<size_t>(mesh.indexarray[i + 2])];
+        // Solve origin + t direction = p0 + u (p1 - p0) + v (p2 - p0) by Cramer's rule
+        double m[3][3];
+        double b[3];
+        for (int c = 0; c < 3; c++) {
+            m[c][0] = -direction[c];
+            m[c][1] = p1[c] - p0[c];
+            m[c][2] = p2[c] - p0[c];
+            b[c] = origin[c] - p0[c];
+        }
+        auto det = [](const double a[3][3]) {
+            return a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+                   a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                   a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+        };
+        const double d = det(m);
+        if (d == 0.0) {
+            continue;
+        }
+        double x[3];
+        for (int k = 0; k < 3; k++) {
+            double mk[3][3];
+            for (int r = 0; r < 3; r++) {
+                for (int c = 0; c < 3; c++) {
+                    mk[r][c] = c == k ? b[r] : m[r][c];
+                }
+            }
+            x[k] = det(mk) / d;
+        }
+        if (x[0] >= 0.0 && x[1] >= 0.0 && x[2] >= 0.0 && x[1] + x[2] <= 1.0 &&
+            (!found || x[0] < distance)) {
+            distance = x[0];
+            found = true;
+        }
+    }
+    return found;
+}
+
+/*
+ * Build a BVH, and cast rays from random points around the mesh towards random points in its
+ * bounding box. The first rays are checked against a test of every triangle.
+ */
+void benchmarkBvh(const std::string& filename) {
+    Mesh mesh;
+    if (!obj::readMapped(filename, mesh.vertexarray, mesh.indexarray, mesh.counts, true)) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+    Bvh bvh;
+    const double buildtime = timeFunction([&]() {
+        bvh.build(mesh.vertexarray.data(), mesh.indexarray.data(), mesh.indexarray.size() / 3);
+    });
+
+    float lo[3] = {1.0e30f, 1.0e30f, 1.0e30f};
+    float hi[3] = {-1.0e30f, -1.0e30f, -1.0e30f};
+    for (size_t i = 0; i < mesh.vertexarray.size(); i += 8) {
+        for (size_t c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], mesh.vertexarray[i + c]);
+            hi[c] = std::max(hi[c], mesh.vertexarray[i + c]);
+        }
+    }
+    const size_t numrays = 10000;
+    std::vector<float> rays(6 * numrays);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+    for (size_t r = 0; r < numrays; r++) {
+        for (size_t c = 0; c < 3; c++) {
+            const float size = hi[c] - lo[c];
+            const float from = lo[c] + size * (3.0f * uniform(random) - 1.0f);
+            const float to = lo[c] + size * uniform(random);
+            rays[6 * r + c] = from;
+            rays[6 * r + 3 + c] = to - from;
+        }
+    }
+    int hits = 0;
+    const double raytime = timeFunction([&]() {
+        hits = 0;
+        for (size_t r = 0; r < numrays; r++) {
+            RayHit hit;
+            hits += bvh.intersect(&rays[6 * r], &rays[6 * r + 3], hit);
+        }
+    });
+    // The same hits, up to rounding, except for rays that graze an edge
+    bool identical = true;
+    for (size_t r = 0; r < 100; r++) {
+        RayHit hit = {0, 0.0f, 0.0f, 0.0f};
+        const bool found = bvh.intersect(&rays[6 * r], &rays[6 * r + 3], hit);
+        const double origin[3] = {rays[6 * r], rays[6 * r + 1], rays[6 * r + 2]};
+        const double direction[3] = {rays[6 * r + 3], rays[6 * r + 4], rays[6 * r + 5]};
+        double distance = 0.0;
+        const bool referencefound = intersectAll(mesh, origin, direction, distance);
+        identical = identical && found == referencefound &&
+                    std::fabs(hit.distance - distance) <= 1.0e-4 * distance;
+    }
+    printf("%-24s %7zu triangles  %7zu nodes  %8.2f ms  %6.2f us per ray  %5.1f%% hits  %s\n",
+           filename.c_str(), mesh.indexarray.size() / 3, bvh.nodeCount(), buildtime,
+           1000.0 * raytime / numrays, 100.0 * hits / static_cast<double>(numrays),
+           identical ? "identical" : "MISMATCH");
+}
+
+/*
+ * The largest distance from a unit sphere to a mesh inside it, from the plane of each triangle
+ * to the origin. The closest point of a triangle is on its plane for all but very thin ones.
+ */
+double sphereError(const Mesh& mesh) {
+    double error = 0.0;
+    for (size_t t = 0; t < mesh.indexarray.size(); t += 3) {
+        const float* p[3];
+        for (size_t k = 0; k < 3; k++) {
+            p[k] = &mesh.vertexarray[8 * static_cast<size_t>(mesh.indexarray[t + k])];
+        }
+        double e1[3], e2[3];
+        for (size_t c = 0; c < 3; c++) {
+            e1[c] = static_cast<double>(p[1][c]) - p[0][c];
+            e2[c] = static_cast<double>(p[2][c]) - p[0][c];
+        }
+        const double n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                             e1[0] * e2[1] - e1[1] * e2[0]};
+        const double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0) {
+            const double distance = (n[0] * p[0][0] + n[1] * p[0][1] + n[2] * p[0][2]) / length;
+            error = std::max(error, 1.0 - distance);
+        }
+    }
+    return error;
+}
+
+/*
+ * Generate a latitude and longitude sphere, and a cube sphere with half as many segments, which
+ * comes out at about the same error with fewer triangles.
+ */
+void benchmarkSpheres(int segments) {
+    Mesh sphere;
+    Mesh cubesphere;
+    const double spheretime = timeFunction(
+        [&]() { primitives::sphere(1.0f, segments, sphere.vertexarray, sphere.indexarray); });
+    const double cubespheretime = timeFunction([&]() {
+        primitives::cubeSphere(1.0f, segments / 2, cubesphere.vertexarray, cubesphere.indexarray);
+    });
+    printf("sphere %4d %8zu triangles  error %.6f %8.2f ms   "
+           "cube sphere %4d %8zu triangles  error %.6f %8.2f ms\n",
+           segments, sphere.indexarray.size() / 3, sphereError(sphere), spheretime, segments / 2,
+           cubesphere.indexarray.size() / 3, sphereError(cubesphere), cubespheretime);
+}
+
+/* Index counts of the triangle list and of the strips, after the vertex cache optimization */
+void benchmarkStrips(const std::string& filename) {
+    Mesh mesh;
+    if (!obj::readMapped(filename, mesh.vertexarray, mesh.indexarray, mesh.counts, true)) {
+        printf("%-24s read error\n", filename.c_str());
+        return;
+    }
+    const int numvertices = static_cast<int>(mesh.vertexarray.size() / 8);
+    meshopt::optimizeVertexCache(mesh.indexarray, numvertices);
+    std::vector<unsigned int> strip;
+    const double striptime =
+        timeFunction([&]() { meshopt::stripify(mesh.indexarray, numvertices, strip); });
+    printf("%-24s %8zu -> %8zu indices (%.2fx)  %8.2f ms\n", filename.c_str(),
+           mesh.indexarray.size(), strip.size(),
+           static_cast<double>(mesh.indexarray.size()) / static_cast<double>(strip.size()),
+           striptime);
+}
+
+/* The strips of the sphere bands, against the list and the general stripifier */
+void benchmarkSphereStrips(int segments) {
+    Mesh sphere;
+    primitives::sphere(1.0f, segments, sphere.vertexarray, sphere.indexarray);
+    std::vector<unsigned int> bands;
+    std::vector<unsigned int> strip;
+    primitives::sphereStrip(segments, bands);
+    meshopt::stripify(sphere.indexarray, static_cast<int>(sphere.vertexarray.size() / 8), strip);
+    printf("sphere %4d %8zu -> %8zu indices (%.2fx)  stripify() %8zu indices\n", segments,
+           sphere.indexarray.size(), bands.size(),
+           static_cast<double>(sphere.indexarray.size()) / static_cast<double>(bands.size()),
+           strip.size());
+}
+
+/*
+ * Compare strtof() and strtol() with numparse::parseFloat() and numparse::parseInt() on all
+ * numbers in the "v", "vn", "vt" and "f" lines of the files. Each number is stored as a null
+ * terminated string, so strtof() gets no extra copying work.
+ */
+void benchmarkNumbers(const std::vector<std::string>& files) {
+    std::vector<std::string> floats;
+    std::vector<std::string> ints;
+    for (const std::string& filename : files) {
+        MappedFile file(filename);
+        const char* p = file.data();
+        const char* end = p + file.size();
+        while (p < end) {
+            const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+            const std::string line(p, eol ? eol : end);
+            p = eol ? eol + 1 : end;
+            const bool vertexline = line.compare(0, 2, "v ") == 0 ||
+                                    line.compare(0, 3, "vn ") == 0 ||
+                                    line.compare(0, 3, "vt ") == 0;
+            const bool faceline = line.compare(0, 2, "f ") == 0;
+            if (!vertexline && !faceline) {
+                continue;
+            }
+            // Split at spaces (and slashes, for faces), skipping the tag
+            size_t start = line.find(' ');
+            while (start != std::string::npos) {
+                start = line.find_first_not_of(faceline ? " /\r" : " \r", start);
+                if (start == std::string::npos) {
+                    break;
+                }
+                const size_t stop = line.find_first_of(faceline ? " /\r" : " \r", start);
+                (faceline ? ints : floats).push_back(line.substr(start, stop - start));
+                start = stop;
+            }
+        }
+    }
+
+    std::vector<float> reference(floats.size());
+    std::vector<float> result(floats.size());
+    const double strtoftime = timeFunction([&]() {
+        for (size_t i = 0; i < floats.size(); i++) {
+            reference[i] = strtof(floats[i].c_str(), nullptr);
+        }
+    });
+    const double parsetime = timeFunction([&]() {
+        for (size_t i = 0; i < floats.size(); i++) {
+            const char* p = floats[i].data();
+            numparse::parseFloat(p, p + floats[i].size(), result[i]);
+        }
+    });
+    const bool sameFloats = memcmp(reference.data(), result.data(), 4 * floats.size()) == 0;
+
+    std::vector<int64_t> intreference(ints.size());
+    std::vector<int64_t> intresult(ints.size());
+    const double strtoltime = timeFunction([&]() {
+        for (size_t i = 0; i < ints.size(); i++) {
+            intreference[i] = strtol(ints[i].c_str(), nullptr, 10);
+        }
+    });
+    const double parseinttime = timeFunction([&]() {
+        for (size_t i = 0; i < ints.size(); i++) {
+            const char* p = ints[i].data();
+            numparse::parseInt(p, p + ints[i].size(), intresult[i]);
+        }
+    });
+    const bool sameInts = intreference == intresult;
+
+    printf("%8zu floats    strtof %8.2f ms  parseFloat %8.2f ms  speedup %5.2fx  %s\n",
+           floats.size(), strtoftime, parsetime, strtoftime / parsetime,
+           sameFloats ? "identical" : "MISMATCH");
+    printf("%8zu integers  strtol %8.2f ms  parseInt   %8.2f ms  speedup %5.2fx  %s\n",
+           ints.size(), strtoltime, parseinttime, strtoltime / parseinttime,
+           sameInts ? "identical" : "MISMATCH");
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++) {
+        files.push_back(argv[i]);
+    }
+    if (files.empty()) {
+        files = {"meshes/onetriangle.obj", "meshes/pyramid.obj", "meshes/teapot_coarse.obj",
+                 "meshes/teapot.obj", "meshes/trex.obj"};
+    }
+
+    printf("Number parsing, best of %d runs:\n", repetitions);
+    benchmarkNumbers(files);
+
+    printf("\nOBJ loaders, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkLoaders(filename);
+    }
+
+    printf("\nParallel OBJ loader, 1 to %d threads, best of %d runs:\n",
+           ThreadPool::instance().size(), repetitions);
+    for (const std::string& filename : files) {
+        benchmarkThreads(filename);
+    }
+
+    printf("\nWelded OBJ loaders, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkWelding(filename);
+    }
+
+    printf("\nVertex cache optimization (FIFO cache of 16), best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkOptimizer(filename);
+    }
+
+    printf("\nSimplification to 1/2 and 1/4 of the triangles, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkSimplifier(filename);
+    }
+
+    printf("\nMeshlets, culled for six axis aligned views, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkMeshlets(filename);
+    }
+
+    printf("\nBVH build and ray casting, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkBvh(filename);
+    }
+
+    printf("\nSphere generation, unit radius, best of %d runs:\n", repetitions);
+    for (int segments : {16, 64, 256, 1024}) {
+        benchmarkSpheres(segments);
+    }
+
+    printf("\nTriangle strips with primitive restart, best of %d runs:\n", repetitions);
+    for (const std::string& filename : files) {
+        benchmarkStrips(filename);
+    }
+    for (int segments : {16, 64, 256}) {
+        benchmarkSphereStrips(segments);
+    }
+
+    return 0;
+}
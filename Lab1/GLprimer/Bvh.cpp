@@ -0,0 +1,380 @@
+/*
+ * Binned SAH bounding volume hierarchy and ray traversal
+ *
+ * This code is in the public domain.
+ */
+#include "Bvh.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+const int numBins = 16;                 // Candidate split planes per axis are between the bins
+const unsigned int maxLeafSize = 8;     // Larger nodes are always split
+const int maxDepth = 60;                // Deeper nodes are leaves, to bound the traversal stack
+const unsigned int taskSize = 16384;    // Subtrees of at most this many triangles are one task
+const float traversalCost = 1.0f;       // Cost of visiting a node, relative to a triangle test
+
+struct Box {
+    float lo[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+                   std::numeric_limits<float>::max()};
+    float hi[3] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+                   -std::numeric_limits<float>::max()};
+
+    void grow(const float* p) {
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    }
+
+    void grow(const Box& box) {
+        grow(box.lo);
+        grow(box.hi);
+    }
+
+    // returns half the surface area, which is all the heuristic needs
+    float area() const {
+        const float dx = hi[0] - lo[0];
+        const float dy = hi[1] - lo[1];
+        const float dz = hi[2] - lo[2];
+        return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+    }
+};
+
+// A triangle during the build. The array of them is sorted in place, so it is read in order.
+struct Primitive {
+    Box box;
+    float centroid[3];  // Centre of the box
+    unsigned int id;    // Triangle number
+};
+
+/*
+ * Compute the bounds of a node from its triangles, and split it with the binned SAH if that is
+ * cheaper than testing all its triangles. The children are appended to 'nodes'. Returns true
+ * if the node was split.
+ */
+template <typename Node>
+bool splitNode(std::vector<Node>& nodes, size_t index, int depth,
+               std::vector<Primitive>& primitives) {
+    const unsigned int first = nodes[index].first;
+    const unsigned int count = nodes[index].count;
+    Primitive* begin = &primitives[first];
+    Primitive* end = begin + count;
+    Box bounds;
+    Box centroidbounds;
+    for (const Primitive* p = begin; p < end; p++) {
+        bounds.grow(p->box);
+        centroidbounds.grow(p->centroid);
+    }
+    std::copy(bounds.lo, bounds.lo + 3, nodes[index].lo);
+    std::copy(bounds.hi, bounds.hi + 3, nodes[index].hi);
+    if (count <= 1 || depth >= maxDepth) {
+        return false;
+    }
+
+    // Sort the triangles into bins along all three axes in one pass
+    float scale[3];
+    for (int axis = 0; axis < 3; axis++) {
+        const float extent = centroidbounds.hi[axis] - centroidbounds.lo[axis];
+        scale[axis] = extent > 0.0f ? static_cast<float>(numBins) / extent : 0.0f;
+    }
+    auto binOf = [&](const Primitive& p, int axis) {
+        const float x = (p.centroid[axis] - centroidbounds.lo[axis]) * scale[axis];
+        return std::min(static_cast<int>(x), numBins - 1);
+    };
+    Box binboxes[3][numBins];
+    unsigned int bincounts[3][numBins] = {};
+    for (const Primitive* p = begin; p < end; p++) {
+        for (int axis = 0; axis < 3; axis++) {
+            const int bin = binOf(*p, axis);
+            binboxes[axis][bin].grow(p->box);
+            bincounts[axis][bin]++;
+        }
+    }
+
+    // Sweep the bins of each axis from both sides for the cost of every split plane
+    int bestaxis = -1;
+    int bestsplit = 0;
+    float bestcost = std::numeric_limits<float>::max();
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0.0f) {
+            continue;
+        }
+        float leftarea[numBins - 1];
+        unsigned int leftcount[numBins - 1];
+        Box box;
+        unsigned int n = 0;
+        for (int b = 0; b < numBins - 1; b++) {
+            box.grow(binboxes[axis][b]);
+            n += bincounts[axis][b];
+            leftarea[b] = box.area();
+            leftcount[b] = n;
+        }
+        box = Box();
+        n = 0;
+        for (int b = numBins - 1; b > 0; b--) {
+            box.grow(binboxes[axis][b]);
+            n += bincounts[axis][b];
+            const float cost = leftarea[b - 1] * static_cast<float>(leftcount[b - 1]) +
+                               box.area() * static_cast<float>(n);
+            if (leftcount[b - 1] > 0 && n > 0 && cost < bestcost) {
+                bestcost = cost;
+                bestaxis = axis;
+                bestsplit = b;
+            }
+        }
+    }
+
+    // Costs in triangle tests, relative to the chance of a ray through the node hitting a child
+    const float area = bounds.area();
+    const float splitcost = area > 0.0f ? traversalCost + bestcost / area : 0.0f;
+    unsigned int mid = first + count / 2;
+    if (bestaxis < 0) {
+        // All centroids in one point: any split is as good, and only large nodes need one
+        if (count <= maxLeafSize) {
+            return false;
+        }
+    } else {
+        if (splitcost >= static_cast<float>(count) && count <= maxLeafSize) {
+            return false;
+        }
+        const Primitive* split = std::partition(
+            begin, end, [&](const Primitive& p) { return binOf(p, bestaxis) < bestsplit; });
+        mid = first + static_cast<unsigned int>(split - begin);
+    }
+
+    const unsigned int left = static_cast<unsigned int>(nodes.size());
+    nodes.push_back({{}, first, {}, mid - first});
+    nodes.push_back({{}, mid, {}, first + count - mid});
+    nodes[index].first = left;
+    nodes[index].count = 0;
+    return true;
+}
+
+/* Build the whole subtree under node 'root' on this thread, returns its depth */
+template <typename Node>
+int buildSubtree(std::vector<Node>& nodes, size_t root, int depth,
+                 std::vector<Primitive>& primitives) {
+    int maxdepth = depth;
+    std::vector<std::pair<size_t, int>> stack = {{root, depth}};
+    while (!stack.empty()) {
+        const std::pair<size_t, int> item = stack.back();
+        stack.pop_back();
+        maxdepth = std::max(maxdepth, item.second);
+        if (splitNode(nodes, item.first, item.second, primitives)) {
+            const size_t left = nodes[item.first].first;
+            stack.push_back({left + 1, item.second + 1});
+            stack.push_back({left, item.second + 1});
+        }
+    }
+    return maxdepth;
+}
+
+}  // namespace
+
+Bvh::Bvh() : depth_(0) {}
+
+void Bvh::build(const float* vertexdata, const unsigned int* indexdata, size_t numtriangles,
+                size_t stride) {
+    nodes_.clear();
+    triangles_.clear();
+    ids_.clear();
+    depth_ = 0;
+    if (numtriangles == 0) {
+        return;
+    }
+
+    ThreadPool& pool = ThreadPool::instance();
+    const int numchunks = pool.size() * 4;
+    auto chunk = [&](int c, size_t& begin, size_t& end) {
+        begin = numtriangles * static_cast<size_t>(c) / static_cast<size_t>(numchunks);
+        end = numtriangles * static_cast<size_t>(c + 1) / static_cast<size_t>(numchunks);
+    };
+
+    std::vector<Primitive> primitives(numtriangles);
+    pool.parallelFor(numchunks, [&](int c) {
+        size_t begin, end;
+        chunk(c, begin, end);
+        for (size_t t = begin; t < end; t++) {
+            Primitive& primitive = primitives[t];
+            primitive.box = Box();
+            for (size_t k = 0; k < 3; k++) {
+                primitive.box.grow(vertexdata +
+                                   stride * static_cast<size_t>(indexdata[3 * t + k]));
+            }
+            for (int k = 0; k < 3; k++) {
+                primitive.centroid[k] = 0.5f * (primitive.box.lo[k] + primitive.box.hi[k]);
+            }
+            primitive.id = static_cast<unsigned int>(t);
+        }
+    });
+
+    // Split the top of the tree here, until the nodes are small enough to be tasks
+    nodes_.push_back({{}, 0, {}, static_cast<unsigned int>(numtriangles)});
+    std::vector<std::pair<size_t, int>> pending = {{0, 0}};
+    std::vector<std::pair<size_t, int>> tasks;
+    while (!pending.empty()) {
+        const std::pair<size_t, int> item = pending.back();
+        pending.pop_back();
+        if (nodes_[item.first].count <= taskSize) {
+            tasks.push_back(item);
+        } else if (splitNode(nodes_, item.first, item.second, primitives)) {
+            const size_t left = nodes_[item.first].first;
+            pending.push_back({left, item.second + 1});
+            pending.push_back({left + 1, item.second + 1});
+        } else {
+            depth_ = std::max(depth_, item.second);
+        }
+    }
+
+    // Each task builds its subtree in nodes of its own, which are then appended to the tree
+    std::vector<std::vector<Node>> subtrees(tasks.size());
+    std::vector<int> depths(tasks.size());
+    pool.parallelFor(static_cast<int>(tasks.size()), [&](int i) {
+        const size_t t = static_cast<size_t>(i);
+        subtrees[t].push_back(nodes_[tasks[t].first]);
+        depths[t] = buildSubtree(subtrees[t], 0, tasks[t].second, primitives);
+    });
+    for (size_t t = 0; t < tasks.size(); t++) {
+        std::vector<Node>& subtree = subtrees[t];
+        const unsigned int offset = static_cast<unsigned int>(nodes_.size()) - 1;
+        for (Node& node : subtree) {
+            if (node.count == 0) {
+                node.first += offset;
+            }
+        }
+        nodes_[tasks[t].first] = subtree[0];
+        nodes_.insert(nodes_.end(), subtree.begin() + 1, subtree.end());
+        depth_ = std::max(depth_, depths[t]);
+    }
+
+    // Copy the triangles in leaf order
+    triangles_.resize(numtriangles);
+    ids_.resize(numtriangles);
+    pool.parallelFor(numchunks, [&](int c) {
+        size_t begin, end;
+        chunk(c, begin, end);
+        for (size_t i = begin; i < end; i++) {
+            ids_[i] = primitives[i].id;
+            const unsigned int* tri = indexdata + 3 * static_cast<size_t>(ids_[i]);
+            const float* p0 = vertexdata + stride * static_cast<size_t>(tri[0]);
+            const float* p1 = vertexdata + stride * static_cast<size_t>(tri[1]);
+            const float* p2 = vertexdata + stride * static_cast<size_t>(tri[2]);
+            Triangle& triangle = triangles_[i];
+            for (int k = 0; k < 3; k++) {
+                triangle.v0[k] = p0[k];
+                triangle.e1[k] = p1[k] - p0[k];
+                triangle.e2[k] = p2[k] - p0[k];
+            }
+        }
+    });
+}
+
+/*
+ * Walk the tree with a stack, always into the nearer child first, and skip the nodes whose
+ * boxes the ray enters behind the nearest hit so far.
+ */
+bool Bvh::intersect(const float* origin, const float* direction, RayHit& hit,
+                    float maxdistance) const {
+    if (nodes_.empty()) {
+        return false;
+    }
+    const float inverse[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+    float nearest = maxdistance;
+    bool found = false;
+
+    // Entry distance of the ray into the box of a node, or infinity if it misses
+    auto enter = [&](const Node& node) {
+        float tmin = 0.0f;
+        float tmax = nearest;
+        for (int c = 0; c < 3; c++) {
+            const float t0 = (node.lo[c] - origin[c]) * inverse[c];
+            const float t1 = (node.hi[c] - origin[c]) * inverse[c];
+            // Written so that a NaN, from a ray in the plane of a side, leaves the range as is
+            tmin = std::max(std::min(t0, t1), tmin);
+            tmax = std::min(std::max(t0, t1), tmax);
+        }
+        return tmin <= tmax ? tmin : std::numeric_limits<float>::infinity();
+    };
+
+    const Node* stack[maxDepth + 1];
+    int top = 0;
+    const Node* node = &nodes_[0];
+    if (enter(*node) == std::numeric_limits<float>::infinity()) {
+        return false;
+    }
+    while (true) {
+        if (node->count > 0) {
+            for (unsigned int i = node->first; i < node->first + node->count; i++) {
+                // Moller-Trumbore: solve origin + t direction = v0 + u e1 + v e2
+                const Triangle& tri = triangles_[i];
+                const float p[3] = {direction[1] * tri.e2[2] - direction[2] * tri.e2[1],
+                                    direction[2] * tri.e2[0] - direction[0] * tri.e2[2],
+                                    direction[0] * tri.e2[1] - direction[1] * tri.e2[0]};
+                const float det = tri.e1[0] * p[0] + tri.e1[1] * p[1] + tri.e1[2] * p[2];
+                if (det == 0.0f) {
+                    continue;  // The ray is parallel to the triangle
+                }
+                const float invdet = 1.0f / det;
+                const float s[3] = {origin[0] - tri.v0[0], origin[1] - tri.v0[1],
+                                    origin[2] - tri.v0[2]};
+                const float u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * invdet;
+                if (u < 0.0f || u > 1.0f) {
+                    continue;
+                }
+                const float q[3] = {s[1] * tri.e1[2] - s[2] * tri.e1[1],
+                                    s[2] * tri.e1[0] - s[0] * tri.e1[2],
+                                    s[0] * tri.e1[1] - s[1] * tri.e1[0]};
+                const float v =
+                    (direction[0] * q[0] + direction[1] * q[1] + direction[2] * q[2]) * invdet;
+                if (v < 0.0f || u + v > 1.0f) {
+                    continue;
+                }
+                const float t = (tri.e2[0] * q[0] + tri.e2[1] * q[1] + tri.e2[2] * q[2]) * invdet;
+                if (t >= 0.0f && t < nearest) {
+                    nearest = t;
+                    hit = {ids_[i], u, v, t};
+                    found = true;
+                }
+            }
+        } else {
+            const Node* left = &nodes_[node->first];
+            const Node* right = left + 1;
+            float tleft = enter(*left);
+            float tright = enter(*right);
+            if (tright < tleft) {
+                std::swap(left, right);
+                std::swap(tleft, tright);
+            }
+            if (tleft != std::numeric_limits<float>::infinity()) {
+                if (tright != std::numeric_limits<float>::infinity()) {
+                    stack[top++] = right;
+                }
+                node = left;
+                continue;
+            }
+        }
+
+        // Take the next node from the stack, unless the ray enters it behind the nearest hit
+        do {
+            if (top == 0) {
+                return found;
+            }
+            node = stack[--top];
+        } while (enter(*node) == std::numeric_limits<float>::infinity());
+    }
+}
+
+bool Bvh::empty() const { return nodes_.empty(); }
+
+size_t Bvh::nodeCount() const { return nodes_.size(); }
+
+size_t Bvh::bytes() const {
+    return nodes_.capacity() * sizeof(Node) + triangles_.capacity() * sizeof(Triangle) +
+           ids_.capacity() * sizeof(unsigned int);
+}
+
+int Bvh::depth() const { return depth_; }
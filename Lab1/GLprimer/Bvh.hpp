@@ -0,0 +1,79 @@
+/*
+ * A bounding volume hierarchy over the triangles of a mesh, for ray queries on the CPU.
+ *
+ * Usage: build() takes the mesh in the interleaved vertex format used by TriangleSoup, 8 floats
+ *        per vertex, or any other stride with the position first, and three indices per
+ *        triangle. The tree is built top down with the surface area heuristic (SAH),
+ *        evaluated at a fixed number of bins per axis. The first levels are split on the
+ *        calling thread, and the subtrees below them are built in parallel on the shared
+ *        ThreadPool.
+ *
+ *        The nodes are stored in one flat array of 32 bytes each, with the two children of a
+ *        node next to each other, and the triangles are copied in the order of the leaves,
+ *        so a query reads memory close to sequentially. intersect() finds the nearest hit of
+ *        a ray, visiting the nearer child first. Triangles are hit from both sides.
+ *
+ * References: I. Wald, "On fast Construction of SAH-based Bounding Volume Hierarchies" (2007).
+ *             T. Moller and B. Trumbore, "Fast, Minimum Storage Ray/Triangle Intersection"
+ *             (1997).
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+// The nearest hit of a ray
+struct RayHit {
+    unsigned int triangle;  // Triangle number, its indices are 3 * triangle ... 3 * triangle + 2
+    float u, v;             // Barycentric weights of its second and third vertex
+    float distance;         // Along the ray, in lengths of the ray direction
+};
+
+class Bvh {
+public:
+    Bvh();
+
+    /* Build the tree over 'numtriangles' triangles, with vertices 'stride' floats apart. The
+       data is copied, so the arrays may change or go away afterwards. */
+    void build(const float* vertexdata, const unsigned int* indexdata, size_t numtriangles,
+               size_t stride = 8);
+
+    /* Find the nearest triangle hit by the ray from 'origin' in 'direction', closer than
+       'maxdistance'. Returns false if there is none. */
+    bool intersect(const float* origin, const float* direction, RayHit& hit,
+                   float maxdistance = std::numeric_limits<float>::max()) const;
+
+    // returns true if the tree has been built
+    bool empty() const;
+
+    // returns the number of nodes and the depth of the tree
+    size_t nodeCount() const;
+    int depth() const;
+
+    // returns the memory held by the tree, in bytes
+    size_t bytes() const;
+
+private:
+    // A node of the tree, with its bounding box
+    struct Node {
+        float lo[3];
+        unsigned int first;  // First triangle of a leaf, or the left child (the right is next)
+        float hi[3];
+        unsigned int count;  // Number of triangles in a leaf, 0 for an inner node
+    };
+
+    // A triangle as a corner and two edges, for the intersection test
+    struct Triangle {
+        float v0[3];
+        float e1[3];
+        float e2[3];
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<Triangle> triangles_;  // In the order of the leaves
+    std::vector<unsigned int> ids_;    // Original number of each triangle
+    int depth_;
+};
@@ -0,0 +1,131 @@
+/*
+ * Frustum culling of bounding boxes, four at a time
+ *
+ * This code is in the public domain.
+ */
+#include "FrustumCuller.hpp"
+#include "TriangleSoup.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUMCULLER_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+/*
+ * The planes a x + b y + c z + d >= 0 that contain the frustum, from the rows of the matrix:
+ * a point is inside when -w <= x, y, z <= w in clip space, so w + x, w - x, w + y ... >= 0.
+ */
+void extractPlanes(const GLfloat* m, float planes[6][4]) {
+    // Column major: element (row, column) is m[4 * column + row]
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            planes[2 * i][j] = m[4 * j + 3] + m[4 * j + i];
+            planes[2 * i + 1][j] = m[4 * j + 3] - m[4 * j + i];
+        }
+    }
+}
+
+}  // namespace
+
+FrustumCuller::FrustumCuller() : visiblecount_(0) {}
+
+void FrustumCuller::setMeshes(const std::vector<TriangleSoup*>& meshes) {
+    meshes_ = meshes;
+    const size_t padded = (meshes.size() + 3) / 4 * 4;
+    centerx_.assign(padded, 0.0f);
+    centery_.assign(padded, 0.0f);
+    centerz_.assign(padded, 0.0f);
+    extentx_.assign(padded, 0.0f);
+    extenty_.assign(padded, 0.0f);
+    extentz_.assign(padded, 0.0f);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const GLfloat* lo = meshes[i]->boundsMin();
+        const GLfloat* hi = meshes[i]->boundsMax();
+        centerx_[i] = 0.5f * (lo[0] + hi[0]);
+        centery_[i] = 0.5f * (lo[1] + hi[1]);
+        centerz_[i] = 0.5f * (lo[2] + hi[2]);
+        extentx_[i] = 0.5f * (hi[0] - lo[0]);
+        extenty_[i] = 0.5f * (hi[1] - lo[1]);
+        extentz_[i] = 0.5f * (hi[2] - lo[2]);
+    }
+    visible_.assign(meshes.size(), 1);
+    visiblecount_ = static_cast<int>(meshes.size());
+}
+
+/*
+ * A box is outside a plane if its centre is further outside than the box reaches towards the
+ * plane: n.c + d < -(|nx| ex + |ny| ey + |nz| ez). The planes need not be normalized, since
+ * both sides scale with the length of n.
+ */
+int FrustumCuller::cull(const GLfloat* mvp) {
+    float planes[6][4];
+    extractPlanes(mvp, planes);
+    const size_t count = meshes_.size();
+    visiblecount_ = 0;
+
+#ifdef FRUSTUMCULLER_SSE
+    for (size_t i = 0; i < count; i += 4) {
+        const __m128 cx = _mm_loadu_ps(&centerx_[i]);
+        const __m128 cy = _mm_loadu_ps(&centery_[i]);
+        const __m128 cz = _mm_loadu_ps(&centerz_[i]);
+        const __m128 ex = _mm_loadu_ps(&extentx_[i]);
+        const __m128 ey = _mm_loadu_ps(&extenty_[i]);
+        const __m128 ez = _mm_loadu_ps(&extentz_[i]);
+        __m128 outside = _mm_setzero_ps();
+        for (const float* plane : planes) {
+            const __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(plane[0])),
+                           _mm_mul_ps(cy, _mm_set1_ps(plane[1]))),
+                _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(plane[2])), _mm_set1_ps(plane[3])));
+            const __m128 reach = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(plane[0]))),
+                           _mm_mul_ps(ey, _mm_set1_ps(std::fabs(plane[1])))),
+                _mm_mul_ps(ez, _mm_set1_ps(std::fabs(plane[2]))));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach),
+                                                      _mm_setzero_ps()));
+        }
+        // One bit per box, set if it is outside
+        const int mask = _mm_movemask_ps(outside);
+        for (size_t j = 0; j < 4 && i + j < count; j++) {
+            const bool visible = !(mask & (1 << j));
+            visible_[i + j] = visible;
+            visiblecount_ += visible;
+        }
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        bool visible = true;
+        for (const float* plane : planes) {
+            const float distance = plane[0] * centerx_[i] + plane[1] * centery_[i] +
+                                   plane[2] * centerz_[i] + plane[3];
+            const float reach = std::fabs(plane[0]) * extentx_[i] +
+                                std::fabs(plane[1]) * extenty_[i] +
+                                std::fabs(plane[2]) * extentz_[i];
+            visible = visible && distance + reach >= 0.0f;
+        }
+        visible_[i] = visible;
+        visiblecount_ += visible;
+    }
+#endif
+    return visiblecount_;
+}
+
+bool FrustumCuller::isVisible(size_t i) const { return visible_[i] != 0; }
+
+void FrustumCuller::render() const {
+    for (size_t i = 0; i < meshes_.size(); i++) {
+        if (visible_[i]) {
+            meshes_[i]->render();
+        }
+    }
+}
+
+int FrustumCuller::visibleCount() const { return visiblecount_; }
+
+int FrustumCuller::culledCount() const {
+    return static_cast<int>(meshes_.size()) - visiblecount_;
+}
@@ -0,0 +1,58 @@
+/*
+ * View frustum culling of many TriangleSoup meshes on the CPU.
+ *
+ * Usage: Give the meshes to test to setMeshes(), which copies their bounding boxes into
+ *        separate arrays of centre and half size coordinates (structure of arrays). Each
+ *        frame, cull() takes the matrix from mesh coordinates to clip space, finds the six
+ *        planes of the view frustum from it, and tests four boxes at a time against each
+ *        plane with SSE instructions (or one at a time without SSE). A box is culled when it
+ *        is entirely outside one of the planes. The test is conservative: a box that
+ *        straddles two planes outside a corner of the frustum is kept.
+ *
+ *        render() then calls TriangleSoup::render() for the visible meshes only. To draw
+ *        them some other way, for example with a BatchRenderer, ask isVisible() per mesh.
+ *        visibleCount() and culledCount() report the result of the last cull().
+ *        Call setMeshes() again when the meshes have changed their geometry.
+ *
+ * References: G. Gribb and K. Hartmann, "Fast Extraction of Viewing Frustum Planes from the
+ *             World-View-Projection Matrix" (2001).
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <cstddef>
+#include <vector>
+
+class TriangleSoup;
+
+class FrustumCuller {
+public:
+    FrustumCuller();
+
+    /* Take the bounding boxes of the meshes to test */
+    void setMeshes(const std::vector<TriangleSoup*>& meshes);
+
+    /* Test all meshes against the view frustum of 'mvp', a column major matrix from mesh
+       coordinates to clip space. Returns the number of visible meshes. */
+    int cull(const GLfloat* mvp);
+
+    // returns true if mesh 'i' (in the order given to setMeshes()) passed the last cull()
+    bool isVisible(size_t i) const;
+
+    /* Render the meshes that passed the last cull() */
+    void render() const;
+
+    // returns the number of meshes that passed and failed the last cull()
+    int visibleCount() const;
+    int culledCount() const;
+
+private:
+    std::vector<TriangleSoup*> meshes_;
+    // Box centres and half sizes, padded with empty boxes to a multiple of four
+    std::vector<float> centerx_, centery_, centerz_;
+    std::vector<float> extentx_, extenty_, extentz_;
+    std::vector<unsigned char> visible_;
+    int visiblecount_;
+};
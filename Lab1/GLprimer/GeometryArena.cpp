@@ -0,0 +1,313 @@
+/*
+ * Shared vertex and index buffers for many meshes
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "GeometryArena.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Room for the first meshes, before the buffers need to grow
+const size_t initialVertices = 1 << 16;
+const size_t initialIndices = 1 << 18;
+
+// Create a buffer of 'newsize' bytes and copy the first 'oldsize' bytes of 'buffer' to it
+GLuint resizeBuffer(GLuint buffer, size_t oldsize, size_t newsize) {
+    GLuint newbuffer;
+    glGenBuffers(1, &newbuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, newbuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(newsize), nullptr, GL_STATIC_DRAW);
+    if (oldsize > 0) {
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                            static_cast<GLsizeiptr>(oldsize));
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    if (glIsBuffer(buffer)) {
+        glDeleteBuffers(1, &buffer);
+    }
+    return newbuffer;
+}
+
+}  // namespace
+
+std::map<int, std::weak_ptr<GeometryArena>> GeometryArena::arenas_;
+
+std::shared_ptr<GeometryArena> GeometryArena::get(const VertexFormat& format) {
+    std::weak_ptr<GeometryArena>& entry = arenas_[format.key()];
+    std::shared_ptr<GeometryArena> arena = entry.lock();
+    if (!arena) {
+        // The constructor is private, so std::make_shared() can not be used
+        arena.reset(new GeometryArena(format));
+        entry = arena;
+    }
+    return arena;
+}
+
+GeometryArena::GeometryArena(const VertexFormat& format)
+    : format_(format),
+      vao_(0),
+      vertexbuffer_(0),
+      indexbuffer_(0),
+      vertexcapacity_(0),
+      indexcapacity_(0) {
+    glGenVertexArrays(1, &vao_);
+    grow(initialVertices, initialIndices);
+}
+
+GeometryArena::~GeometryArena() {
+    if (glIsVertexArray(vao_)) {
+        glDeleteVertexArrays(1, &vao_);
+    }
+    if (glIsBuffer(vertexbuffer_)) {
+        glDeleteBuffers(1, &vertexbuffer_);
+    }
+    if (glIsBuffer(indexbuffer_)) {
+        glDeleteBuffers(1, &indexbuffer_);
+    }
+}
+
+// Take 'size' units from the first free range that is large enough
+bool GeometryArena::take(FreeList& freelist, size_t size, size_t& offset) {
+    for (auto it = freelist.begin(); it != freelist.end(); ++it) {
+        if (it->second >= size) {
+            offset = it->first;
+            const size_t left = it->second - size;
+            freelist.erase(it);
+            if (left > 0) {
+                freelist[offset + size] = left;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Return a range to the free list, merging it with the free ranges on either side
+void GeometryArena::give(FreeList& freelist, size_t offset, size_t size) {
+    if (size == 0) {
+        return;
+    }
+    auto next = freelist.lower_bound(offset);
+    if (next != freelist.end() && offset + size == next->first) {
+        size += next->second;
+        next = freelist.erase(next);
+    }
+    if (next != freelist.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            previous->second += size;
+            return;
+        }
+    }
+    freelist[offset] = size;
+}
+
+int GeometryArena::allocate(const void* vertexdata, int numvertices, const GLushort* indexdata,
+                            int numindices) {
+    const size_t nv = static_cast<size_t>(numvertices);
+    const size_t ni = static_cast<size_t>(numindices);
+    size_t vertexoffset = 0;
+    size_t indexoffset = 0;
+    if (!take(freevertices_, nv, vertexoffset)) {
+        grow(std::max(2 * vertexcapacity_, vertexcapacity_ + nv), indexcapacity_);
+        take(freevertices_, nv, vertexoffset);
+    }
+    if (!take(freeindices_, ni, indexoffset)) {
+        grow(vertexcapacity_, std::max(2 * indexcapacity_, indexcapacity_ + ni));
+        take(freeindices_, ni, indexoffset);
+    }
+
+    const size_t stride = static_cast<size_t>(format_.stride());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexbuffer_);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(vertexoffset * stride),
+                    static_cast<GLsizeiptr>(nv * stride), vertexdata);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexbuffer_);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(indexoffset * sizeof(GLushort)),
+                    static_cast<GLsizeiptr>(ni * sizeof(GLushort)), indexdata);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    int handle;
+    if (freehandles_.empty()) {
+        handle = static_cast<int>(blocks_.size());
+        blocks_.emplace_back();
+    } else {
+        handle = freehandles_.back();
+        freehandles_.pop_back();
+    }
+    Block& block = blocks_[static_cast<size_t>(handle)];
+    block.firstvertex = static_cast<GLint>(vertexoffset);
+    block.numvertices = numvertices;
+    block.firstindex = static_cast<GLsizei>(indexoffset);
+    block.numindices = numindices;
+    block.used = true;
+    return handle;
+}
+
+void GeometryArena::release(int handle) {
+    Block& block = blocks_[static_cast<size_t>(handle)];
+    if (!block.used) {
+        return;
+    }
+    give(freevertices_, static_cast<size_t>(block.firstvertex),
+         static_cast<size_t>(block.numvertices));
+    give(freeindices_, static_cast<size_t>(block.firstindex),
+         static_cast<size_t>(block.numindices));
+    block = Block();
+    freehandles_.push_back(handle);
+}
+
+void GeometryArena::grow(size_t vertexcapacity, size_t indexcapacity) {
+    const size_t stride = static_cast<size_t>(format_.stride());
+    if (vertexcapacity > vertexcapacity_) {
+        vertexbuffer_ =
+            resizeBuffer(vertexbuffer_, vertexcapacity_ * stride, vertexcapacity * stride);
+        give(freevertices_, vertexcapacity_, vertexcapacity - vertexcapacity_);
+        vertexcapacity_ = vertexcapacity;
+    }
+    if (indexcapacity > indexcapacity_) {
+        indexbuffer_ = resizeBuffer(indexbuffer_, indexcapacity_ * sizeof(GLushort),
+                                    indexcapacity * sizeof(GLushort));
+        give(freeindices_, indexcapacity_, indexcapacity - indexcapacity_);
+        indexcapacity_ = indexcapacity;
+    }
+    bindBuffers();
+}
+
+void GeometryArena::compact() {
+    // Visit the meshes in buffer order, so each one moves towards the start, never past another
+    std::vector<Block*> byvertex;
+    for (Block& block : blocks_) {
+        if (block.used) {
+            byvertex.push_back(&block);
+        }
+    }
+    std::vector<Block*> byindex = byvertex;
+    std::sort(byvertex.begin(), byvertex.end(),
+              [](const Block* a, const Block* b) { return a->firstvertex < b->firstvertex; });
+    std::sort(byindex.begin(), byindex.end(),
+              [](const Block* a, const Block* b) { return a->firstindex < b->firstindex; });
+
+    // Copy into new buffers, since glCopyBufferSubData() can not copy overlapping ranges
+    const GLsizeiptr stride = format_.stride();
+    GLuint vertexbuffer;
+    GLuint indexbuffer;
+    glGenBuffers(1, &vertexbuffer);
+    glGenBuffers(1, &indexbuffer);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vertexbuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(vertexcapacity_) * stride,
+                 nullptr, GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexbuffer_);
+    GLint nextvertex = 0;
+    for (Block* block : byvertex) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, block->firstvertex * stride,
+                            nextvertex * stride, block->numvertices * stride);
+        block->firstvertex = nextvertex;
+        nextvertex += block->numvertices;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, indexbuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER,
+                 static_cast<GLsizeiptr>(indexcapacity_ * sizeof(GLushort)), nullptr,
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_COPY_READ_BUFFER, indexbuffer_);
+    const GLsizeiptr indexsize = sizeof(GLushort);
+    GLsizei nextindex = 0;
+    for (Block* block : byindex) {
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            block->firstindex * indexsize, nextindex * indexsize,
+                            block->numindices * indexsize);
+        block->firstindex = nextindex;
+        nextindex += block->numindices;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    glDeleteBuffers(1, &vertexbuffer_);
+    glDeleteBuffers(1, &indexbuffer_);
+    vertexbuffer_ = vertexbuffer;
+    indexbuffer_ = indexbuffer;
+    bindBuffers();
+
+    // All free space is now one range at the end of each buffer
+    freevertices_.clear();
+    freeindices_.clear();
+    give(freevertices_, static_cast<size_t>(nextvertex),
+         vertexcapacity_ - static_cast<size_t>(nextvertex));
+    give(freeindices_, static_cast<size_t>(nextindex),
+         indexcapacity_ - static_cast<size_t>(nextindex));
+}
+
+void GeometryArena::bindBuffers() {
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+    format_.setAttributes();
+    // The index buffer is part of the VAO state, so it stays bound until the VAO is unbound
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+const GeometryArena::Block& GeometryArena::block(int handle) const {
+    return blocks_[static_cast<size_t>(handle)];
+}
+
+GLuint GeometryArena::vao() const { return vao_; }
+
+GLuint GeometryArena::vertexBuffer() const { return vertexbuffer_; }
+
+GLuint GeometryArena::indexBuffer() const { return indexbuffer_; }
+
+GeometryArena::Stats GeometryArena::stats() const {
+    Stats stats;
+    for (const Block& block : blocks_) {
+        if (block.used) {
+            stats.meshes++;
+        }
+    }
+    size_t freevertices = 0;
+    for (const auto& range : freevertices_) {
+        freevertices += range.second;
+        stats.vertexlargestfree = std::max(stats.vertexlargestfree, range.second);
+    }
+    size_t freeindices = 0;
+    for (const auto& range : freeindices_) {
+        freeindices += range.second;
+        stats.indexlargestfree = std::max(stats.indexlargestfree, range.second);
+    }
+    stats.vertexcapacity = vertexcapacity_;
+    stats.vertexused = vertexcapacity_ - freevertices;
+    stats.vertexfreeranges = freevertices_.size();
+    stats.indexcapacity = indexcapacity_;
+    stats.indexused = indexcapacity_ - freeindices;
+    stats.indexfreeranges = freeindices_.size();
+    stats.bytes = vertexcapacity_ * static_cast<size_t>(format_.stride()) +
+                  indexcapacity_ * sizeof(GLushort);
+    if (freevertices > 0) {
+        stats.vertexfragmentation =
+            1.0 - static_cast<double>(stats.vertexlargestfree) / static_cast<double>(freevertices);
+    }
+    if (freeindices > 0) {
+        stats.indexfragmentation =
+            1.0 - static_cast<double>(stats.indexlargestfree) / static_cast<double>(freeindices);
+    }
+    return stats;
+}
+
+void GeometryArena::printStats() const {
+    const Stats s = stats();
+    printf("GeometryArena information (%d bytes per vertex):\n", format_.stride());
+    printf("meshes   : %d\n", s.meshes);
+    printf("vertices : %zu of %zu used, %zu free ranges, largest %zu, fragmentation %.2f\n",
+           s.vertexused, s.vertexcapacity, s.vertexfreeranges, s.vertexlargestfree,
+           s.vertexfragmentation);
+    printf("indices  : %zu of %zu used, %zu free ranges, largest %zu, fragmentation %.2f\n",
+           s.indexused, s.indexcapacity, s.indexfreeranges, s.indexlargestfree,
+           s.indexfragmentation);
+    printf("GPU bytes: %zu\n", s.bytes);
+}
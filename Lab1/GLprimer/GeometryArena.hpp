@@ -0,0 +1,126 @@
+/*
+ * A shared set of large GPU buffers that many meshes are sub-allocated from.
+ *
+ * Usage: GeometryArena::get() returns the arena for a vertex format, creating it if needed.
+ *        Each arena has one vertex buffer, one buffer of 16 bit indices and one VAO, shared by
+ *        all meshes in it. allocate() reserves room for a mesh and copies its data in, and
+ *        returns a handle. block() gives the current location of the mesh, which is drawn
+ *        with glDrawElementsBaseVertex() after binding vao(). Release the room with release().
+ *
+ *        Free space is kept in sorted free lists (one for vertices, one for indices) and
+ *        allocated first fit, with neighbouring free ranges merged. When an allocation does
+ *        not fit, the buffers grow, and the old contents are copied over on the GPU. Space
+ *        freed by released meshes may leave holes. stats() reports how fragmented the free
+ *        space is, and compact() moves all meshes together to close the holes. Handles stay
+ *        valid, but block() must be called again after allocate() or compact().
+ *
+ *        get() returns a reference counted std::shared_ptr, and each TriangleSoup in an arena
+ *        holds one. The arena and its OpenGL objects are deleted when the last of them goes
+ *        away, and a later get() creates a new one. Drop all handles before the context is
+ *        destroyed, as for any other OpenGL object.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "VertexFormat.hpp"
+
+class GeometryArena {
+public:
+    // The location of one mesh in the arena buffers
+    struct Block {
+        GLint firstvertex = 0;  // Base vertex of the mesh
+        GLsizei numvertices = 0;
+        GLsizei firstindex = 0;  // Offset in the index buffer, in indices
+        GLsizei numindices = 0;
+        bool used = false;
+    };
+
+    // Occupancy and fragmentation of the arena buffers
+    struct Stats {
+        int meshes = 0;
+        size_t vertexcapacity = 0;  // In vertices
+        size_t vertexused = 0;
+        size_t vertexfreeranges = 0;
+        size_t vertexlargestfree = 0;
+        size_t indexcapacity = 0;  // In indices
+        size_t indexused = 0;
+        size_t indexfreeranges = 0;
+        size_t indexlargestfree = 0;
+        size_t bytes = 0;  // GPU memory of both buffers
+        // 1 - largest free range / all free space, for vertices and indices. 0 means the
+        // free space is in one piece, values close to 1 mean it is scattered in small holes.
+        double vertexfragmentation = 0.0;
+        double indexfragmentation = 0.0;
+    };
+
+    /* Return the arena for a vertex format, creating it if no handle to it is left */
+    static std::shared_ptr<GeometryArena> get(const VertexFormat& format);
+
+    ~GeometryArena();
+
+    GeometryArena(const GeometryArena&) = delete;
+    GeometryArena& operator=(const GeometryArena&) = delete;
+
+    /*
+     * Copy a mesh into the arena. 'vertexdata' is in the vertex format of the arena, and the
+     * indices are relative to the first vertex of the mesh. Returns a handle for the mesh.
+     */
+    int allocate(const void* vertexdata, int numvertices, const GLushort* indexdata,
+                 int numindices);
+
+    /* Free the room of a mesh. The handle may be reused by later allocations */
+    void release(int handle);
+
+    /* Move all meshes to the start of the buffers, with no holes between them */
+    void compact();
+
+    // returns the current location of a mesh
+    const Block& block(int handle) const;
+
+    // returns the VAO that reads the arena buffers in its vertex format
+    GLuint vao() const;
+
+    // returns the vertex and index buffers, which change when the arena grows
+    GLuint vertexBuffer() const;
+    GLuint indexBuffer() const;
+
+    Stats stats() const;
+
+    /* Print stats() */
+    void printStats() const;
+
+private:
+    // Free ranges as offset -> size, kept sorted with neighbours merged
+    using FreeList = std::map<size_t, size_t>;
+
+    explicit GeometryArena(const VertexFormat& format);
+
+    static bool take(FreeList& freelist, size_t size, size_t& offset);
+    static void give(FreeList& freelist, size_t offset, size_t size);
+
+    /* Make the buffers large enough for the given capacities, keeping their contents */
+    void grow(size_t vertexcapacity, size_t indexcapacity);
+
+    /* Point the VAO to the current buffers */
+    void bindBuffers();
+
+    VertexFormat format_;
+    GLuint vao_;
+    GLuint vertexbuffer_;
+    GLuint indexbuffer_;
+    size_t vertexcapacity_;
+    size_t indexcapacity_;
+    FreeList freevertices_;
+    FreeList freeindices_;
+    std::vector<Block> blocks_;
+    std::vector<int> freehandles_;
+
+    // Not owned, so no OpenGL objects are left for the static destructors
+    static std::map<int, std::weak_ptr<GeometryArena>> arenas_;
+};
@@ -0,0 +1,138 @@
+/*
+ * Streaming of per-instance data
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "InstanceBuffer.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+
+InstanceBuffer::InstanceBuffer(bool colors)
+    : buffer_(0),
+      capacity_(0),
+      count_(0),
+      maxsegments_(0),
+      region_(0),
+      fences_(),
+      colors_(colors) {}
+
+InstanceBuffer::~InstanceBuffer() {
+    for (GLsync& fence : fences_) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (glIsBuffer(buffer_)) {
+        glDeleteBuffers(1, &buffer_);
+    }
+}
+
+int InstanceBuffer::count() const { return count_; }
+
+int InstanceBuffer::maxSegments() const { return maxsegments_; }
+
+void InstanceBuffer::update(const std::vector<Instance>& instances) {
+    const int count = static_cast<int>(instances.size());
+
+    if (count > capacity_) {
+        // Start over with a larger buffer. The driver keeps the old storage until the GPU is
+        // done with it, so the fences are no longer needed.
+        for (GLsync& fence : fences_) {
+            if (fence) {
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+        if (buffer_ == 0) {
+            glGenBuffers(1, &buffer_);
+        }
+        capacity_ = std::max(count, 2 * capacity_);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+        glBufferData(GL_ARRAY_BUFFER,
+                     static_cast<GLsizeiptr>(regions * capacity_) *
+                         static_cast<GLsizeiptr>(sizeof(Instance)),
+                     nullptr, GL_STREAM_DRAW);
+        region_ = 0;
+    } else {
+        // The draws since the last update() have read the current region. Move on to the
+        // next one, and wait if the GPU may still be drawing with it.
+        fences_[region_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        region_ = (region_ + 1) % regions;
+        if (fences_[region_]) {
+            while (glClientWaitSync(fences_[region_], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+                   GL_TIMEOUT_EXPIRED) {
+            }
+            glDeleteSync(fences_[region_]);
+            fences_[region_] = nullptr;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    }
+
+    count_ = count;
+    maxsegments_ = 0;
+    for (const Instance& instance : instances) {
+        maxsegments_ = std::max(maxsegments_, static_cast<int>(instance.segments));
+    }
+    if (count > 0) {
+        const GLsizeiptr bytes = static_cast<GLsizeiptr>(count) * sizeof(Instance);
+        const GLintptr offset =
+            static_cast<GLintptr>(region_) * capacity_ * static_cast<GLintptr>(sizeof(Instance));
+        void* data = glMapBufferRange(
+            GL_ARRAY_BUFFER, offset, bytes,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (data) {
+            memcpy(data, instances.data(), static_cast<size_t>(bytes));
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        } else {
+            std::cerr << "InstanceBuffer: could not map the buffer.\n";
+            count_ = 0;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::setAttributes() const {
+    if (buffer_ == 0) {
+        return;  // Nothing written yet, and buffer 0 would make the attributes read client memory
+    }
+    const GLsizei stride = sizeof(Instance);
+    const size_t base = static_cast<size_t>(region_) * static_cast<size_t>(capacity_) * stride;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer_);
+    // Attribute 3 is the position and scale (vec4), 4 the rotation (vec4), 5 the colour
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*)(base + offsetof(Instance, position)));
+    glVertexAttribDivisor(3, 1);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void*)(base + offsetof(Instance, rotation)));
+    glVertexAttribDivisor(4, 1);
+    if (colors_) {
+        glEnableVertexAttribArray(5);
+        glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+                              (void*)(base + offsetof(Instance, color)));
+        glVertexAttribDivisor(5, 1);
+    } else {
+        // A disabled attribute reads this constant value instead
+        glDisableVertexAttribArray(5);
+        glVertexAttrib4f(5, 1.0f, 1.0f, 1.0f, 1.0f);
+    }
+    // Attribute 6 is an integer, only read by spherevertex.glsl
+    glEnableVertexAttribArray(6);
+    glVertexAttribIPointer(6, 1, GL_UNSIGNED_INT, stride,
+                           (void*)(base + offsetof(Instance, segments)));
+    glVertexAttribDivisor(6, 1);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void InstanceBuffer::clearAttributes() const {
+    glDisableVertexAttribArray(3);
+    glDisableVertexAttribArray(4);
+    glDisableVertexAttribArray(5);
+    glDisableVertexAttribArray(6);
+}
@@ -0,0 +1,73 @@
+/*
+ * A GPU buffer of per-instance data for TriangleSoup::renderInstanced().
+ *
+ * Usage: Fill a vector of InstanceBuffer::Instance, one per copy of the mesh to draw, and pass
+ *        it to update(), typically once per frame. Each instance has a position, a uniform
+ *        scale and a rotation quaternion (32 bytes, half the size of a mat4), and optionally
+ *        a colour. The vertex shader instancevertex.glsl reads them as vertex attributes
+ *        3, 4 and 5, which advance once per instance (glVertexAttribDivisor()). Spheres from
+ *        TriangleSoup::createProceduralSphere() also read the number of segments of each
+ *        instance, as attribute 6.
+ *
+ *        The data is streamed through a buffer with room for three frames. Each update()
+ *        writes to the next third with an unsynchronized glMapBufferRange(), so the CPU never
+ *        waits for the GPU to finish drawing with the data of the previous frames. A fence
+ *        per third makes sure that data is not overwritten while the GPU may still read it,
+ *        which only blocks when the CPU is more than two frames ahead. The buffer grows
+ *        when more instances are written than fit.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <vector>
+
+typedef struct __GLsync* GLsync;
+
+class InstanceBuffer {
+public:
+    // The data of one instance, as stored in the buffer
+    struct Instance {
+        GLfloat position[3] = {0.0f, 0.0f, 0.0f};    // Translation, applied last
+        GLfloat scale = 1.0f;                         // Uniform scale, applied first
+        GLfloat rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};  // Unit quaternion (x, y, z, w)
+        GLubyte color[4] = {255, 255, 255, 255};      // RGBA, used if the buffer has colours
+        GLuint segments = 0;  // Segments of a procedural sphere, 0 for those of the sphere
+    };
+
+    /* Create an empty buffer. With 'colors' false, the colour of each instance is ignored
+       and the shader gets white. */
+    explicit InstanceBuffer(bool colors = false);
+    ~InstanceBuffer();
+
+    InstanceBuffer(const InstanceBuffer&) = delete;
+    InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+
+    /* Send new instance data to the GPU, for the draws that follow */
+    void update(const std::vector<Instance>& instances);
+
+    // returns the number of instances written by the last update()
+    int count() const;
+
+    // returns the largest segments of the instances written by the last update()
+    int maxSegments() const;
+
+    /* Set up the attributes 3 to 6 of the bound VAO to read the current instances. Does
+       nothing before the first update() with any instances, since there is no buffer yet. */
+    void setAttributes() const;
+
+    /* Disable the attributes again, so the VAO can be used without instances */
+    void clearAttributes() const;
+
+private:
+    static const int regions = 3;  // Frames in flight
+
+    GLuint buffer_;
+    int capacity_;  // Instances per region
+    int count_;
+    int maxsegments_;
+    int region_;    // Region written by the last update()
+    GLsync fences_[regions];
+    bool colors_;
+};
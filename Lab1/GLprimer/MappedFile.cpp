@@ -0,0 +1,130 @@
+/*
+ * Read-only memory mapped files
+ *
+ * This code is in the public domain.
+ */
+#include "MappedFile.hpp"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <iostream>
+
+/* Constructor: create an empty object with no file mapped */
+MappedFile::MappedFile()
+    : data_(nullptr)
+    , size_(0)
+    , open_(false)
+#if defined(_WIN32)
+    , file_(nullptr)
+    , mapping_(nullptr)
+#endif
+{
+}
+
+/* Constructor to open and map a file all at once */
+MappedFile::MappedFile(const std::string& filename) : MappedFile() { open(filename); }
+
+/* Destructor: unmap the file */
+MappedFile::~MappedFile() { close(); }
+
+bool MappedFile::open(const std::string& filename) {
+    close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER filesize;
+    if (!GetFileSizeEx(file, &filesize)) {
+        CloseHandle(file);
+        return false;
+    }
+    size_ = static_cast<size_t>(filesize.QuadPart);
+    if (size_ == 0) {
+        // Empty files can not be mapped, but they are still valid files
+        CloseHandle(file);
+        data_ = "";
+        open_ = true;
+        return true;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        size_ = 0;
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        size_ = 0;
+        return false;
+    }
+    file_ = file;
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(view);
+#else
+    const int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat filestat;
+    if (fstat(fd, &filestat) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size_ = static_cast<size_t>(filestat.st_size);
+    if (size_ == 0) {
+        // Empty files can not be mapped, but they are still valid files
+        ::close(fd);
+        data_ = "";
+        open_ = true;
+        return true;
+    }
+    void* view = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // The mapping keeps its own reference to the file
+    if (view == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+    // The whole file is read front to back, so ask for aggressive read-ahead
+    madvise(view, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char*>(view);
+#endif
+    open_ = true;
+    return true;
+}
+
+void MappedFile::close() {
+    if (open_ && size_ > 0) {
+#if defined(_WIN32)
+        UnmapViewOfFile(data_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+        CloseHandle(static_cast<HANDLE>(file_));
+        file_ = nullptr;
+        mapping_ = nullptr;
+#else
+        munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    data_ = nullptr;
+    size_ = 0;
+    open_ = false;
+}
+
+bool MappedFile::isOpen() const { return open_; }
+
+const char* MappedFile::data() const { return data_; }
+
+size_t MappedFile::size() const { return size_; }
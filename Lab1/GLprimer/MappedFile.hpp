@@ -0,0 +1,52 @@
+/*
+ * A class to map a file read-only into memory.
+ *
+ * Usage: Call open() with a file name, or use the constructor with a file name argument.
+ *        The contents are available through data() and size() until close() is called or
+ *        the object is destroyed. Note that the mapped data is NOT null terminated.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+class MappedFile {
+public:
+    /* Constructor: create an empty object with no file mapped */
+    MappedFile();
+
+    /* Constructor to open and map a file all at once */
+    MappedFile(const std::string& filename);
+
+    /* Destructor: unmap the file */
+    ~MappedFile();
+
+    // A mapping can not be shared between objects
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* Map a file into memory. Returns false if the file could not be opened or mapped */
+    bool open(const std::string& filename);
+
+    /* Unmap the file, if any */
+    void close();
+
+    bool isOpen() const;
+
+    // returns a pointer to the first byte of the file
+    const char* data() const;
+
+    // returns the file size in bytes
+    size_t size() const;
+
+private:
+    const char* data_;  // Start of the mapping (or an empty string for empty files)
+    size_t size_;       // Size of the mapping in bytes
+    bool open_;
+#if defined(_WIN32)
+    void* file_;     // HANDLE of the opened file
+    void* mapping_;  // HANDLE of the file mapping object
+#endif
+};
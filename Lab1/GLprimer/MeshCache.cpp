@@ -0,0 +1,229 @@
+/*
+ * Binary cache files for meshes loaded from OBJ files
+ *
+ * This code is in the public domain.
+ */
+#include "MeshCache.hpp"
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+namespace {
+
+const char magic[8] = {'T', 'N', 'M', 'M', 'E', 'S', 'H', '\0'};
+const uint32_t version = 1;
+const uint64_t pageSize = 4096;
+
+// The first page of a cache file. All offsets are counted from the start of the file.
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t options;      // Processing applied to the mesh, chosen by the caller
+    uint64_t sourcesize;   // Size of the OBJ file in bytes
+    int64_t sourcetime;    // Modification time of the OBJ file
+    uint64_t sourcehash;   // Hash of the OBJ file contents
+    uint32_t numvertices;  // Number of vertices (8 floats each)
+    uint32_t numindices;
+    uint64_t vertexoffset;
+    uint64_t indexoffset;
+    uint64_t datahash;  // Hash of the vertex and index blocks
+};
+
+uint64_t alignToPage(uint64_t offset) { return (offset + pageSize - 1) / pageSize * pageSize; }
+
+/*
+ * A fast 64 bit hash, processing 8 bytes at a time. It only needs to catch stale and damaged
+ * files, so it is not meant to be cryptographically strong.
+ */
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+    const uint64_t k = 0x9E3779B97F4A7C15ull;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ (size * k);
+    while (size >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = (h ^ (word * k)) * 0xBF58476D1CE4E5B9ull;
+        h ^= h >> 31;
+        p += 8;
+        size -= 8;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, p, size);
+    h = (h ^ (tail * k)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 29);
+}
+
+/*
+ * A temporary file name next to 'filename' that no other writer uses at the same time, from
+ * the process ID and a count of the files written by this process
+ */
+std::string tempFilename(const std::string& filename) {
+    static std::atomic<unsigned long> count(0);
+#if defined(_WIN32)
+    const long pid = _getpid();
+#else
+    const long pid = getpid();
+#endif
+    return filename + "." + std::to_string(pid) + "." + std::to_string(count++) + ".tmp";
+}
+
+}  // namespace
+
+/* Constructor: create an empty object with no cache file opened */
+MeshCache::MeshCache() : vertices_(nullptr), indices_(nullptr), numvertices_(0), numindices_(0) {}
+
+std::string MeshCache::cacheFilename(const std::string& objfilename) {
+    return objfilename + ".meshcache";
+}
+
+bool MeshCache::sourceTime(const std::string& objfilename, int64_t& time) {
+    std::error_code error;
+    const auto filetime = std::filesystem::last_write_time(objfilename, error);
+    if (error) {
+        return false;
+    }
+    time = static_cast<int64_t>(filetime.time_since_epoch().count());
+    return true;
+}
+
+MeshCache::Source MeshCache::source(const char* data, size_t size, int64_t time) {
+    Source source;
+    source.size = size;
+    source.time = time;
+    source.hash = hashBytes(data, size);
+    return source;
+}
+
+bool MeshCache::open(const std::string& objfilename, uint32_t options) {
+    file_.close();
+    vertices_ = nullptr;
+    indices_ = nullptr;
+    numvertices_ = 0;
+    numindices_ = 0;
+
+    if (!file_.open(cacheFilename(objfilename))) {
+        return false;  // No cache yet
+    }
+
+    Header header;
+    if (file_.size() < sizeof(Header)) {
+        file_.close();
+        return false;
+    }
+    memcpy(&header, file_.data(), sizeof(Header));
+
+    // Check the format, and that the blocks are where they should be and fit in the file
+    const uint64_t vertexbytes = uint64_t(header.numvertices) * 8 * sizeof(float);
+    const uint64_t indexbytes = uint64_t(header.numindices) * sizeof(unsigned int);
+    if (memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version ||
+        header.options != options || header.vertexoffset != pageSize ||
+        header.indexoffset != alignToPage(header.vertexoffset + vertexbytes) ||
+        header.indexoffset + indexbytes > file_.size()) {
+        file_.close();
+        return false;
+    }
+
+    // Check that the OBJ file has not changed since the cache was written
+    int64_t sourcetime;
+    MappedFile objfile;
+    if (!sourceTime(objfilename, sourcetime) || !objfile.open(objfilename)) {
+        file_.close();
+        return false;
+    }
+    const Source current = source(objfile.data(), objfile.size(), sourcetime);
+    if (current.size != header.sourcesize || current.time != header.sourcetime ||
+        current.hash != header.sourcehash) {
+        file_.close();
+        return false;
+    }
+
+    // Check that the data itself is intact
+    const char* vertexdata = file_.data() + header.vertexoffset;
+    const char* indexdata = file_.data() + header.indexoffset;
+    if (hashBytes(indexdata, indexbytes, hashBytes(vertexdata, vertexbytes)) != header.datahash) {
+        file_.close();
+        return false;
+    }
+
+    // Both blocks are page aligned in the mapping, so the pointers are properly aligned
+    vertices_ = reinterpret_cast<const float*>(vertexdata);
+    indices_ = reinterpret_cast<const unsigned int*>(indexdata);
+    numvertices_ = static_cast<int>(header.numvertices);
+    numindices_ = static_cast<int>(header.numindices);
+    return true;
+}
+
+bool MeshCache::write(const std::string& objfilename, const Source& source,
+                      const std::vector<float>& vertexarray,
+                      const std::vector<unsigned int>& indexarray, uint32_t options) {
+    Header header = {};
+    memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.options = options;
+    header.sourcesize = source.size;
+    header.sourcetime = source.time;
+    header.sourcehash = source.hash;
+    const uint64_t vertexbytes = vertexarray.size() * sizeof(float);
+    const uint64_t indexbytes = indexarray.size() * sizeof(unsigned int);
+    header.numvertices = static_cast<uint32_t>(vertexarray.size() / 8);
+    header.numindices = static_cast<uint32_t>(indexarray.size());
+    header.vertexoffset = pageSize;
+    header.indexoffset = alignToPage(header.vertexoffset + vertexbytes);
+    header.datahash = hashBytes(indexarray.data(), indexbytes,
+                                hashBytes(vertexarray.data(), vertexbytes));
+
+    // Write to a temporary file first, so a reader never sees a half written cache, and
+    // concurrent writers of the same cache each rename a complete file of their own
+    const std::string filename = cacheFilename(objfilename);
+    const std::string tempname = tempFilename(filename);
+    {
+        std::ofstream out(tempname, std::ios_base::out | std::ios_base::binary);
+        if (!out.is_open()) {
+            std::cerr << "Could not write mesh cache ('" << filename << "')\n";
+            return false;
+        }
+        const std::vector<char> padding(pageSize, 0);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(padding.data(), static_cast<std::streamsize>(pageSize - sizeof(header)));
+        out.write(reinterpret_cast<const char*>(vertexarray.data()),
+                  static_cast<std::streamsize>(vertexbytes));
+        out.write(padding.data(), static_cast<std::streamsize>(header.indexoffset -
+                                                               header.vertexoffset - vertexbytes));
+        out.write(reinterpret_cast<const char*>(indexarray.data()),
+                  static_cast<std::streamsize>(indexbytes));
+        if (!out) {
+            std::cerr << "Could not write mesh cache ('" << filename << "')\n";
+            out.close();
+            std::remove(tempname.c_str());
+            return false;
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tempname, filename, error);
+    if (error) {
+        std::cerr << "Could not write mesh cache ('" << filename << "')\n";
+        std::remove(tempname.c_str());
+        return false;
+    }
+    return true;
+}
+
+const float* MeshCache::vertices() const { return vertices_; }
+
+int MeshCache::numVertices() const { return numvertices_; }
+
+const unsigned int* MeshCache::indices() const { return indices_; }
+
+int MeshCache::numIndices() const { return numindices_; }
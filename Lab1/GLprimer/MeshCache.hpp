@@ -0,0 +1,79 @@
+/*
+ * A binary cache file for meshes loaded from OBJ files.
+ *
+ * Usage: After an OBJ file has been parsed, call MeshCache::write() to store the final vertex
+ *        and index arrays in a sidecar file next to it ("mesh.obj" -> "mesh.obj.meshcache").
+ *        It needs the Source of the file contents that were parsed: call sourceTime() before
+ *        the file is read, and source() on the contents afterwards. The file is not read again,
+ *        and a change made to it while it was parsed leaves a cache that open() rejects.
+ *        Next time, open() maps the sidecar into memory and checks that it is still valid.
+ *        vertices() and indices() then point straight into the mapped file, ready to be
+ *        handed to glBufferData(). They stay valid until the MeshCache object is destroyed.
+ *
+ *        The file has a header page followed by the interleaved vertex block (8 floats per
+ *        vertex) and the index block, each starting on a page boundary. The header records
+ *        the size, modification time and a hash of the OBJ file contents, and a hash of the
+ *        vertex and index blocks. If any of them do not match, open() fails and the caller
+ *        should parse the OBJ file again.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+class MeshCache {
+public:
+    // The OBJ file contents a cache was made from
+    struct Source {
+        uint64_t size = 0;  // In bytes
+        int64_t time = 0;   // Modification time
+        uint64_t hash = 0;  // Hash of the contents
+    };
+
+    /* Constructor: create an empty object with no cache file opened */
+    MeshCache();
+
+    /*
+     * Open the cache file for an OBJ file and validate it against the OBJ file.
+     * 'options' identifies the processing that was applied to the mesh, and must match the
+     * value the cache was written with. Returns false if there is no valid cache.
+     */
+    bool open(const std::string& objfilename, uint32_t options = 0);
+
+    /*
+     * Write a cache file for an OBJ file, parsed from the contents described by 'source'.
+     * Returns false if the file could not be written.
+     */
+    static bool write(const std::string& objfilename, const Source& source,
+                      const std::vector<float>& vertexarray,
+                      const std::vector<unsigned int>& indexarray, uint32_t options = 0);
+
+    /* Find the modification time of an OBJ file. Returns false if it does not exist */
+    static bool sourceTime(const std::string& objfilename, int64_t& time);
+
+    /* Describe the 'size' bytes of OBJ file contents at 'data', with 'time' from sourceTime() */
+    static Source source(const char* data, size_t size, int64_t time);
+
+    /* Return the name of the cache file for an OBJ file */
+    static std::string cacheFilename(const std::string& objfilename);
+
+    // returns the interleaved vertex data in the mapped file (8 floats per vertex)
+    const float* vertices() const;
+    int numVertices() const;
+
+    // returns the index data in the mapped file
+    const unsigned int* indices() const;
+    int numIndices() const;
+
+private:
+    MappedFile file_;
+    const float* vertices_;
+    const unsigned int* indices_;
+    int numvertices_;
+    int numindices_;
+};
@@ -0,0 +1,554 @@
+/*
+ * Reordering of indexed triangle meshes for vertex cache and vertex fetch locality
+ *
+ * This code is in the public domain.
+ */
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace {
+
+// Parameters of the scoring function, as suggested by Forsyth
+const int cacheSize = 32;  // Size of the simulated LRU cache
+const float cacheDecayPower = 1.5f;
+const float lastTriangleScore = 0.75f;
+const float valenceBoostScale = 2.0f;
+const float valenceBoostPower = 0.5f;
+const int maxValence = 64;  // Higher valences all get the same (small) boost
+
+/*
+ * The score tables. Vertices in the triangle just drawn get a fixed score, so the next
+ * triangle is not forced to use them, and the score of older cache entries decays with their
+ * position. Vertices with few triangles left get a boost, so they are finished off early
+ * instead of leaving lone triangles behind that need the vertex transformed again later.
+ */
+struct ScoreTables {
+    float cache[cacheSize];
+    float valence[maxValence + 1];
+
+    ScoreTables() {
+        for (int i = 0; i < cacheSize; i++) {
+            if (i < 3) {
+                cache[i] = lastTriangleScore;
+            } else {
+                const float scaler = 1.0f / (cacheSize - 3);
+                cache[i] = std::pow(1.0f - static_cast<float>(i - 3) * scaler, cacheDecayPower);
+            }
+        }
+        valence[0] = 0.0f;
+        for (int i = 1; i <= maxValence; i++) {
+            valence[i] = valenceBoostScale * std::pow(static_cast<float>(i), -valenceBoostPower);
+        }
+    }
+
+    float score(int cacheposition, int remaining) const {
+        if (remaining == 0) {
+            return -1.0f;  // No triangles left, the vertex no longer matters
+        }
+        const float cachescore = cacheposition >= 0 ? cache[cacheposition] : 0.0f;
+        return cachescore + valence[std::min(remaining, maxValence)];
+    }
+};
+
+// A FIFO vertex cache. A vertex is in it if it was added less than 'size' misses ago.
+class FifoCache {
+public:
+    FifoCache(size_t numvertices, int size)
+        : addedat_(numvertices, -size - 1), size_(size), time_(0) {}
+
+    // Return the number of vertices of a triangle that missed the cache, and add them to it
+    int misses(const unsigned int* triangle) {
+        int count = 0;
+        for (int k = 0; k < 3; k++) {
+            if (time_ - addedat_[triangle[k]] > size_) {
+                addedat_[triangle[k]] = time_++;
+                count++;
+            }
+        }
+        return count;
+    }
+
+    // Empty the cache, by moving the time forward past all entries
+    void flush() { time_ += size_ + 1; }
+
+private:
+    std::vector<int> addedat_;
+    int size_;
+    int time_;
+};
+
+/*
+ * The half-edges of a triangle mesh by their first vertex, to find the triangle on the other
+ * side of an edge. Corner c of triangle c / 3 starts the half-edge to the next corner.
+ */
+class HalfEdges {
+public:
+    HalfEdges(const std::vector<unsigned int>& indexarray, size_t numvertices)
+        : indices_(indexarray), offsets_(numvertices + 1, 0), corners_(indexarray.size()) {
+        for (unsigned int v : indexarray) {
+            offsets_[v + 1]++;
+        }
+        for (size_t v = 0; v < numvertices; v++) {
+            offsets_[v + 1] += offsets_[v];
+        }
+        std::vector<size_t> fill(offsets_.begin(), offsets_.end() - 1);
+        for (size_t c = 0; c < indexarray.size(); c++) {
+            corners_[fill[indexarray[c]]++] = c;
+        }
+    }
+
+    // The corner that starts the half-edge a -> b of a triangle not 'used', or -1
+    long find(unsigned int a, unsigned int b, const std::vector<unsigned char>& used) const {
+        for (size_t e = offsets_[a]; e < offsets_[a + 1]; e++) {
+            const size_t c = corners_[e];
+            if (!used[c / 3] && indices_[next(c)] == b) {
+                return static_cast<long>(c);
+            }
+        }
+        return -1;
+    }
+
+    // The next corner of the same triangle
+    static size_t next(size_t c) { return c % 3 == 2 ? c - 2 : c + 1; }
+
+private:
+    const std::vector<unsigned int>& indices_;
+    std::vector<size_t> offsets_;
+    std::vector<size_t> corners_;
+};
+
+bool isDegenerate(const unsigned int* triangle) {
+    return triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2];
+}
+
+/*
+ * Follow the strip that starts with 'triangle', at corner 'rotation', marking its triangles as
+ * used. The indices go in 'strip' and the triangles in 'triangles'. Triangle k of a strip is
+ * (k, k + 1, k + 2) if k is even, and (k + 1, k, k + 2) if k is odd, so the next triangle
+ * must have the last edge in the order that keeps the winding.
+ */
+void followStrip(const std::vector<unsigned int>& indexarray, const HalfEdges& edges,
+                 size_t triangle, int rotation, std::vector<unsigned char>& used,
+                 std::vector<unsigned int>& strip, std::vector<size_t>& triangles) {
+    size_t c = 3 * triangle + static_cast<size_t>(rotation);
+    strip.clear();
+    for (int k = 0; k < 3; k++, c = HalfEdges::next(c)) {
+        strip.push_back(indexarray[c]);
+    }
+    triangles.assign(1, triangle);
+    used[triangle] = 1;
+    for (;;) {
+        const bool odd = strip.size() % 2 == 1;
+        const unsigned int p = strip[strip.size() - 2];
+        const unsigned int q = strip.back();
+        const long corner = odd ? edges.find(q, p, used) : edges.find(p, q, used);
+        if (corner < 0) {
+            break;
+        }
+        const size_t n = static_cast<size_t>(corner);
+        strip.push_back(indexarray[HalfEdges::next(HalfEdges::next(n))]);
+        triangles.push_back(n / 3);
+        used[n / 3] = 1;
+    }
+}
+
+}  // namespace
+
+namespace meshopt {
+
+CacheStats analyzeVertexCache(const std::vector<unsigned int>& indexarray, int numvertices,
+                              int cachesize) {
+    CacheStats stats;
+    if (indexarray.empty() || numvertices == 0) {
+        return stats;
+    }
+
+    // A vertex is in the FIFO cache if it was added less than 'cachesize' misses ago
+    std::vector<int> addedat(static_cast<size_t>(numvertices), -cachesize - 1);
+    std::vector<bool> referenced(static_cast<size_t>(numvertices), false);
+    int unique = 0;
+    for (unsigned int index : indexarray) {
+        if (stats.transformed - addedat[index] > cachesize) {
+            addedat[index] = stats.transformed;
+            stats.transformed++;
+        }
+        if (!referenced[index]) {
+            referenced[index] = true;
+            unique++;
+        }
+    }
+    const double numtris = static_cast<double>(indexarray.size() / 3);
+    stats.acmr = static_cast<double>(stats.transformed) / numtris;
+    stats.atvr = static_cast<double>(stats.transformed) / unique;
+    return stats;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indexarray, int numvertices) {
+    static const ScoreTables tables;
+    const size_t numtris = indexarray.size() / 3;
+    if (numtris == 0) {
+        return;
+    }
+    const size_t nv = static_cast<size_t>(numvertices);
+
+    // Triangles using each vertex, in one flat array. remaining[v] of them are not drawn yet,
+    // and they are kept first in the list of the vertex.
+    std::vector<int> remaining(nv, 0);
+    for (unsigned int index : indexarray) {
+        remaining[index]++;
+    }
+    std::vector<size_t> first(nv + 1, 0);
+    for (size_t v = 0; v < nv; v++) {
+        first[v + 1] = first[v] + static_cast<size_t>(remaining[v]);
+    }
+    std::vector<int> adjacency(indexarray.size());
+    {
+        std::vector<size_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indexarray.size(); i++) {
+            adjacency[fill[indexarray[i]]++] = static_cast<int>(i / 3);
+        }
+    }
+
+    std::vector<float> vertexscore(nv);
+    for (size_t v = 0; v < nv; v++) {
+        vertexscore[v] = tables.score(-1, remaining[v]);
+    }
+    std::vector<float> triscore(numtris);
+    std::vector<bool> drawn(numtris, false);
+    int best = 0;
+    for (size_t t = 0; t < numtris; t++) {
+        triscore[t] = vertexscore[indexarray[3 * t]] + vertexscore[indexarray[3 * t + 1]] +
+                      vertexscore[indexarray[3 * t + 2]];
+        if (triscore[t] > triscore[best]) {
+            best = static_cast<int>(t);
+        }
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indexarray.size());
+    int cache[cacheSize + 3];
+    int cachecount = 0;
+    size_t nextundrawn = 0;  // Where to look for a new start when the cache has no candidates
+
+    while (result.size() < indexarray.size()) {
+        if (best < 0) {
+            while (drawn[nextundrawn]) {
+                nextundrawn++;
+            }
+            best = static_cast<int>(nextundrawn);
+        }
+        const unsigned int* tri = &indexarray[3 * static_cast<size_t>(best)];
+        result.insert(result.end(), tri, tri + 3);
+        drawn[static_cast<size_t>(best)] = true;
+
+        // Remove the triangle from the lists of its vertices
+        for (int k = 0; k < 3; k++) {
+            const unsigned int v = tri[k];
+            int* list = &adjacency[first[v]];
+            const int count = remaining[v];
+            for (int i = 0; i < count; i++) {
+                if (list[i] == best) {
+                    std::swap(list[i], list[count - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // The vertices of the triangle go first in the LRU cache, followed by the old entries
+        int newcache[cacheSize + 3];
+        int newcount = 0;
+        for (int k = 0; k < 3; k++) {
+            newcache[newcount++] = static_cast<int>(tri[k]);
+        }
+        for (int i = 0; i < cachecount; i++) {
+            const int v = cache[i];
+            if (v != static_cast<int>(tri[0]) && v != static_cast<int>(tri[1]) &&
+                v != static_cast<int>(tri[2])) {
+                newcache[newcount++] = v;
+            }
+        }
+
+        // Update the scores of all vertices that moved in or out of the cache, and of their
+        // triangles that are left
+        for (int i = 0; i < newcount; i++) {
+            const size_t v = static_cast<size_t>(newcache[i]);
+            const int position = i < cacheSize ? i : -1;
+            const float score = tables.score(position, remaining[v]);
+            const float delta = score - vertexscore[v];
+            vertexscore[v] = score;
+            for (int j = 0; j < remaining[v]; j++) {
+                const int t = adjacency[first[v] + static_cast<size_t>(j)];
+                triscore[static_cast<size_t>(t)] += delta;
+            }
+        }
+
+        // The next triangle is the best one that uses a vertex in the cache
+        best = -1;
+        float bestscore = -1.0f;
+        for (int i = 0; i < std::min(newcount, cacheSize); i++) {
+            const size_t v = static_cast<size_t>(newcache[i]);
+            for (int j = 0; j < remaining[v]; j++) {
+                const int t = adjacency[first[v] + static_cast<size_t>(j)];
+                if (triscore[static_cast<size_t>(t)] > bestscore) {
+                    bestscore = triscore[static_cast<size_t>(t)];
+                    best = t;
+                }
+            }
+        }
+
+        cachecount = std::min(newcount, cacheSize);
+        std::copy(newcache, newcache + cachecount, cache);
+    }
+
+    indexarray.swap(result);
+}
+
+void optimizeOverdraw(const std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray,
+                      float threshold) {
+    const int cachesize = 16;
+    const size_t numtris = indexarray.size() / 3;
+    if (numtris == 0) {
+        return;
+    }
+
+    // Hard boundaries: triangles where all three vertices miss the cache. The cache optimized
+    // order starts over there, so reordering at these points costs nothing.
+    FifoCache cache(vertexarray.size() / 8, cachesize);
+    std::vector<size_t> hard;
+    for (size_t t = 0; t < numtris; t++) {
+        if (cache.misses(&indexarray[3 * t]) == 3 || t == 0) {
+            hard.push_back(t);
+        }
+    }
+    hard.push_back(numtris);
+
+    // Soft boundaries: split each hard cluster further wherever the part since the last split
+    // already has an ACMR within 'threshold' of the whole cluster. Each part is counted from a
+    // cold cache, since it may end up drawn anywhere.
+    std::vector<size_t> boundaries;
+    for (size_t c = 0; c + 1 < hard.size(); c++) {
+        const size_t begin = hard[c];
+        const size_t end = hard[c + 1];
+        cache.flush();
+        int clustermisses = 0;
+        for (size_t t = begin; t < end; t++) {
+            clustermisses += cache.misses(&indexarray[3 * t]);
+        }
+        const float limit =
+            threshold * static_cast<float>(clustermisses) / static_cast<float>(end - begin);
+
+        boundaries.push_back(begin);
+        cache.flush();
+        int runningmisses = 0;
+        size_t start = begin;
+        for (size_t t = begin; t < end; t++) {
+            runningmisses += cache.misses(&indexarray[3 * t]);
+            const float acmr =
+                static_cast<float>(runningmisses) / static_cast<float>(t + 1 - start);
+            if (acmr <= limit && t + 1 < end) {
+                boundaries.push_back(t + 1);
+                cache.flush();
+                start = t + 1;
+                runningmisses = 0;
+            }
+        }
+    }
+    boundaries.push_back(numtris);
+
+    // Area weighted centroid and normal of each cluster, and of the whole mesh
+    const size_t numclusters = boundaries.size() - 1;
+    std::vector<float> centroids(3 * numclusters, 0.0f);
+    std::vector<float> normals(3 * numclusters, 0.0f);
+    std::vector<float> areas(numclusters, 0.0f);
+    float meshcentroid[3] = {0.0f, 0.0f, 0.0f};
+    float mesharea = 0.0f;
+    for (size_t c = 0; c < numclusters; c++) {
+        for (size_t t = boundaries[c]; t < boundaries[c + 1]; t++) {
+            const float* p0 = &vertexarray[8 * size_t(indexarray[3 * t])];
+            const float* p1 = &vertexarray[8 * size_t(indexarray[3 * t + 1])];
+            const float* p2 = &vertexarray[8 * size_t(indexarray[3 * t + 2])];
+            const float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            const float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            const float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                                e1[0] * e2[1] - e1[1] * e2[0]};
+            const float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int i = 0; i < 3; i++) {
+                const float centre = (p0[i] + p1[i] + p2[i]) / 3.0f;
+                centroids[3 * c + size_t(i)] += centre * area;
+                normals[3 * c + size_t(i)] += n[i];  // The length of n is the area
+                meshcentroid[i] += centre * area;
+            }
+            areas[c] += area;
+            mesharea += area;
+        }
+    }
+    if (mesharea > 0.0f) {
+        for (float& x : meshcentroid) {
+            x /= mesharea;
+        }
+    }
+
+    // Sort key: how far the cluster lies out from the mesh centre along its own normal
+    std::vector<float> keys(numclusters, 0.0f);
+    for (size_t c = 0; c < numclusters; c++) {
+        const float* n = &normals[3 * c];
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (areas[c] > 0.0f && length > 0.0f) {
+            for (int i = 0; i < 3; i++) {
+                const float centre = centroids[3 * c + size_t(i)] / areas[c];
+                keys[c] += (centre - meshcentroid[i]) * n[i] / length;
+            }
+        }
+    }
+    std::vector<size_t> order(numclusters);
+    for (size_t c = 0; c < numclusters; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indexarray.size());
+    for (size_t c : order) {
+        result.insert(result.end(), indexarray.begin() + long(3 * boundaries[c]),
+                      indexarray.begin() + long(3 * boundaries[c + 1]));
+    }
+    indexarray.swap(result);
+}
+
+void optimizeVertexFetch(std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray) {
+    const size_t nv = vertexarray.size() / 8;
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(nv, unused);
+    unsigned int next = 0;
+    for (unsigned int& index : indexarray) {
+        if (remap[index] == unused) {
+            remap[index] = next++;
+        }
+        index = remap[index];
+    }
+    for (size_t v = 0; v < nv; v++) {
+        if (remap[v] == unused) {
+            remap[v] = next++;
+        }
+    }
+
+    std::vector<float> result(vertexarray.size());
+    for (size_t v = 0; v < nv; v++) {
+        std::copy(&vertexarray[8 * v], &vertexarray[8 * v] + 8, &result[8 * size_t(remap[v])]);
+    }
+    vertexarray.swap(result);
+}
+
+/*
+ * The next strip starts at the unused triangle with the fewest unused neighbours, taken from
+ * one queue per neighbour count. A triangle is queued again each time its count drops, and
+ * the stale entries are skipped. All three rotations of it are tried, and the longest strip
+ * is kept.
+ */
+size_t stripify(const std::vector<unsigned int>& indexarray, int numvertices,
+                std::vector<unsigned int>& strip, unsigned int restart) {
+    const size_t nt = indexarray.size() / 3;
+    const HalfEdges edges(indexarray, static_cast<size_t>(numvertices));
+    std::vector<unsigned char> used(nt, 0);
+    for (size_t t = 0; t < nt; t++) {
+        used[t] = isDegenerate(&indexarray[3 * t]) ? 1 : 0;
+    }
+
+    // Unused triangles across the edges of a triangle, on the other side (b -> a)
+    auto forNeighbours = [&](size_t t, const std::function<void(size_t)>& visit) {
+        for (size_t c = 3 * t; c < 3 * t + 3; c++) {
+            const long other = edges.find(indexarray[HalfEdges::next(c)], indexarray[c], used);
+            if (other >= 0) {
+                visit(static_cast<size_t>(other) / 3);
+            }
+        }
+    };
+    std::vector<int> neighbours(nt, 0);
+    std::vector<size_t> queues[4];
+    size_t heads[4] = {0, 0, 0, 0};
+    for (size_t t = 0; t < nt; t++) {
+        if (!used[t]) {
+            forNeighbours(t, [&](size_t) { neighbours[t]++; });
+            queues[neighbours[t]].push_back(t);
+        }
+    }
+
+    strip.clear();
+    size_t numtriangles = 0;
+    std::vector<unsigned int> candidate;
+    std::vector<unsigned int> best;
+    std::vector<size_t> triangles;
+    for (;;) {
+        size_t start = nt;
+        for (int q = 0; q < 4 && start == nt; q++) {
+            while (heads[q] < queues[q].size()) {
+                const size_t t = queues[q][heads[q]++];
+                if (!used[t] && neighbours[t] == q) {
+                    start = t;
+                    break;
+                }
+            }
+        }
+        if (start == nt) {
+            break;
+        }
+
+        // Try the rotations, and give the triangles back after each try
+        int bestrotation = 0;
+        size_t bestlength = 0;
+        for (int rotation = 0; rotation < 3; rotation++) {
+            followStrip(indexarray, edges, start, rotation, used, candidate, triangles);
+            for (size_t t : triangles) {
+                used[t] = 0;
+            }
+            if (triangles.size() > bestlength) {
+                bestlength = triangles.size();
+                bestrotation = rotation;
+            }
+        }
+        followStrip(indexarray, edges, start, bestrotation, used, best, triangles);
+        for (size_t t : triangles) {
+            forNeighbours(t, [&](size_t n) {
+                // Only a heuristic, and edges shared by more than two triangles may not match
+                neighbours[n] = std::max(neighbours[n] - 1, 0);
+                queues[neighbours[n]].push_back(n);
+            });
+        }
+        if (!strip.empty()) {
+            strip.push_back(restart);
+        }
+        strip.insert(strip.end(), best.begin(), best.end());
+        numtriangles += triangles.size();
+    }
+    return numtriangles;
+}
+
+void unstripify(const std::vector<unsigned int>& strip, std::vector<unsigned int>& indexarray,
+                unsigned int restart) {
+    indexarray.clear();
+    size_t first = 0;
+    for (size_t i = 0; i < strip.size(); i++) {
+        if (strip[i] == restart) {
+            first = i + 1;
+            continue;
+        }
+        if (i < first + 2) {
+            continue;
+        }
+        const unsigned int triangle[3] = {strip[i - 2], strip[i - 1], strip[i]};
+        if (isDegenerate(triangle)) {
+            continue;  // Joins two parts of a strip, or a fan
+        }
+        const bool odd = (i - first) % 2 == 1;
+        indexarray.push_back(odd ? triangle[1] : triangle[0]);
+        indexarray.push_back(odd ? triangle[0] : triangle[1]);
+        indexarray.push_back(triangle[2]);
+    }
+}
+
+}  // namespace meshopt
@@ -0,0 +1,76 @@
+/*
+ * Functions to reorder indexed triangle meshes for faster rendering.
+ *
+ * Usage: The meshes are in the interleaved vertex format used by TriangleSoup, 8 floats per
+ *        vertex, with three indices per triangle.
+ *
+ *        optimizeVertexCache() reorders the triangles so that vertices are reused while they
+ *        are still in the post-transform vertex cache of the GPU, which saves vertex shader
+ *        invocations. It uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" (2006).
+ *        optimizeOverdraw() reorders the triangles of a cache optimized mesh to reduce overdraw,
+ *        with the method of Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ *        Locality and Reduced Overdraw" (SIGGRAPH 2007). The triangles are split into clusters
+ *        where the vertex cache would be flushed anyway, and the clusters that face away from
+ *        the centre of the mesh, and so are likely to occlude the rest from most viewpoints,
+ *        are drawn first. The order within each cluster is kept, so the cache locality stays.
+ *        optimizeVertexFetch() then renumbers the vertices in the order they are first used,
+ *        so the vertex buffer is read close to sequentially. Run it after the triangle order
+ *        is final, since it does not change which triangles are drawn or in what order.
+ *        stripify() converts the triangles to triangle strips, separated by a restart index
+ *        for drawing with primitive restart. Each strip starts at a triangle with as few
+ *        neighbours left as possible, so the strips do not cut the mesh into islands, in the
+ *        rotation that gives the longest strip. unstripify() converts the strips back.
+ *        analyzeVertexCache() simulates a FIFO vertex cache to measure the result as ACMR
+ *        (vertices transformed per triangle, 0.5 at best) and ATVR (vertices transformed per
+ *        vertex in the mesh, 1.0 at best).
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace meshopt {
+
+// Results of a vertex cache simulation
+struct CacheStats {
+    int transformed = 0;  // Number of cache misses, each one a vertex shader invocation
+    double acmr = 0.0;    // Average cache miss ratio: transformed vertices per triangle
+    double atvr = 0.0;    // Average transformed to vertex ratio: per referenced vertex
+};
+
+/* Simulate drawing the triangles through a FIFO cache of 'cachesize' vertices */
+CacheStats analyzeVertexCache(const std::vector<unsigned int>& indexarray, int numvertices,
+                              int cachesize = 16);
+
+/* Reorder the triangles in 'indexarray' for vertex cache locality. The vertices are unchanged */
+void optimizeVertexCache(std::vector<unsigned int>& indexarray, int numvertices);
+
+/*
+ * Reorder the clusters of triangles in 'indexarray' to draw the most occluding ones first.
+ * 'threshold' is how much worse than the cache optimized order the ACMR of each cluster may
+ * get from splitting it into smaller clusters (1.05 allows 5 percent).
+ */
+void optimizeOverdraw(const std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray,
+                      float threshold = 1.05f);
+
+/*
+ * Renumber the vertices in the order they are first referenced by 'indexarray', and reorder
+ * 'vertexarray' to match. Vertices that are never referenced are kept, at the end.
+ */
+void optimizeVertexFetch(std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray);
+
+/*
+ * Convert the triangles in 'indexarray' to triangle strips in 'strip', with 'restart' between
+ * them. The strips keep the winding of the triangles. Degenerate triangles are left out.
+ * Returns the number of triangles in the strips.
+ */
+size_t stripify(const std::vector<unsigned int>& indexarray, int numvertices,
+                std::vector<unsigned int>& strip, unsigned int restart = ~0u);
+
+/* Convert triangle strips separated by 'restart' to triangles, without the degenerate ones */
+void unstripify(const std::vector<unsigned int>& strip, std::vector<unsigned int>& indexarray,
+                unsigned int restart = ~0u);
+
+}  // namespace meshopt
@@ -0,0 +1,470 @@
+/*
+ * Quadric error edge collapse simplification
+ *
+ * This code is in the public domain.
+ */
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+// Edges on borders and seams are held in place by planes this much stronger than the surface
+const double borderWeight = 10.0;
+
+// How a vertex may move, decided by the edges around all vertices at its position
+enum class Kind : unsigned char {
+    Manifold,  // Inside the surface, no seam: may collapse into any neighbour
+    Border,    // On an open border: only along the border
+    Seam,      // On a seam between two copies: only along the seam, with both copies
+    Locked     // Where borders or seams meet: never moves
+};
+
+/*
+ * The squared distance to a weighted set of planes, as the symmetric matrix of the quadratic
+ * form x^T A x + 2 b^T x + c. Divided by the total weight, it is the mean squared distance.
+ */
+struct Quadric {
+    double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    double c = 0.0;
+    double weight = 0.0;
+
+    // Add the plane n.x + d = 0, with a unit normal n
+    void addPlane(const double* n, double d, double w) {
+        a00 += w * n[0] * n[0];
+        a11 += w * n[1] * n[1];
+        a22 += w * n[2] * n[2];
+        a01 += w * n[0] * n[1];
+        a02 += w * n[0] * n[2];
+        a12 += w * n[1] * n[2];
+        b0 += w * n[0] * d;
+        b1 += w * n[1] * d;
+        b2 += w * n[2] * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q) {
+        a00 += q.a00;
+        a11 += q.a11;
+        a22 += q.a22;
+        a01 += q.a01;
+        a02 += q.a02;
+        a12 += q.a12;
+        b0 += q.b0;
+        b1 += q.b1;
+        b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    // returns the root mean square distance from 'p' to the planes
+    float distance(const float* p) const {
+        const double x = p[0], y = p[1], z = p[2];
+        const double e = a00 * x * x + a11 * y * y + a22 * z * z +
+                         2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                         2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return weight > 0.0 ? static_cast<float>(std::sqrt(std::max(e / weight, 0.0))) : 0.0f;
+    }
+};
+
+void cross(const double* u, const double* v, double* n) {
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+}
+
+double dot(const double* u, const double* v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; }
+
+// Normal of the triangle p0 p1 p2, with the length of twice its area
+void triangleNormal(const float* p0, const float* p1, const float* p2, double* n) {
+    const double u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+    const double v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+    cross(u, v, n);
+}
+
+// A candidate collapse of vertex 'from' into vertex 'to'
+struct Collapse {
+    unsigned int from;
+    unsigned int to;
+    float error;
+};
+
+class Simplifier {
+public:
+    Simplifier(const std::vector<float>& vertexarray, std::vector<unsigned int>& indices)
+        : vertices_(vertexarray),
+          indices_(indices),
+          numvertices_(vertexarray.size() / 8),
+          position_(numvertices_),
+          wedge_(numvertices_),
+          kind_(numvertices_, Kind::Manifold),
+          quadrics_(numvertices_) {
+        findPositions();
+        buildEdges();
+        classify();
+        computeQuadrics();
+    }
+
+    /* Collapse the edges with the least error first, a pass at a time, until done */
+    float run(size_t targetindexcount, float maxerror) {
+        float error = 0.0f;
+        while (indices_.size() > targetindexcount) {
+            const size_t triangles = indices_.size() / 3;
+            const size_t target = targetindexcount / 3;
+            if (pass(triangles - target, maxerror, error) == 0) {
+                break;
+            }
+            buildEdges();
+        }
+        return error;
+    }
+
+private:
+    const float* pos(unsigned int v) const { return &vertices_[8 * static_cast<size_t>(v)]; }
+
+    /* Give all vertices with the same position a common representative, and link them in a
+       circular list of wedges */
+    void findPositions() {
+        std::vector<unsigned int> order(numvertices_);
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) {
+            return std::lexicographical_compare(pos(a), pos(a) + 3, pos(b), pos(b) + 3);
+        });
+        size_t first = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            const bool last =
+                i + 1 == order.size() || !std::equal(pos(order[i]), pos(order[i]) + 3,
+                                                      pos(order[i + 1]));
+            position_[order[i]] = order[first];
+            wedge_[order[i]] = last ? order[first] : order[i + 1];
+            if (last) {
+                first = i + 1;
+            }
+        }
+    }
+
+    /* Build the list of outgoing half-edges of each vertex, and find the open ones: a -> b
+       is open if no triangle has the edge b -> a between the same two vertices. */
+    void buildEdges() {
+        edgeoffsets_.assign(numvertices_ + 1, 0);
+        for (unsigned int v : indices_) {
+            edgeoffsets_[v + 1]++;
+        }
+        std::partial_sum(edgeoffsets_.begin(), edgeoffsets_.end(), edgeoffsets_.begin());
+        edgetargets_.resize(indices_.size());
+        triangles_.resize(indices_.size());
+        std::vector<size_t> fill(edgeoffsets_.begin(), edgeoffsets_.end() - 1);
+        for (size_t t = 0; t < indices_.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                const unsigned int a = indices_[t + static_cast<size_t>(k)];
+                const unsigned int b = indices_[t + static_cast<size_t>((k + 1) % 3)];
+                triangles_[fill[a]] = static_cast<unsigned int>(t / 3);
+                edgetargets_[fill[a]++] = b;
+            }
+        }
+
+        openout_.assign(numvertices_, 0);
+        openin_.assign(numvertices_, 0);
+        openouttarget_.assign(numvertices_, ~0u);
+        openinsource_.assign(numvertices_, ~0u);
+        for (unsigned int a = 0; a < numvertices_; a++) {
+            for (size_t e = edgeoffsets_[a]; e < edgeoffsets_[a + 1]; e++) {
+                const unsigned int b = edgetargets_[e];
+                if (!hasEdge(b, a)) {
+                    openout_[a]++;
+                    openouttarget_[a] = b;
+                    openin_[b]++;
+                    openinsource_[b] = a;
+                }
+            }
+        }
+    }
+
+    bool hasEdge(unsigned int a, unsigned int b) const {
+        for (size_t e = edgeoffsets_[a]; e < edgeoffsets_[a + 1]; e++) {
+            if (edgetargets_[e] == b) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Is there an edge a -> b between any vertices at the positions of a and b?
+    bool hasPositionEdge(unsigned int a, unsigned int b) const {
+        unsigned int w = a;
+        do {
+            for (size_t e = edgeoffsets_[w]; e < edgeoffsets_[w + 1]; e++) {
+                if (position_[edgetargets_[e]] == position_[b]) {
+                    return true;
+                }
+            }
+            w = wedge_[w];
+        } while (w != a);
+        return false;
+    }
+
+    void classify() {
+        for (unsigned int v = 0; v < numvertices_; v++) {
+            if (position_[v] != v) {
+                continue;  // Done with the representative
+            }
+            const unsigned int other = wedge_[v];
+            Kind kind = Kind::Locked;
+            if (other == v) {
+                if (openout_[v] == 0 && openin_[v] == 0) {
+                    kind = Kind::Manifold;
+                } else if (openout_[v] == 1 && openin_[v] == 1) {
+                    kind = Kind::Border;
+                }
+            } else if (wedge_[other] == v && openout_[v] == 1 && openin_[v] == 1 &&
+                       openout_[other] == 1 && openin_[other] == 1) {
+                // Two copies, each with one open edge in and out. It is a seam if the open
+                // edges are closed by the other copy, and a border between seams otherwise.
+                if (hasPositionEdge(openouttarget_[v], v) && hasPositionEdge(v, openinsource_[v]) &&
+                    hasPositionEdge(openouttarget_[other], other) &&
+                    hasPositionEdge(other, openinsource_[other])) {
+                    kind = Kind::Seam;
+                }
+            }
+            unsigned int w = v;
+            do {
+                kind_[w] = kind;
+                w = wedge_[w];
+            } while (w != v);
+        }
+    }
+
+    /* Sum the planes of the triangles around each position, and the planes that hold the
+       border and seam edges in place */
+    void computeQuadrics() {
+        for (size_t t = 0; t < indices_.size(); t += 3) {
+            const unsigned int* tri = &indices_[t];
+            double n[3];
+            triangleNormal(pos(tri[0]), pos(tri[1]), pos(tri[2]), n);
+            const double area = std::sqrt(dot(n, n));
+            if (area == 0.0) {
+                continue;
+            }
+            for (double& x : n) {
+                x /= area;
+            }
+            const float* p0 = pos(tri[0]);
+            const double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+            for (int k = 0; k < 3; k++) {
+                quadrics_[position_[tri[k]]].addPlane(n, d, 0.5 * area);
+            }
+
+            // A plane through each open edge, perpendicular to the triangle
+            for (int k = 0; k < 3; k++) {
+                const unsigned int a = tri[k];
+                const unsigned int b = tri[(k + 1) % 3];
+                if (hasEdge(b, a)) {
+                    continue;
+                }
+                const float* pa = pos(a);
+                const float* pb = pos(b);
+                const double e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+                double m[3];
+                cross(e, n, m);
+                const double length = std::sqrt(dot(m, m));
+                if (length == 0.0) {
+                    continue;
+                }
+                for (double& x : m) {
+                    x /= length;
+                }
+                const double md = -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]);
+                const double w = borderWeight * dot(e, e);
+                quadrics_[position_[a]].addPlane(m, md, w);
+                quadrics_[position_[b]].addPlane(m, md, w);
+            }
+        }
+    }
+
+    /* May 'from' collapse into 'to'? For seams, also find the copy of 'to' that the other
+       copy of 'from' collapses into. */
+    bool canCollapse(unsigned int from, unsigned int to, unsigned int& seamto) const {
+        if (position_[from] == position_[to]) {
+            return false;
+        }
+        switch (kind_[from]) {
+            case Kind::Manifold:
+                return true;
+            case Kind::Border:
+                // Into the next vertex along the border, which may be a locked corner
+                return (kind_[to] == Kind::Border || kind_[to] == Kind::Locked) &&
+                       (openouttarget_[from] == to || openinsource_[from] == to);
+            case Kind::Seam: {
+                if (kind_[to] != Kind::Seam && kind_[to] != Kind::Locked) {
+                    return false;
+                }
+                // The open edge from -> to runs the other way between the other copies
+                const unsigned int other = wedge_[from];
+                if (openouttarget_[from] == to) {
+                    seamto = openinsource_[other];
+                } else if (openinsource_[from] == to) {
+                    seamto = openouttarget_[other];
+                } else {
+                    return false;
+                }
+                return seamto != ~0u && position_[seamto] == position_[to];
+            }
+            case Kind::Locked:
+                return false;
+        }
+        return false;
+    }
+
+    // Would moving 'from' onto 'to' turn any triangle around 'from' over?
+    bool flips(unsigned int from, unsigned int to) const {
+        const float* target = pos(to);
+        for (size_t e = edgeoffsets_[from]; e < edgeoffsets_[from + 1]; e++) {
+            const unsigned int* tri = &indices_[3 * static_cast<size_t>(triangles_[e])];
+            unsigned int v[3];
+            for (int k = 0; k < 3; k++) {
+                v[k] = remap_[tri[k]];
+            }
+            if (position_[v[0]] == position_[to] || position_[v[1]] == position_[to] ||
+                position_[v[2]] == position_[to]) {
+                continue;  // Collapses away
+            }
+            const float* p[3] = {pos(v[0]), pos(v[1]), pos(v[2])};
+            double before[3];
+            triangleNormal(p[0], p[1], p[2], before);
+            for (int k = 0; k < 3; k++) {
+                if (position_[v[k]] == position_[from]) {
+                    p[k] = target;
+                }
+            }
+            double after[3];
+            triangleNormal(p[0], p[1], p[2], after);
+            if (dot(before, before) > 0.0 && dot(before, after) <= 0.0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* Make the best collapses that do not touch each other. Returns the number made. */
+    size_t pass(size_t trianglestoremove, float maxerror, float& error) {
+        // Each edge, in the better of its two directions
+        std::vector<Collapse> collapses;
+        for (size_t t = 0; t < indices_.size(); t += 3) {
+            for (int k = 0; k < 3; k++) {
+                const unsigned int a = indices_[t + static_cast<size_t>(k)];
+                const unsigned int b = indices_[t + static_cast<size_t>((k + 1) % 3)];
+                unsigned int seam;
+                const float ab = canCollapse(a, b, seam)
+                                     ? quadrics_[position_[a]].distance(pos(b))
+                                     : -1.0f;
+                const float ba = canCollapse(b, a, seam)
+                                     ? quadrics_[position_[b]].distance(pos(a))
+                                     : -1.0f;
+                if (ab >= 0.0f && (ba < 0.0f || ab <= ba)) {
+                    collapses.push_back({a, b, ab});
+                } else if (ba >= 0.0f) {
+                    collapses.push_back({b, a, ba});
+                }
+            }
+        }
+        if (collapses.empty()) {
+            return 0;
+        }
+        std::sort(collapses.begin(), collapses.end(),
+                  [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+        // Each collapse removes about two triangles. Stop well before collapses that cost much
+        // more than the ones needed to reach the target, since cheaper ones may become
+        // possible in the next pass.
+        const size_t goal = std::min(collapses.size() - 1, trianglestoremove / 2);
+        const float errorgoal = collapses[goal].error * 1.5f;
+
+        remap_.resize(numvertices_);
+        std::iota(remap_.begin(), remap_.end(), 0u);
+        std::vector<bool> locked(numvertices_, false);
+        size_t removed = 0;
+        size_t made = 0;
+        for (const Collapse& collapse : collapses) {
+            if (collapse.error > maxerror || (made > 0 && collapse.error > errorgoal) ||
+                removed >= trianglestoremove) {
+                break;
+            }
+            const unsigned int from = collapse.from;
+            const unsigned int to = collapse.to;
+            if (locked[position_[from]] || locked[position_[to]]) {
+                continue;
+            }
+            unsigned int seamto = ~0u;
+            if (!canCollapse(from, to, seamto) || flips(from, to)) {
+                continue;
+            }
+            if (kind_[from] == Kind::Seam) {
+                const unsigned int other = wedge_[from];
+                if (flips(other, seamto)) {
+                    continue;
+                }
+                remap_[other] = seamto;
+            }
+            remap_[from] = to;
+            quadrics_[position_[to]].add(quadrics_[position_[from]]);
+            locked[position_[from]] = true;
+            locked[position_[to]] = true;
+            removed += kind_[from] == Kind::Border ? 1 : 2;
+            error = std::max(error, collapse.error);
+            made++;
+        }
+
+        // Apply the collapses, and drop the triangles that have lost an edge
+        size_t write = 0;
+        for (size_t t = 0; t < indices_.size(); t += 3) {
+            const unsigned int a = remap_[indices_[t]];
+            const unsigned int b = remap_[indices_[t + 1]];
+            const unsigned int c = remap_[indices_[t + 2]];
+            if (position_[a] != position_[b] && position_[b] != position_[c] &&
+                position_[a] != position_[c]) {
+                indices_[write++] = a;
+                indices_[write++] = b;
+                indices_[write++] = c;
+            }
+        }
+        indices_.resize(write);
+        return made;
+    }
+
+    const std::vector<float>& vertices_;
+    std::vector<unsigned int>& indices_;
+    size_t numvertices_;
+    std::vector<unsigned int> position_;  // First vertex with the same position
+    std::vector<unsigned int> wedge_;     // Next vertex with the same position (circular)
+    std::vector<Kind> kind_;
+    std::vector<Quadric> quadrics_;       // Per position, at its first vertex
+
+    std::vector<size_t> edgeoffsets_;          // Half-edges of vertex v: [offsets[v], offsets[v+1])
+    std::vector<unsigned int> edgetargets_;    // End vertex of each half-edge
+    std::vector<unsigned int> triangles_;      // Triangle of each half-edge
+    std::vector<unsigned int> openout_;        // Number of open edges out of each vertex
+    std::vector<unsigned int> openin_;         // Number of open edges into each vertex
+    std::vector<unsigned int> openouttarget_;  // End of an open edge out of each vertex
+    std::vector<unsigned int> openinsource_;   // Start of an open edge into each vertex
+    std::vector<unsigned int> remap_;          // Collapses of the current pass
+};
+
+}  // namespace
+
+namespace meshopt {
+
+float simplify(const std::vector<float>& vertexarray, const std::vector<unsigned int>& indexarray,
+               size_t targetindexcount, float maxerror, std::vector<unsigned int>& result) {
+    result = indexarray;
+    if (result.size() <= targetindexcount) {
+        return 0.0f;
+    }
+    Simplifier simplifier(vertexarray, result);
+    return simplifier.run(targetindexcount, maxerror);
+}
+
+}  // namespace meshopt
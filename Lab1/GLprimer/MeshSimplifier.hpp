@@ -0,0 +1,39 @@
+/*
+ * Simplification of indexed triangle meshes by quadric error edge collapse.
+ *
+ * Usage: The meshes are in the interleaved vertex format used by TriangleSoup, 8 floats per
+ *        vertex, with three indices per triangle.
+ *
+ *        simplify() removes triangles by collapsing edges, one endpoint into the other, in
+ *        the order of least error, as measured by the quadric error metric of Garland and
+ *        Heckbert, "Surface Simplification Using Quadric Error Metrics" (SIGGRAPH 1997).
+ *        Since a vertex always moves onto another one and keeps no attributes of its own,
+ *        the simplified mesh is a new index array for the same vertex array, and several
+ *        levels of detail can share one vertex buffer.
+ *
+ *        Vertices with the same position but different normals or texture coordinates
+ *        (creases and UV seams) only move along their seam, with all their copies together,
+ *        so the seams stay intact. The same goes for the open borders of the mesh. Vertices
+ *        where seams or borders meet or branch are never moved. Collapses that would flip a
+ *        triangle are rejected. The approach follows meshoptimizer by Arseny Kapoulkine.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace meshopt {
+
+/*
+ * Simplify the mesh until it has at most 'targetindexcount' indices, or until the next collapse
+ * would move the surface further than 'maxerror' (in the units of the vertex positions). The
+ * indices of the simplified mesh are written to 'result'. Returns the largest error of the
+ * collapses that were made, which is an estimate of the distance from the simplified surface
+ * to the original one.
+ */
+float simplify(const std::vector<float>& vertexarray, const std::vector<unsigned int>& indexarray,
+               size_t targetindexcount, float maxerror, std::vector<unsigned int>& result);
+
+}  // namespace meshopt
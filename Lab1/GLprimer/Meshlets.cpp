@@ -0,0 +1,386 @@
+/*
+ * Meshlet building and culling
+ *
+ * This code is in the public domain.
+ */
+#include "Meshlets.hpp"
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace {
+
+// How much a normal far from the average of the meshlet counts against a candidate triangle,
+// compared to its distance from the centre. 0 makes compact meshlets, 1 flat ones, which are
+// more often culled as back facing.
+const float coneWeight = 0.8f;
+
+// The centroid and unit normal of each triangle, zero for a triangle without area
+struct Triangle {
+    float centroid[3];
+    float normal[3];
+    float area;
+};
+
+float dot(const float* u, const float* v) { return u[0] * v[0] + u[1] * v[1] + u[2] * v[2]; }
+
+// Normalize 'v' in place, returns its length before
+float normalize(float* v) {
+    const float length = std::sqrt(dot(v, v));
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+    return length;
+}
+
+/*
+ * Map each vertex to the first vertex with the same position, so that the copies of a vertex
+ * on a crease or a UV seam connect their triangles.
+ */
+std::vector<unsigned int> findPositions(const std::vector<float>& vertexarray) {
+    const size_t numvertices = vertexarray.size() / 8;
+    std::vector<unsigned int> order(numvertices);
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+        const float* p = &vertexarray[8 * static_cast<size_t>(a)];
+        const float* q = &vertexarray[8 * static_cast<size_t>(b)];
+        return std::lexicographical_compare(p, p + 3, q, q + 3) ||
+               (std::equal(p, p + 3, q) && a < b);
+    });
+    std::vector<unsigned int> position(numvertices);
+    for (size_t i = 0; i < numvertices; i++) {
+        const float* p = &vertexarray[8 * static_cast<size_t>(order[i])];
+        const bool same =
+            i > 0 && std::equal(p, p + 3, &vertexarray[8 * static_cast<size_t>(order[i - 1])]);
+        position[order[i]] = same ? position[order[i - 1]] : order[i];
+    }
+    return position;
+}
+
+/* Find the bounding sphere and the normal cone of the triangles of a meshlet */
+void computeBounds(const std::vector<float>& vertexarray, const unsigned int* indices,
+                   const std::vector<Triangle>& triangles, size_t firsttriangle,
+                   meshopt::Meshlet& meshlet) {
+    const size_t numtriangles = meshlet.indexcount / 3;
+    float lo[3], hi[3];
+    for (int c = 0; c < 3; c++) {
+        lo[c] = std::numeric_limits<float>::max();
+        hi[c] = -std::numeric_limits<float>::max();
+    }
+    for (size_t i = 0; i < meshlet.indexcount; i++) {
+        const float* p = &vertexarray[8 * static_cast<size_t>(indices[i])];
+        for (int c = 0; c < 3; c++) {
+            lo[c] = std::min(lo[c], p[c]);
+            hi[c] = std::max(hi[c], p[c]);
+        }
+    }
+    float r2 = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        meshlet.center[c] = 0.5f * (lo[c] + hi[c]);
+    }
+    for (size_t i = 0; i < meshlet.indexcount; i++) {
+        const float* p = &vertexarray[8 * static_cast<size_t>(indices[i])];
+        const float d[3] = {p[0] - meshlet.center[0], p[1] - meshlet.center[1],
+                            p[2] - meshlet.center[2]};
+        r2 = std::max(r2, dot(d, d));
+    }
+    meshlet.radius = std::sqrt(r2);
+
+    // The axis is the mean of the unit normals, and the cone reaches the normal furthest from it
+    float* axis = meshlet.coneaxis;
+    axis[0] = axis[1] = axis[2] = 0.0f;
+    for (size_t t = 0; t < numtriangles; t++) {
+        const Triangle& triangle = triangles[firsttriangle + t];
+        for (int c = 0; c < 3; c++) {
+            axis[c] += triangle.normal[c];
+        }
+    }
+    float mindot = normalize(axis) > 0.0f ? 1.0f : -1.0f;
+    for (size_t t = 0; t < numtriangles; t++) {
+        const Triangle& triangle = triangles[firsttriangle + t];
+        if (triangle.area > 0.0f) {
+            mindot = std::min(mindot, dot(axis, triangle.normal));
+        }
+    }
+    // A cone of 90 degrees or more can not be seen entirely from behind
+    meshlet.conecutoff = mindot > 0.0f ? std::sqrt(1.0f - mindot * mindot) : 1.0f;
+
+    // Move the apex back along the axis until it is behind the planes of all triangles
+    float t = 0.0f;
+    for (size_t i = 0; i < meshlet.indexcount && mindot > 0.0f; i += 3) {
+        const Triangle& triangle = triangles[firsttriangle + i / 3];
+        if (triangle.area > 0.0f) {
+            const float* p = &vertexarray[8 * static_cast<size_t>(indices[i])];
+            const float d[3] = {meshlet.center[0] - p[0], meshlet.center[1] - p[1],
+                                meshlet.center[2] - p[2]};
+            t = std::max(t, dot(triangle.normal, d) / dot(triangle.normal, axis));
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        meshlet.coneapex[c] = meshlet.center[c] - t * axis[c];
+    }
+}
+
+/*
+ * Put the triangles of a meshlet in vertex cache order. Its vertices are numbered from zero
+ * first, so the optimizer works on arrays of the size of the meshlet and not of the mesh.
+ */
+void optimizeMeshlet(unsigned int* indices, size_t count, std::vector<unsigned int>& local,
+                     std::vector<unsigned int>& global) {
+    global.clear();
+    std::vector<unsigned int> meshletindices(count);
+    for (size_t i = 0; i < count; i++) {
+        const unsigned int v = indices[i];
+        if (local[v] == ~0u) {
+            local[v] = static_cast<unsigned int>(global.size());
+            global.push_back(v);
+        }
+        meshletindices[i] = local[v];
+    }
+    meshopt::optimizeVertexCache(meshletindices, static_cast<int>(global.size()));
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = global[meshletindices[i]];
+    }
+    for (unsigned int v : global) {
+        local[v] = ~0u;
+    }
+}
+
+}  // namespace
+
+namespace meshopt {
+
+void buildMeshlets(const std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray,
+                   std::vector<Meshlet>& meshlets, size_t maxtriangles) {
+    meshlets.clear();
+    const size_t numtriangles = indexarray.size() / 3;
+    const size_t numvertices = vertexarray.size() / 8;
+    if (numtriangles == 0 || maxtriangles == 0) {
+        return;
+    }
+    const std::vector<unsigned int> position = findPositions(vertexarray);
+
+    std::vector<Triangle> triangles(numtriangles);
+    float totalarea = 0.0f;
+    for (size_t t = 0; t < numtriangles; t++) {
+        const float* p0 = &vertexarray[8 * static_cast<size_t>(indexarray[3 * t])];
+        const float* p1 = &vertexarray[8 * static_cast<size_t>(indexarray[3 * t + 1])];
+        const float* p2 = &vertexarray[8 * static_cast<size_t>(indexarray[3 * t + 2])];
+        const float u[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        const float v[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+        Triangle& triangle = triangles[t];
+        triangle.normal[0] = u[1] * v[2] - u[2] * v[1];
+        triangle.normal[1] = u[2] * v[0] - u[0] * v[2];
+        triangle.normal[2] = u[0] * v[1] - u[1] * v[0];
+        triangle.area = 0.5f * normalize(triangle.normal);
+        for (int c = 0; c < 3; c++) {
+            triangle.centroid[c] = (p0[c] + p1[c] + p2[c]) / 3.0f;
+        }
+        totalarea += triangle.area;
+    }
+    // The radius of a meshlet of average triangles, if it were a disc
+    const float pi = 3.14159265f;
+    float expectedradius = std::sqrt(totalarea / static_cast<float>(numtriangles) *
+                                     static_cast<float>(maxtriangles) / pi);
+    if (!(expectedradius > 0.0f)) {
+        expectedradius = 1.0f;
+    }
+
+    // Triangles using each vertex position, in one flat array
+    std::vector<size_t> first(numvertices + 1, 0);
+    for (unsigned int index : indexarray) {
+        first[position[index] + 1]++;
+    }
+    std::partial_sum(first.begin(), first.end(), first.begin());
+    std::vector<unsigned int> adjacency(indexarray.size());
+    {
+        std::vector<size_t> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < indexarray.size(); i++) {
+            adjacency[fill[position[indexarray[i]]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    std::vector<unsigned int> result;
+    result.reserve(indexarray.size());
+    std::vector<Triangle> ordered;
+    ordered.reserve(numtriangles);
+    std::vector<unsigned char> emitted(numtriangles, 0);
+    std::vector<size_t> seen(numtriangles, ~size_t(0));  // Meshlet that has it as a candidate
+    std::vector<unsigned int> candidates;
+    size_t cursor = 0;
+    while (true) {
+        // Continue next to the previous meshlet if possible, else in the original order
+        size_t seed = numtriangles;
+        for (unsigned int t : candidates) {
+            if (!emitted[t]) {
+                seed = t;
+                break;
+            }
+        }
+        while (seed == numtriangles && cursor < numtriangles) {
+            if (!emitted[cursor]) {
+                seed = cursor;
+            }
+            cursor++;
+        }
+        if (seed == numtriangles) {
+            break;
+        }
+
+        const size_t id = meshlets.size();
+        Meshlet meshlet = {static_cast<unsigned int>(result.size()), 0, {}, 0.0f, {}, 1.0f, {}};
+        float centroidsum[3] = {0.0f, 0.0f, 0.0f};
+        float normalsum[3] = {0.0f, 0.0f, 0.0f};
+        candidates.clear();
+        size_t t = seed;
+        while (true) {
+            emitted[t] = 1;
+            const Triangle& triangle = triangles[t];
+            ordered.push_back(triangle);
+            for (int c = 0; c < 3; c++) {
+                centroidsum[c] += triangle.centroid[c];
+                normalsum[c] += triangle.normal[c];
+            }
+            for (size_t k = 0; k < 3; k++) {
+                const unsigned int v = indexarray[3 * t + k];
+                result.push_back(v);
+                const unsigned int p = position[v];
+                for (size_t a = first[p]; a < first[p + 1]; a++) {
+                    const unsigned int neighbour = adjacency[a];
+                    if (!emitted[neighbour] && seen[neighbour] != id) {
+                        seen[neighbour] = id;
+                        candidates.push_back(neighbour);
+                    }
+                }
+            }
+            meshlet.indexcount += 3;
+            if (meshlet.indexcount / 3 >= maxtriangles) {
+                break;
+            }
+
+            // The candidate closest to the centre, with the normal closest to the average
+            const float scale = 3.0f / static_cast<float>(meshlet.indexcount);
+            const float centre[3] = {centroidsum[0] * scale, centroidsum[1] * scale,
+                                     centroidsum[2] * scale};
+            float axis[3] = {normalsum[0], normalsum[1], normalsum[2]};
+            normalize(axis);
+            size_t best = numtriangles;
+            float bestscore = std::numeric_limits<float>::max();
+            size_t kept = 0;
+            for (unsigned int candidate : candidates) {
+                if (emitted[candidate]) {
+                    continue;
+                }
+                candidates[kept++] = candidate;
+                const Triangle& c = triangles[candidate];
+                const float d[3] = {c.centroid[0] - centre[0], c.centroid[1] - centre[1],
+                                    c.centroid[2] - centre[2]};
+                const float score = (1.0f + std::sqrt(dot(d, d)) / expectedradius) *
+                                    (1.0f - coneWeight * dot(c.normal, axis));
+                if (score < bestscore) {
+                    bestscore = score;
+                    best = candidate;
+                }
+            }
+            candidates.resize(kept);
+            if (best == numtriangles) {
+                break;  // A closed or separate part of the mesh is done
+            }
+            t = best;
+        }
+        meshlets.push_back(meshlet);
+    }
+
+    // Cache order within each meshlet, which keeps the triangles in the meshlet. The bounds
+    // come first, since 'ordered' has the triangles in the order before the reordering.
+    std::vector<unsigned int> local(numvertices, ~0u);
+    std::vector<unsigned int> global;
+    for (Meshlet& meshlet : meshlets) {
+        computeBounds(vertexarray, &result[meshlet.firstindex], ordered, meshlet.firstindex / 3,
+                      meshlet);
+        optimizeMeshlet(&result[meshlet.firstindex], meshlet.indexcount, local, global);
+    }
+    indexarray.swap(result);
+}
+
+/*
+ * The frustum planes come from the rows of the matrix, as in FrustumCuller.cpp, and a sphere
+ * is outside a plane n.x + d = 0 if n.c + d < -r |n|.
+ *
+ * The camera is the point that clip space x, y and w are all zero for, in homogeneous
+ * coordinates e, the null vector of those three rows. With a parallel projection, ew is zero
+ * and e is a direction. Its sign is chosen so that the camera is at the near side, where clip
+ * z is negative. With the camera at p = e / ew, a meshlet is seen entirely from behind if the
+ * direction from p to the apex of its cone is within the cone, but turned 90 degrees less:
+ * dot(apex - p, axis) >= cutoff |apex - p|. Multiplied by ew, this holds for both projections.
+ */
+MeshletCullStats cullMeshlets(const std::vector<Meshlet>& meshlets, const float* mvp,
+                              std::vector<unsigned char>& visible) {
+    // Column major: element (row, column) is m[4 * column + row]
+    float planes[6][4];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            planes[2 * i][j] = mvp[4 * j + 3] + mvp[4 * j + i];
+            planes[2 * i + 1][j] = mvp[4 * j + 3] - mvp[4 * j + i];
+        }
+    }
+    float planelength[6];
+    for (int i = 0; i < 6; i++) {
+        planelength[i] = std::sqrt(dot(planes[i], planes[i]));
+    }
+
+    // The null vector of rows 0, 1 and 3, from the 3 x 3 minors of those rows
+    auto row = [&](int r, int c) { return static_cast<double>(mvp[4 * c + r]); };
+    auto minor = [&](int c0, int c1, int c2) {
+        return row(0, c0) * (row(1, c1) * row(3, c2) - row(1, c2) * row(3, c1)) -
+               row(0, c1) * (row(1, c0) * row(3, c2) - row(1, c2) * row(3, c0)) +
+               row(0, c2) * (row(1, c0) * row(3, c1) - row(1, c1) * row(3, c0));
+    };
+    double e[4] = {minor(1, 2, 3), -minor(0, 2, 3), minor(0, 1, 3), -minor(0, 1, 2)};
+    if (row(2, 0) * e[0] + row(2, 1) * e[1] + row(2, 2) * e[2] + row(2, 3) * e[3] > 0.0) {
+        for (double& x : e) {
+            x = -x;
+        }
+    }
+    const double elength = std::sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2] + e[3] * e[3]);
+    const bool conetest = elength > 0.0 && e[3] >= 0.0;
+    float camera[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for (int c = 0; c < 4 && conetest; c++) {
+        camera[c] = static_cast<float>(e[c] / elength);
+    }
+
+    MeshletCullStats stats;
+    visible.assign(meshlets.size(), 0);
+    for (size_t i = 0; i < meshlets.size(); i++) {
+        const Meshlet& meshlet = meshlets[i];
+        const float* c = meshlet.center;
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; p++) {
+            outside = dot(planes[p], c) + planes[p][3] < -meshlet.radius * planelength[p];
+        }
+        bool backfacing = false;
+        if (!outside && conetest && meshlet.conecutoff < 1.0f) {
+            const float* a = meshlet.coneapex;
+            const float v[3] = {a[0] * camera[3] - camera[0], a[1] * camera[3] - camera[1],
+                                a[2] * camera[3] - camera[2]};
+            backfacing = dot(v, meshlet.coneaxis) >= meshlet.conecutoff * std::sqrt(dot(v, v));
+        }
+        if (outside) {
+            stats.frustum++;
+        } else if (backfacing) {
+            stats.backface++;
+        } else {
+            stats.visible++;
+            visible[i] = 1;
+        }
+        (visible[i] ? stats.visibleindices : stats.culledindices) += meshlet.indexcount;
+    }
+    return stats;
+}
+
+}  // namespace meshopt
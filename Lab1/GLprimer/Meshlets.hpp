@@ -0,0 +1,64 @@
+/*
+ * Clusters of triangles (meshlets) that can be culled separately on the CPU.
+ *
+ * Usage: The meshes are in the interleaved vertex format used by TriangleSoup, 8 floats per
+ *        vertex, with three indices per triangle.
+ *
+ *        buildMeshlets() reorders the triangles into meshlets of at most a given number of
+ *        triangles, so that each meshlet is a consecutive range of the index array. A meshlet
+ *        is grown from a seed triangle by adding the neighbouring triangle that is closest to
+ *        its centre and whose normal is closest to its average normal, which keeps it small
+ *        on screen and makes its normals point the same way. Triangles across creases and UV
+ *        seams count as neighbours, since they share vertex positions. Each meshlet gets a
+ *        bounding sphere and a cone that holds the normals of all its triangles, and the
+ *        triangles within it are put in vertex cache order.
+ *
+ *        cullMeshlets() then tests each meshlet against the view frustum, and against the
+ *        camera position with its normal cone: if the camera sees all its triangles from
+ *        behind, the meshlet is culled as back facing. Both tests are conservative. The
+ *        cone and its apex are computed as in meshoptimizer by Arseny Kapoulkine.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace meshopt {
+
+// A cluster of triangles, a range of the index array
+struct Meshlet {
+    unsigned int firstindex;  // First index of its triangles
+    unsigned int indexcount;  // Number of indices, three per triangle
+    float center[3];          // Bounding sphere of its vertices
+    float radius;
+    float coneaxis[3];  // Unit vector, the average direction of the triangle normals
+    float conecutoff;   // Sine of the largest angle from the axis to a normal, 1 if 90 or more
+    float coneapex[3];  // On the axis, behind the planes of all the triangles
+};
+
+// Results of cullMeshlets()
+struct MeshletCullStats {
+    int visible = 0;            // Meshlets that passed both tests
+    int frustum = 0;            // Meshlets outside the view frustum
+    int backface = 0;           // Meshlets in the frustum, but facing away from the camera
+    size_t visibleindices = 0;  // Indices in the visible meshlets
+    size_t culledindices = 0;   // Indices in the culled meshlets
+};
+
+/*
+ * Reorder the triangles in 'indexarray' into meshlets of at most 'maxtriangles' triangles each,
+ * and return their ranges and bounds in 'meshlets'. The vertices are unchanged.
+ */
+void buildMeshlets(const std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray,
+                   std::vector<Meshlet>& meshlets, size_t maxtriangles = 64);
+
+/*
+ * Test the meshlets against the view of 'mvp', a column major matrix from mesh coordinates to
+ * clip space, with a perspective or a parallel projection. 'visible' gets one flag per meshlet.
+ */
+MeshletCullStats cullMeshlets(const std::vector<Meshlet>& meshlets, const float* mvp,
+                              std::vector<unsigned char>& visible);
+
+}  // namespace meshopt
@@ -0,0 +1,469 @@
+/*
+ * Fast parsing of numbers
+ *
+ * This code is in the public domain.
+ */
+#include "NumberParser.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace numparse {
+
+namespace {
+
+/*
+ * 128 bit approximations of 5^q for q = -65 ... 38, the range where a float can be neither
+ * zero nor infinite. Each entry is {high 64 bits, low 64 bits}, normalized so that the most
+ * significant bit is set. Negative powers are rounded up, positive ones truncated. This is
+ * the float part of the table used by the fast_float library.
+ */
+const int smallestPowerOfTen = -65;
+const int largestPowerOfTen = 38;
+const uint64_t powersOfFive[][2] = {
+    {0x86ccbb52ea94baeaull, 0x98e947129fc2b4e9ull},  // 5^-65
+    {0xa87fea27a539e9a5ull, 0x3f2398d747b36224ull},  // 5^-64
+    {0xd29fe4b18e88640eull, 0x8eec7f0d19a03aadull},  // 5^-63
+    {0x83a3eeeef9153e89ull, 0x1953cf68300424acull},  // 5^-62
+    {0xa48ceaaab75a8e2bull, 0x5fa8c3423c052dd7ull},  // 5^-61
+    {0xcdb02555653131b6ull, 0x3792f412cb06794dull},  // 5^-60
+    {0x808e17555f3ebf11ull, 0xe2bbd88bbee40bd0ull},  // 5^-59
+    {0xa0b19d2ab70e6ed6ull, 0x5b6aceaeae9d0ec4ull},  // 5^-58
+    {0xc8de047564d20a8bull, 0xf245825a5a445275ull},  // 5^-57
+    {0xfb158592be068d2eull, 0xeed6e2f0f0d56712ull},  // 5^-56
+    {0x9ced737bb6c4183dull, 0x55464dd69685606bull},  // 5^-55
+    {0xc428d05aa4751e4cull, 0xaa97e14c3c26b886ull},  // 5^-54
+    {0xf53304714d9265dfull, 0xd53dd99f4b3066a8ull},  // 5^-53
+    {0x993fe2c6d07b7fabull, 0xe546a8038efe4029ull},  // 5^-52
+    {0xbf8fdb78849a5f96ull, 0xde98520472bdd033ull},  // 5^-51
+    {0xef73d256a5c0f77cull, 0x963e66858f6d4440ull},  // 5^-50
+    {0x95a8637627989aadull, 0xdde7001379a44aa8ull},  // 5^-49
+    {0xbb127c53b17ec159ull, 0x5560c018580d5d52ull},  // 5^-48
+    {0xe9d71b689dde71afull, 0xaab8f01e6e10b4a6ull},  // 5^-47
+    {0x9226712162ab070dull, 0xcab3961304ca70e8ull},  // 5^-46
+    {0xb6b00d69bb55c8d1ull, 0x3d607b97c5fd0d22ull},  // 5^-45
+    {0xe45c10c42a2b3b05ull, 0x8cb89a7db77c506aull},  // 5^-44
+    {0x8eb98a7a9a5b04e3ull, 0x77f3608e92adb242ull},  // 5^-43
+    {0xb267ed1940f1c61cull, 0x55f038b237591ed3ull},  // 5^-42
+    {0xdf01e85f912e37a3ull, 0x6b6c46dec52f6688ull},  // 5^-41
+    {0x8b61313bbabce2c6ull, 0x2323ac4b3b3da015ull},  // 5^-40
+    {0xae397d8aa96c1b77ull, 0xabec975e0a0d081aull},  // 5^-39
+    {0xd9c7dced53c72255ull, 0x96e7bd358c904a21ull},  // 5^-38
+    {0x881cea14545c7575ull, 0x7e50d64177da2e54ull},  // 5^-37
+    {0xaa242499697392d2ull, 0xdde50bd1d5d0b9e9ull},  // 5^-36
+    {0xd4ad2dbfc3d07787ull, 0x955e4ec64b44e864ull},  // 5^-35
+    {0x84ec3c97da624ab4ull, 0xbd5af13bef0b113eull},  // 5^-34
+    {0xa6274bbdd0fadd61ull, 0xecb1ad8aeacdd58eull},  // 5^-33
+    {0xcfb11ead453994baull, 0x67de18eda5814af2ull},  // 5^-32
+    {0x81ceb32c4b43fcf4ull, 0x80eacf948770ced7ull},  // 5^-31
+    {0xa2425ff75e14fc31ull, 0xa1258379a94d028dull},  // 5^-30
+    {0xcad2f7f5359a3b3eull, 0x096ee45813a04330ull},  // 5^-29
+    {0xfd87b5f28300ca0dull, 0x8bca9d6e188853fcull},  // 5^-28
+    {0x9e74d1b791e07e48ull, 0x775ea264cf55347eull},  // 5^-27
+    {0xc612062576589ddaull, 0x95364afe032a819eull},  // 5^-26
+    {0xf79687aed3eec551ull, 0x3a83ddbd83f52205ull},  // 5^-25
+    {0x9abe14cd44753b52ull, 0xc4926a9672793543ull},  // 5^-24
+    {0xc16d9a0095928a27ull, 0x75b7053c0f178294ull},  // 5^-23
+    {0xf1c90080baf72cb1ull, 0x5324c68b12dd6339ull},  // 5^-22
+    {0x971da05074da7beeull, 0xd3f6fc16ebca5e04ull},  // 5^-21
+    {0xbce5086492111aeaull, 0x88f4bb1ca6bcf585ull},  // 5^-20
+    {0xec1e4a7db69561a5ull, 0x2b31e9e3d06c32e6ull},  // 5^-19
+    {0x9392ee8e921d5d07ull, 0x3aff322e62439fd0ull},  // 5^-18
+    {0xb877aa3236a4b449ull, 0x09befeb9fad487c3ull},  // 5^-17
+    {0xe69594bec44de15bull, 0x4c2ebe687989a9b4ull},  // 5^-16
+    {0x901d7cf73ab0acd9ull, 0x0f9d37014bf60a11ull},  // 5^-15
+    {0xb424dc35095cd80full, 0x538484c19ef38c95ull},  // 5^-14
+    {0xe12e13424bb40e13ull, 0x2865a5f206b06fbaull},  // 5^-13
+    {0x8cbccc096f5088cbull, 0xf93f87b7442e45d4ull},  // 5^-12
+    {0xafebff0bcb24aafeull, 0xf78f69a51539d749ull},  // 5^-11
+    {0xdbe6fecebdedd5beull, 0xb573440e5a884d1cull},  // 5^-10
+    {0x89705f4136b4a597ull, 0x31680a88f8953031ull},  // 5^-9
+    {0xabcc77118461cefcull, 0xfdc20d2b36ba7c3eull},  // 5^-8
+    {0xd6bf94d5e57a42bcull, 0x3d32907604691b4dull},  // 5^-7
+    {0x8637bd05af6c69b5ull, 0xa63f9a49c2c1b110ull},  // 5^-6
+    {0xa7c5ac471b478423ull, 0x0fcf80dc33721d54ull},  // 5^-5
+    {0xd1b71758e219652bull, 0xd3c36113404ea4a9ull},  // 5^-4
+    {0x83126e978d4fdf3bull, 0x645a1cac083126eaull},  // 5^-3
+    {0xa3d70a3d70a3d70aull, 0x3d70a3d70a3d70a4ull},  // 5^-2
+    {0xccccccccccccccccull, 0xcccccccccccccccdull},  // 5^-1
+    {0x8000000000000000ull, 0x0000000000000000ull},  // 5^0
+    {0xa000000000000000ull, 0x0000000000000000ull},  // 5^1
+    {0xc800000000000000ull, 0x0000000000000000ull},  // 5^2
+    {0xfa00000000000000ull, 0x0000000000000000ull},  // 5^3
+    {0x9c40000000000000ull, 0x0000000000000000ull},  // 5^4
+    {0xc350000000000000ull, 0x0000000000000000ull},  // 5^5
+    {0xf424000000000000ull, 0x0000000000000000ull},  // 5^6
+    {0x9896800000000000ull, 0x0000000000000000ull},  // 5^7
+    {0xbebc200000000000ull, 0x0000000000000000ull},  // 5^8
+    {0xee6b280000000000ull, 0x0000000000000000ull},  // 5^9
+    {0x9502f90000000000ull, 0x0000000000000000ull},  // 5^10
+    {0xba43b74000000000ull, 0x0000000000000000ull},  // 5^11
+    {0xe8d4a51000000000ull, 0x0000000000000000ull},  // 5^12
+    {0x9184e72a00000000ull, 0x0000000000000000ull},  // 5^13
+    {0xb5e620f480000000ull, 0x0000000000000000ull},  // 5^14
+    {0xe35fa931a0000000ull, 0x0000000000000000ull},  // 5^15
+    {0x8e1bc9bf04000000ull, 0x0000000000000000ull},  // 5^16
+    {0xb1a2bc2ec5000000ull, 0x0000000000000000ull},  // 5^17
+    {0xde0b6b3a76400000ull, 0x0000000000000000ull},  // 5^18
+    {0x8ac7230489e80000ull, 0x0000000000000000ull},  // 5^19
+    {0xad78ebc5ac620000ull, 0x0000000000000000ull},  // 5^20
+    {0xd8d726b7177a8000ull, 0x0000000000000000ull},  // 5^21
+    {0x878678326eac9000ull, 0x0000000000000000ull},  // 5^22
+    {0xa968163f0a57b400ull, 0x0000000000000000ull},  // 5^23
+    {0xd3c21bcecceda100ull, 0x0000000000000000ull},  // 5^24
+    {0x84595161401484a0ull, 0x0000000000000000ull},  // 5^25
+    {0xa56fa5b99019a5c8ull, 0x0000000000000000ull},  // 5^26
+    {0xcecb8f27f4200f3aull, 0x0000000000000000ull},  // 5^27
+    {0x813f3978f8940984ull, 0x4000000000000000ull},  // 5^28
+    {0xa18f07d736b90be5ull, 0x5000000000000000ull},  // 5^29
+    {0xc9f2c9cd04674edeull, 0xa400000000000000ull},  // 5^30
+    {0xfc6f7c4045812296ull, 0x4d00000000000000ull},  // 5^31
+    {0x9dc5ada82b70b59dull, 0xf020000000000000ull},  // 5^32
+    {0xc5371912364ce305ull, 0x6c28000000000000ull},  // 5^33
+    {0xf684df56c3e01bc6ull, 0xc732000000000000ull},  // 5^34
+    {0x9a130b963a6c115cull, 0x3c7f400000000000ull},  // 5^35
+    {0xc097ce7bc90715b3ull, 0x4b9f100000000000ull},  // 5^36
+    {0xf0bdc21abb48db20ull, 0x1e86d40000000000ull},  // 5^37
+    {0x96769950b50d88f4ull, 0x1314448000000000ull},  // 5^38
+};
+
+// Exact powers of ten for the Clinger fast path
+const float exactPowersOfTen[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                  1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+int leadingZeros(uint64_t x) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return 63 - static_cast<int>(index);
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_clzll(x);
+#else
+    int n = 0;
+    while (!(x & 0x8000000000000000ull)) {
+        x <<= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+int trailingZeros(uint64_t x) {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#elif defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+// Full 64 x 64 -> 128 bit multiplication
+void multiply(uint64_t a, uint64_t b, uint64_t& high, uint64_t& low) {
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    high = static_cast<uint64_t>(product >> 64);
+    low = static_cast<uint64_t>(product);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    low = _umul128(a, b, &high);
+#else
+    const uint64_t a0 = a & 0xffffffffu, a1 = a >> 32;
+    const uint64_t b0 = b & 0xffffffffu, b1 = b >> 32;
+    const uint64_t p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+    const uint64_t middle = (p00 >> 32) + (p01 & 0xffffffffu) + (p10 & 0xffffffffu);
+    high = p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+    low = (middle << 32) | (p00 & 0xffffffffu);
+#endif
+}
+
+bool isLittleEndian() {
+    const uint16_t one = 1;
+    unsigned char first;
+    memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+const bool littleEndian = isLittleEndian();
+
+/*
+ * Eisel-Lemire: convert w * 10^q to the bits of the nearest float. Returns false if the
+ * result can not be determined from the 128 bit product, which is very rare.
+ */
+bool eiselLemire(uint64_t w, int q, bool negative, float& value) {
+    const int mantissaBits = 23;
+    const int minimumExponent = -127;
+    const int infinitePower = 0xFF;
+
+    uint64_t mantissa;
+    int power2;
+    if (w == 0 || q < smallestPowerOfTen) {
+        mantissa = 0;
+        power2 = 0;
+    } else if (q > largestPowerOfTen) {
+        mantissa = 0;
+        power2 = infinitePower;
+    } else {
+        const int lz = leadingZeros(w);
+        w <<= lz;
+
+        // Only the upper bits of the product matter. If the ones below the mantissa and
+        // rounding bits are all set, a carry from the lower half of the table entry could
+        // still change them, so include that too.
+        const uint64_t* power = powersOfFive[q - smallestPowerOfTen];
+        uint64_t high, low;
+        multiply(w, power[0], high, low);
+        const uint64_t precisionMask = 0xFFFFFFFFFFFFFFFFull >> (mantissaBits + 3);
+        if ((high & precisionMask) == precisionMask) {
+            uint64_t high2, low2;
+            multiply(w, power[1], high2, low2);
+            low += high2;
+            if (high2 > low) {
+                high++;
+            }
+        }
+        if (low == 0xFFFFFFFFFFFFFFFFull) {
+            return false;  // Still ambiguous
+        }
+
+        const int upperbit = static_cast<int>(high >> 63);
+        const int shift = upperbit + 64 - mantissaBits - 3;
+        mantissa = high >> shift;
+        // floor(log2(10^q)) + 63, computed without floating point
+        const int log2PowerOfTen = (((152170 + 65536) * q) >> 16) + 63;
+        power2 = log2PowerOfTen + upperbit - lz - minimumExponent;
+
+        if (power2 <= 0) {
+            // A subnormal number, or zero
+            if (-power2 + 1 >= 64) {
+                mantissa = 0;
+                power2 = 0;
+            } else {
+                mantissa >>= -power2 + 1;
+                mantissa += (mantissa & 1);
+                mantissa >>= 1;
+                power2 = (mantissa < (uint64_t(1) << mantissaBits)) ? 0 : 1;
+            }
+        } else {
+            // Exactly halfway between two floats: round to even. This can only
+            // happen for a small range of exponents, where the product is exact.
+            if (low <= 1 && q >= -17 && q <= 10 && (mantissa & 3) == 1 &&
+                (mantissa << shift) == high) {
+                mantissa &= ~uint64_t(1);
+            }
+            mantissa += (mantissa & 1);
+            mantissa >>= 1;
+            if (mantissa >= (uint64_t(2) << mantissaBits)) {
+                mantissa = uint64_t(1) << mantissaBits;
+                power2++;
+            }
+            mantissa &= ~(uint64_t(1) << mantissaBits);
+            if (power2 >= infinitePower) {
+                power2 = infinitePower;
+                mantissa = 0;
+            }
+        }
+    }
+
+    const uint32_t bits = static_cast<uint32_t>(mantissa) |
+                          (static_cast<uint32_t>(power2) << mantissaBits) |
+                          (negative ? 0x80000000u : 0u);
+    memcpy(&value, &bits, sizeof(value));
+    return true;
+}
+
+// The slow path: copy the token to a null terminated buffer and use strtof()
+bool parseFloatStrtof(const char*& p, const char* end, float& value) {
+    char buf[128];
+    size_t len = 0;
+    while (p + len < end && len < sizeof(buf) - 1 && !isBlank(p[len]) && p[len] != '\n') {
+        buf[len] = p[len];
+        ++len;
+    }
+    buf[len] = '\0';
+    char* last = nullptr;
+    value = strtof(buf, &last);
+    if (last == buf) {
+        return false;
+    }
+    p += last - buf;
+    return true;
+}
+
+}  // namespace
+
+bool parseFloat(const char*& p, const char* end, float& value) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    const char* start = p;
+    const char* s = p;
+
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        ++s;
+    }
+    if (end - s >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        return parseFloatStrtof(p, end, value);  // Hexadecimal float
+    }
+
+    // Collect up to 19 significant digits in w. The decimal exponent of the last digit
+    // is tracked in q.
+    uint64_t w = 0;
+    int64_t q = 0;
+    int digits = 0;  // significant digits, not counting leading zeros
+    bool anydigits = false;
+    bool truncated = false;
+    while (s < end && isDigit(*s)) {
+        anydigits = true;
+        if (digits < 19) {
+            w = 10 * w + static_cast<uint64_t>(*s - '0');
+            digits += (w != 0);
+        } else {
+            truncated = true;
+        }
+        ++s;
+    }
+    if (truncated) {
+        return parseFloatStrtof(p, end, value);
+    }
+    if (s < end && *s == '.') {
+        ++s;
+        while (s < end && isDigit(*s)) {
+            anydigits = true;
+            if (digits < 19) {
+                w = 10 * w + static_cast<uint64_t>(*s - '0');
+                digits += (w != 0);
+                --q;
+            } else {
+                truncated = true;
+            }
+            ++s;
+        }
+    }
+    if (!anydigits || truncated) {
+        // Not a plain decimal number (inf, nan, hex...) or too many digits for w
+        return parseFloatStrtof(p, end, value);
+    }
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negativeExponent = *e == '-';
+            ++e;
+        }
+        if (e < end && isDigit(*e)) {
+            int64_t exponent = 0;
+            while (e < end && isDigit(*e)) {
+                if (exponent < 100000) {
+                    exponent = 10 * exponent + (*e - '0');
+                }
+                ++e;
+            }
+            q += negativeExponent ? -exponent : exponent;
+            s = e;
+        }
+        // Otherwise the 'e' is not part of the number, just like for strtof()
+    }
+
+    // Clinger's fast path: both w and 10^|q| are exact floats, so a single
+    // correctly rounded multiplication or division gives the right answer.
+    if (w <= (uint64_t(1) << 24) && q >= -10 && q <= 10) {
+        float f = static_cast<float>(w);
+        if (q < 0) {
+            f /= exactPowersOfTen[-q];
+        } else {
+            f *= exactPowersOfTen[q];
+        }
+        value = negative ? -f : f;
+        p = s;
+        return true;
+    }
+
+    if (!eiselLemire(w, static_cast<int>(std::max<int64_t>(-1000, std::min<int64_t>(1000, q))),
+                     negative, value)) {
+        p = start;
+        return parseFloatStrtof(p, end, value);
+    }
+    p = s;
+    return true;
+}
+
+bool parseInt(const char*& p, const char* end, int64_t& value) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    const char* s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = *s == '-';
+        ++s;
+    }
+    if (s == end || !isDigit(*s)) {
+        return false;
+    }
+
+    uint64_t result = 0;
+    if (littleEndian) {
+        // Eight characters at a time. A byte is a digit if its high nibble is 3, and its high
+        // nibble stays 3 when 6 is added. 'nondigits' gets a non-zero byte for every other
+        // character, so its trailing zero bytes count the leading digits.
+        while (end - s >= 8) {
+            uint64_t chunk;
+            memcpy(&chunk, s, 8);
+            const uint64_t high = chunk & 0xF0F0F0F0F0F0F0F0ull;
+            const uint64_t high6 = (chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull;
+            const uint64_t nondigits = (high | (high6 >> 4)) ^ 0x3333333333333333ull;
+            const int count = nondigits ? trailingZeros(nondigits) / 8 : 8;
+            if (count == 0) {
+                break;
+            }
+            // Move the digits to the high bytes, leaving zeros in front, and combine
+            // pairs, then quads, then octets of digits with one multiplication each.
+            uint64_t x = (chunk - 0x3030303030303030ull) << (8 * (8 - count));
+            x = (x * 10 + (x >> 8)) & 0x00FF00FF00FF00FFull;
+            x = (x * 100 + (x >> 16)) & 0x0000FFFF0000FFFFull;
+            x = (x * 10000 + (x >> 32)) & 0x00000000FFFFFFFFull;
+            static const uint64_t scale[9] = {1,      10,      100,      1000,     10000,
+                                              100000, 1000000, 10000000, 100000000};
+            if (result > 9999999999ull) {
+                return false;  // Too many digits
+            }
+            result = result * scale[count] + x;
+            s += count;
+            if (count < 8) {
+                break;
+            }
+        }
+    }
+    while (s < end && isDigit(*s)) {
+        if (result > 99999999999999999ull) {
+            return false;  // Too many digits
+        }
+        result = 10 * result + static_cast<uint64_t>(*s - '0');
+        ++s;
+    }
+
+    value = negative ? -static_cast<int64_t>(result) : static_cast<int64_t>(result);
+    p = s;
+    return true;
+}
+
+}  // namespace numparse
@@ -0,0 +1,33 @@
+/*
+ * Fast parsing of the numbers in text files like OBJ meshes.
+ *
+ * Usage: parseFloat() and parseInt() read one number starting at 'p', after skipping any
+ *        spaces and tabs, and advance 'p' past it. They never read at or beyond 'end', so
+ *        they work directly on memory mapped files without a terminating null character.
+ *
+ *        parseFloat() gives bit-identical results to strtof() in the "C" locale. Most numbers
+ *        are converted with the Clinger fast path or the Eisel-Lemire algorithm (a 64 by 128
+ *        bit multiplication with a table of powers of five). The rare cases these can not
+ *        decide, like numbers with more than 19 significant digits, are handed to strtof().
+ *
+ *        parseInt() reads up to eight digits at a time with SWAR arithmetic ("SIMD within a
+ *        register"): a 64 bit word is tested for digits and converted with three multiplies.
+ *
+ * References: D. Lemire, "Number Parsing at a Gigabyte per Second", Software: Practice and
+ *             Experience 51(8), 2021.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace numparse {
+
+/* Read one float. Returns false if there is no number at 'p' */
+bool parseFloat(const char*& p, const char* end, float& value);
+
+/* Read one decimal integer with an optional sign. Returns false if there is no number at 'p' */
+bool parseInt(const char*& p, const char* end, int64_t& value);
+
+}  // namespace numparse
@@ -0,0 +1,752 @@
+/*
+ * Wavefront OBJ parsing
+ *
+ * Authors: Stefan Gustavson (stegu@itn.liu.se) 2014 (readScanf)
+ *
+ * This code is in the public domain.
+ */
+#include "ObjReader.hpp"
+#include "MappedFile.hpp"
+#include "NumberParser.hpp"
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace obj {
+
+bool readScanf(const std::string& filename, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray, Counts& counts) {
+    FILE* objfile = fopen(filename.c_str(), "r");
+
+    if (!objfile) {
+        std::cerr << "File not found: " << filename << "\n";
+        return false;
+    }
+
+    // Scan through the file to count the number of data elements
+    char line[256];
+    char tag[3];
+
+    int numverts = 0;
+    int numnormals = 0;
+    int numtexcoords = 0;
+    int numfaces = 0;
+    while (fgets(line, 256, objfile)) {
+        tag[0] = '\0';
+        sscanf(line, "%2s ", tag);
+        if (!strcmp(tag, "v")) {
+            numverts++;
+        } else if (!strcmp(tag, "vn")) {
+            numnormals++;
+        } else if (!strcmp(tag, "vt")) {
+            numtexcoords++;
+        } else if (!strcmp(tag, "f")) {
+            numfaces++;
+        }
+        // else {
+        //     std::cout << "Ignoring line starting with \"" << tag << "\"\n";
+        // }
+    }
+
+    std::vector<float> verts(3 * numverts);
+    std::vector<float> normals(3 * numnormals);
+    std::vector<float> texcoords(2 * numtexcoords);
+
+    vertexarray.resize(8 * 3 * numfaces);
+    indexarray.resize(3 * numfaces);
+
+    rewind(objfile);  // Start from the top again to read data
+
+    int i_v = 0;
+    int i_n = 0;
+    int i_t = 0;
+    int i_f = 0;
+
+    int readerror = 0;
+    while (fgets(line, 256, objfile)) {
+        tag[0] = '\0';
+        sscanf(line, "%2s ", tag);
+        if (!strcmp(tag, "v")) {
+            // A vertex with three coordinates
+            int numargs = sscanf(line, "v %f %f %f", &verts[3 * i_v], &verts[3 * i_v + 1],
+                                 &verts[3 * i_v + 2]);
+            if (numargs != 3) {
+                std::cerr << "Malformed vertex data found at vertex " << i_v + 1 << "\nAborting\n";
+                readerror = 1;
+                break;
+            }
+            i_v++;
+        } else if (!strcmp(tag, "vn")) {
+            // A vertex normal with three components
+            int numargs = sscanf(line, "vn %f %f %f", &normals[3 * i_n], &normals[3 * i_n + 1],
+                                 &normals[3 * i_n + 2]);
+            if (numargs != 3) {
+                std::cerr << "Malformed normal data found at normal" << i_n + 1 << "\nAborting\n";
+                readerror = 1;
+                break;
+            }
+            i_n++;
+        } else if (!strcmp(tag, "vt")) {
+            // A vertex texture coordinate, two components
+            int numargs = sscanf(line, "vt %f %f", &texcoords[2 * i_t], &texcoords[2 * i_t + 1]);
+            if (numargs != 2) {
+                std::cerr << "Malformed texcoord data found at texcoord " << i_t + 1
+                          << "\nAborting\n";
+                readerror = 1;
+                break;
+            }
+            i_t++;
+        } else if (!strcmp(tag, "f")) {
+            // A face with three or more vertex indices
+            int v1, v2, v3, n1, n2, n3, t1, t2, t3;
+            int numargs = sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", &v1, &t1, &n1, &v2, &t2, &n2,
+                                 &v3, &t3, &n3);
+            if (numargs != 9) {  // Accept only triangles. Quads cause an error.
+                std::cerr << "Malformed face data found at vertex " << i_f + 1 << "\nAborting\n";
+                readerror = 1;
+                break;
+            }
+            // Indices in OBJ files start at 1, but C++ arrays start at index 0.
+            --v1;
+            --v2;
+            --v3;
+            --n1;
+            --n2;
+            --n3;
+            --t1;
+            --t2;
+            --t3;
+
+            const int currentv = 8 * 3 * i_f;
+            vertexarray[currentv] = verts[3 * v1];
+            vertexarray[currentv + 1] = verts[3 * v1 + 1];
+            vertexarray[currentv + 2] = verts[3 * v1 + 2];
+            vertexarray[currentv + 3] = normals[3 * n1];
+            vertexarray[currentv + 4] = normals[3 * n1 + 1];
+            vertexarray[currentv + 5] = normals[3 * n1 + 2];
+            vertexarray[currentv + 6] = texcoords[2 * t1];
+            vertexarray[currentv + 7] = texcoords[2 * t1 + 1];
+            vertexarray[currentv + 8] = verts[3 * v2];
+            vertexarray[currentv + 9] = verts[3 * v2 + 1];
+            vertexarray[currentv + 10] = verts[3 * v2 + 2];
+            vertexarray[currentv + 11] = normals[3 * n2];
+            vertexarray[currentv + 12] = normals[3 * n2 + 1];
+            vertexarray[currentv + 13] = normals[3 * n2 + 2];
+            vertexarray[currentv + 14] = texcoords[2 * t2];
+            vertexarray[currentv + 15] = texcoords[2 * t2 + 1];
+            vertexarray[currentv + 16] = verts[3 * v3];
+            vertexarray[currentv + 17] = verts[3 * v3 + 1];
+            vertexarray[currentv + 18] = verts[3 * v3 + 2];
+            vertexarray[currentv + 19] = normals[3 * n3];
+            vertexarray[currentv + 20] = normals[3 * n3 + 1];
+            vertexarray[currentv + 21] = normals[3 * n3 + 2];
+            vertexarray[currentv + 22] = texcoords[2 * t3];
+            vertexarray[currentv + 23] = texcoords[2 * t3 + 1];
+            indexarray[3 * i_f] = 3 * i_f;
+            indexarray[3 * i_f + 1] = 3 * i_f + 1;
+            indexarray[3 * i_f + 2] = 3 * i_f + 2;
+            i_f++;
+        }
+    }
+
+    fclose(objfile);
+
+    counts.verts = numverts;
+    counts.normals = numnormals;
+    counts.texcoords = numtexcoords;
+    counts.faces = numfaces;
+
+    return readerror == 0;
+}
+
+bool readMapped(const std::string& filename, std::vector<float>& vertexarray,
+                std::vector<unsigned int>& indexarray, Counts& counts, bool weld) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "File not found: " << filename << "\n";
+        return false;
+    }
+    return parse(file.data(), file.data() + file.size(), vertexarray, indexarray, counts, weld);
+}
+
+bool readParallel(const std::string& filename, std::vector<float>& vertexarray,
+                  std::vector<unsigned int>& indexarray, Counts& counts, int threads,
+                  bool weld) {
+    MappedFile file;
+    if (!file.open(filename)) {
+        std::cerr << "File not found: " << filename << "\n";
+        return false;
+    }
+    return parseParallel(file.data(), file.data() + file.size(), vertexarray, indexarray, counts,
+                         threads, weld);
+}
+
+namespace {
+
+// The kind of line where parsing failed
+enum class Error { None, Vertex, Normal, Texcoord, Face };
+
+// Vertex attributes read from a range of lines
+struct Elements {
+    std::vector<float> verts;
+    std::vector<float> normals;
+    std::vector<float> texcoords;
+    Counts counts;
+};
+
+bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+bool isSpace(char c) { return isBlank(c) || c == '\n'; }
+
+// Skip spaces and tabs, but not the end of the line
+const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && isBlank(*p)) {
+        ++p;
+    }
+    return p;
+}
+
+// Return a pointer to the first character after the end of the current line
+const char* skipLine(const char* p, const char* end) {
+    const void* eol = memchr(p, '\n', static_cast<size_t>(end - p));
+    return eol ? static_cast<const char*>(eol) + 1 : end;
+}
+
+// Read one "v/t/n" index triple of a face
+bool parseCorner(const char*& p, const char* end, int64_t& v, int64_t& t, int64_t& n) {
+    return numparse::parseInt(p, end, v) && p < end && *p++ == '/' &&
+           numparse::parseInt(p, end, t) && p < end && *p++ == '/' &&
+           numparse::parseInt(p, end, n);
+}
+
+/*
+ * Convert an OBJ index to a zero based array index. Indices start at 1, and negative
+ * indices count backwards from the most recently defined element.
+ */
+bool resolveIndex(int64_t index, int count, int& result) {
+    if (index > 0 && index <= count) {
+        result = static_cast<int>(index - 1);
+        return true;
+    }
+    if (index < 0 && -index <= count) {
+        result = static_cast<int>(count + index);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Scan the lines in [begin, end) in one pass. Vertex data is appended to 'elements', and each
+ * of the three corners of a face is handed to corner(v, t, n) with the raw OBJ indices.
+ * Like the scanf() loader, any further corners on a face line are ignored.
+ */
+template <typename CornerFunction>
+Error scan(const char* begin, const char* end, Elements& elements, CornerFunction&& corner) {
+    Counts& counts = elements.counts;
+    const char* p = begin;
+    while (p < end) {
+        p = skipBlanks(p, end);
+        const char* tag = p;
+        while (p < end && !isSpace(*p)) {
+            ++p;
+        }
+        const size_t taglen = static_cast<size_t>(p - tag);
+
+        if (taglen == 1 && tag[0] == 'v') {
+            // A vertex with three coordinates
+            float xyz[3];
+            if (!numparse::parseFloat(p, end, xyz[0]) || !numparse::parseFloat(p, end, xyz[1]) ||
+                !numparse::parseFloat(p, end, xyz[2])) {
+                return Error::Vertex;
+            }
+            elements.verts.insert(elements.verts.end(), xyz, xyz + 3);
+            counts.verts++;
+        } else if (taglen == 2 && tag[0] == 'v' && tag[1] == 'n') {
+            // A vertex normal with three components
+            float nxyz[3];
+            if (!numparse::parseFloat(p, end, nxyz[0]) ||
+                !numparse::parseFloat(p, end, nxyz[1]) ||
+                !numparse::parseFloat(p, end, nxyz[2])) {
+                return Error::Normal;
+            }
+            elements.normals.insert(elements.normals.end(), nxyz, nxyz + 3);
+            counts.normals++;
+        } else if (taglen == 2 && tag[0] == 'v' && tag[1] == 't') {
+            // A vertex texture coordinate, two components
+            float st[2];
+            if (!numparse::parseFloat(p, end, st[0]) || !numparse::parseFloat(p, end, st[1])) {
+                return Error::Texcoord;
+            }
+            elements.texcoords.insert(elements.texcoords.end(), st, st + 2);
+            counts.texcoords++;
+        } else if (taglen == 1 && tag[0] == 'f') {
+            // A face with three vertex indices
+            for (int i = 0; i < 3; i++) {
+                int64_t v, t, n;
+                if (!parseCorner(p, end, v, t, n) || !corner(v, t, n)) {
+                    return Error::Face;
+                }
+            }
+            counts.faces++;
+        }
+        p = skipLine(p, end);
+    }
+    return Error::None;
+}
+
+// Print an error message for the element after the ones in 'counts'
+void printError(Error error, const Counts& counts) {
+    switch (error) {
+        case Error::Vertex:
+            std::cerr << "Malformed vertex data found at vertex " << counts.verts + 1
+                      << "\nAborting\n";
+            break;
+        case Error::Normal:
+            std::cerr << "Malformed normal data found at normal" << counts.normals + 1
+                      << "\nAborting\n";
+            break;
+        case Error::Texcoord:
+            std::cerr << "Malformed texcoord data found at texcoord " << counts.texcoords + 1
+                      << "\nAborting\n";
+            break;
+        case Error::Face:
+            std::cerr << "Malformed face data found at vertex " << counts.faces + 1
+                      << "\nAborting\n";
+            break;
+        case Error::None:
+            break;
+    }
+}
+
+// Append the 8 floats of one vertex to the interleaved vertex array
+void appendVertex(std::vector<float>& vertexarray, const Elements& elements, int v, int t, int n) {
+    const float vertex[8] = {elements.verts[3 * v],         elements.verts[3 * v + 1],
+                             elements.verts[3 * v + 2],     elements.normals[3 * n],
+                             elements.normals[3 * n + 1],   elements.normals[3 * n + 2],
+                             elements.texcoords[2 * t],     elements.texcoords[2 * t + 1]};
+    vertexarray.insert(vertexarray.end(), vertex, vertex + 8);
+}
+
+/*
+ * A hash table from zero based (v, t, n) index triples to vertex numbers, used for welding.
+ * Open addressing with linear probing keeps the whole table in one flat array.
+ */
+class CornerMap {
+public:
+    CornerMap(size_t expected) : mask_(0), size_(0) {
+        size_t capacity = 64;
+        while (capacity < 2 * expected) {
+            capacity *= 2;
+        }
+        slots_.resize(capacity);
+        mask_ = capacity - 1;
+    }
+
+    // Return the vertex number stored for (v, t, n), or store 'index' for it and return that
+    unsigned int insert(int v, int t, int n, unsigned int index) {
+        if (2 * (size_ + 1) > slots_.size()) {
+            grow();
+        }
+        size_t i = hash(v, t, n) & mask_;
+        for (;; i = (i + 1) & mask_) {
+            Slot& slot = slots_[i];
+            if (slot.v < 0) {
+                slot = {v, t, n, index};
+                size_++;
+                return index;
+            }
+            if (slot.v == v && slot.t == t && slot.n == n) {
+                return slot.index;
+            }
+        }
+    }
+
+private:
+    struct Slot {
+        int v = -1;  // -1 marks an empty slot
+        int t = 0;
+        int n = 0;
+        unsigned int index = 0;
+    };
+
+    static size_t hash(int v, int t, int n) {
+        uint64_t h = static_cast<uint32_t>(v) * 0x9E3779B97F4A7C15ull;
+        h ^= (static_cast<uint32_t>(t) + (h << 6) + (h >> 2)) * 0xC2B2AE3D27D4EB4Full;
+        h ^= (static_cast<uint32_t>(n) + (h << 6) + (h >> 2)) * 0x165667B19E3779F9ull;
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+
+    void grow() {
+        std::vector<Slot> old;
+        old.swap(slots_);
+        slots_.resize(2 * old.size());
+        mask_ = slots_.size() - 1;
+        size_ = 0;
+        for (const Slot& slot : old) {
+            if (slot.v >= 0) {
+                insert(slot.v, slot.t, slot.n, slot.index);
+            }
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t mask_;
+    size_t size_;
+};
+
+/*
+ * The parallel parser splits the file into chunks of whole lines. Each chunk is scanned on
+ * its own, and the face corners are stored as zero based indices until the number of elements
+ * in all earlier chunks is known. Negative (relative) indices can only be resolved then, so
+ * their positions in 'corners' are kept in 'relative' and the chunk offset is added later.
+ * Like parse(), a face may only use elements defined before it, so the number of elements
+ * read in the chunk before each face is kept in 'defined' to check the indices against.
+ */
+struct Chunk {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+    Elements elements;
+    std::vector<int> corners;   // v, t, n for each face corner
+    std::vector<int> relative;  // positions in 'corners' that are relative to the chunk offset
+    std::vector<int> defined;   // v, t and n elements in the chunk before each face
+    Error error = Error::None;
+    Counts offsets;  // Number of elements in all earlier chunks
+
+    // Welding only: the distinct corners of this chunk, and a reference to one of
+    // them for each corner. 'remap' is the global vertex number of each distinct corner.
+    std::vector<int> unique;
+    std::vector<unsigned int> local;
+    std::vector<unsigned int> remap;
+};
+
+// Parallel parsing is not worth the overhead for chunks smaller than this
+const size_t minChunkSize = 64 * 1024;
+
+void scanChunk(Chunk& chunk) {
+    const Counts& local = chunk.elements.counts;
+    auto record = [&chunk, &local](int64_t v, int64_t t, int64_t n) {
+        const int64_t index[3] = {v, t, n};
+        const int count[3] = {local.verts, local.texcoords, local.normals};
+        if (chunk.corners.size() % 9 == 0) {
+            chunk.defined.insert(chunk.defined.end(), count, count + 3);  // First corner
+        }
+        for (int i = 0; i < 3; i++) {
+            if (index[i] > 0 && index[i] <= 0x7fffffff) {
+                chunk.corners.push_back(static_cast<int>(index[i] - 1));
+            } else if (index[i] < 0 && index[i] >= -0x7fffffff) {
+                chunk.relative.push_back(static_cast<int>(chunk.corners.size()));
+                chunk.corners.push_back(static_cast<int>(count[i] + index[i]));
+            } else {
+                return false;
+            }
+        }
+        return true;
+    };
+    chunk.error = scan(chunk.begin, chunk.end, chunk.elements, record);
+}
+
+/*
+ * Turn the corners of a chunk into global indices and check that they refer to elements
+ * defined before their face, as resolveIndex() does for parse()
+ */
+bool resolveChunk(Chunk& chunk) {
+    const int offset[3] = {chunk.offsets.verts, chunk.offsets.texcoords, chunk.offsets.normals};
+    for (int position : chunk.relative) {
+        chunk.corners[position] += offset[position % 3];
+    }
+
+    for (size_t i = 0; i < chunk.corners.size(); i++) {
+        const int limit = offset[i % 3] + chunk.defined[3 * (i / 9) + i % 3];
+        if (chunk.corners[i] < 0 || chunk.corners[i] >= limit) {
+            // Report the face number within the chunk, parseParallel() adds the offset
+            chunk.error = Error::Face;
+            chunk.elements.counts.faces = static_cast<int>(i / 9);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Build the interleaved vertices for the faces of a chunk, starting at its face offset
+void fillChunk(const Chunk& chunk, const Elements& all, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray) {
+    const size_t firstvertex = 3 * static_cast<size_t>(chunk.offsets.faces);
+    float* out = vertexarray.data() + 8 * firstvertex;
+    for (size_t i = 0; i < chunk.corners.size(); i += 3) {
+        const int v = chunk.corners[i];
+        const int t = chunk.corners[i + 1];
+        const int n = chunk.corners[i + 2];
+        out[0] = all.verts[3 * v];
+        out[1] = all.verts[3 * v + 1];
+        out[2] = all.verts[3 * v + 2];
+        out[3] = all.normals[3 * n];
+        out[4] = all.normals[3 * n + 1];
+        out[5] = all.normals[3 * n + 2];
+        out[6] = all.texcoords[2 * t];
+        out[7] = all.texcoords[2 * t + 1];
+        out += 8;
+        const size_t index = firstvertex + i / 3;
+        indexarray[index] = static_cast<unsigned int>(index);
+    }
+}
+
+// Welding, step 1: find the distinct corners within a chunk
+void weldChunk(Chunk& chunk) {
+    CornerMap map(chunk.corners.size() / 6);
+    chunk.local.resize(chunk.corners.size() / 3);
+    for (size_t i = 0; i < chunk.corners.size(); i += 3) {
+        const int* c = &chunk.corners[i];
+        const unsigned int next = static_cast<unsigned int>(chunk.unique.size() / 3);
+        const unsigned int index = map.insert(c[0], c[1], c[2], next);
+        if (index == next) {
+            chunk.unique.insert(chunk.unique.end(), c, c + 3);
+        }
+        chunk.local[i / 3] = index;
+    }
+}
+
+/*
+ * Add one face corner to the arrays, resolving it against the elements read so far.
+ * With a map, the corner is welded to an earlier vertex with the same index triple.
+ */
+bool addCorner(int64_t v, int64_t t, int64_t n, const Elements& elements, CornerMap* map,
+               std::vector<float>& vertexarray, std::vector<unsigned int>& indexarray) {
+    int iv, it, in;
+    if (!resolveIndex(v, elements.counts.verts, iv) ||
+        !resolveIndex(t, elements.counts.texcoords, it) ||
+        !resolveIndex(n, elements.counts.normals, in)) {
+        return false;
+    }
+    const unsigned int next = static_cast<unsigned int>(vertexarray.size() / 8);
+    const unsigned int index = map ? map->insert(iv, it, in, next) : next;
+    if (index == next) {
+        appendVertex(vertexarray, elements, iv, it, in);
+    }
+    indexarray.push_back(index);
+    return true;
+}
+
+// Add the element counts of two ranges
+Counts operator+(const Counts& a, const Counts& b) {
+    Counts sum;
+    sum.verts = a.verts + b.verts;
+    sum.normals = a.normals + b.normals;
+    sum.texcoords = a.texcoords + b.texcoords;
+    sum.faces = a.faces + b.faces;
+    return sum;
+}
+
+}  // namespace
+
+bool parse(const char* begin, const char* end, std::vector<float>& vertexarray,
+           std::vector<unsigned int>& indexarray, Counts& counts, bool weld) {
+    Elements elements;
+    vertexarray.clear();
+    indexarray.clear();
+    CornerMap map(weld ? static_cast<size_t>(end - begin) / 256 : 0);
+
+    auto emit = [&](int64_t v, int64_t t, int64_t n) {
+        return addCorner(v, t, n, elements, weld ? &map : nullptr, vertexarray, indexarray);
+    };
+
+    const Error error = scan(begin, end, elements, emit);
+    counts = elements.counts;
+    if (error != Error::None) {
+        printError(error, counts);
+        return false;
+    }
+    return true;
+}
+
+bool parseParallel(const char* begin, const char* end, std::vector<float>& vertexarray,
+                   std::vector<unsigned int>& indexarray, Counts& counts, int threads,
+                   bool weld) {
+    ThreadPool& pool = ThreadPool::instance();
+    if (threads <= 0) {
+        threads = pool.size();
+    }
+    const size_t size = static_cast<size_t>(end - begin);
+    const int numchunks =
+        static_cast<int>(std::min(static_cast<size_t>(threads), size / minChunkSize + 1));
+    if (numchunks <= 1) {
+        return parse(begin, end, vertexarray, indexarray, counts, weld);
+    }
+
+    // Split the buffer into chunks of roughly equal size, ending at a line break
+    std::vector<Chunk> chunks(numchunks);
+    const char* p = begin;
+    for (int i = 0; i < numchunks; i++) {
+        chunks[i].begin = p;
+        if (i == numchunks - 1) {
+            p = end;
+        } else {
+            p = std::max(p, begin + size / numchunks * (i + 1));
+            p = p < end ? skipLine(p, end) : end;
+        }
+        chunks[i].end = p;
+    }
+
+    // Pass 1: scan all chunks in parallel
+    pool.parallelFor(numchunks, [&chunks](int i) { scanChunk(chunks[i]); });
+
+    // Prefix sum of the element counts, and the first error in file order
+    Counts total;
+    for (Chunk& chunk : chunks) {
+        chunk.offsets = total;
+        if (chunk.error != Error::None) {
+            printError(chunk.error, total + chunk.elements.counts);
+            counts = total + chunk.elements.counts;
+            return false;
+        }
+        total = total + chunk.elements.counts;
+    }
+    counts = total;
+
+    // Pass 2: gather the vertex attributes in file order and resolve the face corners
+    Elements all;
+    all.counts = total;
+    all.verts.resize(3 * static_cast<size_t>(total.verts));
+    all.normals.resize(3 * static_cast<size_t>(total.normals));
+    all.texcoords.resize(2 * static_cast<size_t>(total.texcoords));
+
+    std::vector<char> success(numchunks, 0);
+    pool.parallelFor(numchunks, [&](int i) {
+        const Elements& local = chunks[i].elements;
+        const Counts& offsets = chunks[i].offsets;
+        std::copy(local.verts.begin(), local.verts.end(), all.verts.begin() + 3 * offsets.verts);
+        std::copy(local.normals.begin(), local.normals.end(),
+                  all.normals.begin() + 3 * offsets.normals);
+        std::copy(local.texcoords.begin(), local.texcoords.end(),
+                  all.texcoords.begin() + 2 * offsets.texcoords);
+        success[i] = resolveChunk(chunks[i]) ? 1 : 0;
+    });
+
+    for (int i = 0; i < numchunks; i++) {
+        if (!success[i]) {
+            Counts at = chunks[i].offsets;
+            at.faces += chunks[i].elements.counts.faces;
+            printError(Error::Face, at);
+            return false;
+        }
+    }
+
+    indexarray.resize(3 * static_cast<size_t>(total.faces));
+
+    if (!weld) {
+        // Pass 3: build the faces of each chunk in its own part of the arrays
+        vertexarray.resize(8 * 3 * static_cast<size_t>(total.faces));
+        pool.parallelFor(numchunks, [&](int i) {
+            fillChunk(chunks[i], all, vertexarray, indexarray);
+        });
+        return true;
+    }
+
+    // Pass 3: weld the corners within each chunk, then merge the distinct corners of all
+    // chunks in file order. This gives the same vertex order as parse() with welding.
+    pool.parallelFor(numchunks, [&chunks](int i) { weldChunk(chunks[i]); });
+
+    CornerMap map(static_cast<size_t>(total.faces) / 2);
+    vertexarray.clear();
+    for (Chunk& chunk : chunks) {
+        chunk.remap.resize(chunk.unique.size() / 3);
+        for (size_t i = 0; i < chunk.unique.size(); i += 3) {
+            const int* c = &chunk.unique[i];
+            const unsigned int next = static_cast<unsigned int>(vertexarray.size() / 8);
+            const unsigned int index = map.insert(c[0], c[1], c[2], next);
+            if (index == next) {
+                appendVertex(vertexarray, all, c[0], c[1], c[2]);
+            }
+            chunk.remap[i / 3] = index;
+        }
+    }
+
+    pool.parallelFor(numchunks, [&chunks, &indexarray](int i) {
+        const Chunk& chunk = chunks[i];
+        unsigned int* out = indexarray.data() + 3 * static_cast<size_t>(chunk.offsets.faces);
+        for (unsigned int local : chunk.local) {
+            *out++ = chunk.remap[local];
+        }
+    });
+    return true;
+}
+
+// The parsing state kept between calls to StreamParser::parse()
+struct StreamParser::State {
+    MappedFile file;
+    const char* position = nullptr;
+    const char* end = nullptr;
+    Elements elements;
+    CornerMap map{0};
+    bool weld = false;
+    bool failed = false;
+    int totalfaces = 0;
+};
+
+StreamParser::StreamParser() : state_(new State) {}
+
+StreamParser::~StreamParser() = default;
+
+bool StreamParser::open(const std::string& filename, bool weld) {
+    state_.reset(new State);
+    State& state = *state_;
+    if (!state.file.open(filename)) {
+        std::cerr << "File not found: " << filename << "\n";
+        state.failed = true;
+        return false;
+    }
+    state.position = state.file.data();
+    state.end = state.file.data() + state.file.size();
+    state.weld = weld;
+
+    // Count the faces up front, looking only at the start of each line
+    for (const char* p = state.position; p < state.end; p = skipLine(p, state.end)) {
+        p = skipBlanks(p, state.end);
+        if (state.end - p >= 2 && p[0] == 'f' && isBlank(p[1])) {
+            state.totalfaces++;
+        }
+    }
+    state.map = CornerMap(weld ? 3 * static_cast<size_t>(state.totalfaces) / 4 : 0);
+    return true;
+}
+
+bool StreamParser::parse(size_t bytes, std::vector<float>& vertexarray,
+                         std::vector<unsigned int>& indexarray) {
+    State& state = *state_;
+    if (state.failed || state.position >= state.end) {
+        return !state.failed;
+    }
+
+    // Always stop at a line break, so only complete faces are added
+    const size_t left = static_cast<size_t>(state.end - state.position);
+    const char* stop = state.position + std::min(bytes, left);
+    stop = stop < state.end ? skipLine(stop, state.end) : state.end;
+
+    auto emit = [&](int64_t v, int64_t t, int64_t n) {
+        return addCorner(v, t, n, state.elements, state.weld ? &state.map : nullptr, vertexarray,
+                         indexarray);
+    };
+    const Error error = scan(state.position, stop, state.elements, emit);
+    state.position = stop;
+    if (error != Error::None) {
+        printError(error, state.elements.counts);
+        state.failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool StreamParser::done() const { return state_->failed || state_->position >= state_->end; }
+
+int StreamParser::totalFaces() const { return state_->totalfaces; }
+
+const Counts& StreamParser::counts() const { return state_->elements.counts; }
+
+const char* StreamParser::data() const { return state_->file.data(); }
+
+size_t StreamParser::size() const { return state_->file.size(); }
+
+}  // namespace obj
@@ -0,0 +1,119 @@
+/*
+ * Functions to parse geometry from Wavefront OBJ files.
+ *
+ * Usage: The parsers produce the interleaved vertex format used by TriangleSoup. For each
+ *        vertex, there are 8 floats: x y z, nx ny nz, s t. By default every face gets three
+ *        vertices of its own, and the index array simply enumerates them. With 'weld' set,
+ *        face corners that share the same v/t/n index triple share one vertex, which gives a
+ *        properly indexed mesh. Only "v", "vn", "vt" and "f v/t/n v/t/n v/t/n" lines are used.
+ *        All other lines are ignored.
+ *
+ *        readScanf() is the original two pass fgets()/sscanf() loader.
+ *        readMapped() maps the file into memory and parses it in a single pass, with the
+ *        number parsing in NumberParser.hpp.
+ *        readParallel() maps the file and parses chunks of it on several threads.
+ *        StreamParser maps the file and parses it a piece at a time, like readMapped().
+ *        All of them produce identical arrays for the same file. readScanf() does not weld.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace obj {
+
+// Number of data elements found in an OBJ file
+struct Counts {
+    int verts = 0;
+    int normals = 0;
+    int texcoords = 0;
+    int faces = 0;
+};
+
+/*
+ * Parse an OBJ file with two passes of fgets() and sscanf(), one to count the elements and one
+ * to read them. Returns false on errors, in which case the arrays are left in an undefined state.
+ */
+bool readScanf(const std::string& filename, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray, Counts& counts);
+
+/*
+ * Map an OBJ file into memory and parse it in a single pass with parse().
+ * Returns false on errors, in which case the arrays are left in an undefined state.
+ */
+bool readMapped(const std::string& filename, std::vector<float>& vertexarray,
+                std::vector<unsigned int>& indexarray, Counts& counts, bool weld = false);
+
+/*
+ * Parse the OBJ data in [begin, end) in a single pass. The arrays are grown as the faces are
+ * read, so faces may only refer to vertices, normals and texcoords defined above them.
+ * Welded vertices are numbered in the order their index triple first appears in the file.
+ */
+bool parse(const char* begin, const char* end, std::vector<float>& vertexarray,
+           std::vector<unsigned int>& indexarray, Counts& counts, bool weld = false);
+
+/*
+ * Map an OBJ file into memory and parse it with parseParallel().
+ * Returns false on errors, in which case the arrays are left in an undefined state.
+ */
+bool readParallel(const std::string& filename, std::vector<float>& vertexarray,
+                  std::vector<unsigned int>& indexarray, Counts& counts, int threads = 0,
+                  bool weld = false);
+
+/*
+ * Parse the OBJ data in [begin, end) on up to 'threads' threads of ThreadPool::instance()
+ * (0 means all of them). The buffer is split into chunks at line breaks, each chunk is parsed
+ * on its own, and a prefix sum of the element counts of the chunks turns the chunk local
+ * indices into global ones. Small buffers are parsed with parse() on the calling thread.
+ * When welding, each chunk is welded on its own before the chunks are merged in file order,
+ * so the result is the same as for parse().
+ */
+bool parseParallel(const char* begin, const char* end, std::vector<float>& vertexarray,
+                   std::vector<unsigned int>& indexarray, Counts& counts, int threads = 0,
+                   bool weld = false);
+
+/*
+ * A single pass parser that reads a memory mapped OBJ file a piece at a time, so a mesh can be
+ * loaded progressively over several frames. After each call to parse(), the arrays hold all
+ * faces read so far, and the indices refer only to vertices that are already in the array.
+ */
+class StreamParser {
+public:
+    StreamParser();
+    ~StreamParser();
+
+    StreamParser(const StreamParser&) = delete;
+    StreamParser& operator=(const StreamParser&) = delete;
+
+    /* Map the file and count its faces. Returns false if the file could not be opened */
+    bool open(const std::string& filename, bool weld = false);
+
+    /*
+     * Parse whole lines until at least 'bytes' bytes more of the file are read, or the file
+     * ends, appending to the arrays. Returns false on errors.
+     */
+    bool parse(size_t bytes, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray);
+
+    /* Returns true when the whole file is read, or parsing failed */
+    bool done() const;
+
+    // returns the number of faces in the file, counted by open()
+    int totalFaces() const;
+
+    // returns the number of elements read so far
+    const Counts& counts() const;
+
+    // returns the contents of the mapped file
+    const char* data() const;
+    size_t size() const;
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+}  // namespace obj
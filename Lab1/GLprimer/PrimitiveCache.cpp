@@ -0,0 +1,76 @@
+/*
+ * Shared procedural meshes, see PrimitiveCache.hpp
+ *
+ * This code is in the public domain.
+ */
+#include "PrimitiveCache.hpp"
+
+#include <cstdio>
+
+#include "TriangleSoup.hpp"
+
+std::map<PrimitiveCache::Key, std::weak_ptr<TriangleSoup>> PrimitiveCache::meshes_;
+int PrimitiveCache::requests_ = 0;
+int PrimitiveCache::uploads_ = 0;
+
+PrimitiveCache::Handle PrimitiveCache::get(Shape shape, int segments, const VertexFormat& format) {
+    requests_++;
+    if (shape == Shape::Triangle || shape == Shape::Box) {
+        segments = 0;
+    }
+    std::weak_ptr<TriangleSoup>& entry =
+        meshes_[Key(std::make_pair(static_cast<int>(shape), segments), format.key())];
+    Handle mesh = entry.lock();
+    if (mesh) {
+        return mesh;
+    }
+
+    mesh = std::make_shared<TriangleSoup>();
+    mesh->setVertexFormat(format);
+    switch (shape) {
+        case Shape::Triangle:
+            mesh->createTriangle();
+            break;
+        case Shape::Box:
+            mesh->createBox(1.0f, 1.0f, 1.0f);
+            break;
+        case Shape::Sphere:
+            mesh->createSphere(1.0f, segments);
+            break;
+        case Shape::CubeSphere:
+            mesh->createCubeSphere(1.0f, segments);
+            break;
+    }
+    entry = mesh;
+    uploads_++;
+    return mesh;
+}
+
+PrimitiveCache::Stats PrimitiveCache::stats() {
+    Stats s;
+    s.requests = requests_;
+    s.uploads = uploads_;
+    for (auto it = meshes_.begin(); it != meshes_.end();) {
+        const Handle mesh = it->second.lock();
+        if (!mesh) {
+            it = meshes_.erase(it);  // All handles are gone
+            continue;
+        }
+        // Not counting the handle held here
+        const size_t handles = static_cast<size_t>(it->second.use_count() - 1);
+        s.meshes++;
+        s.handles += static_cast<int>(handles);
+        s.gpubytes += mesh->gpuBytes();
+        s.savedbytes += (handles - 1) * mesh->gpuBytes();
+        ++it;
+    }
+    return s;
+}
+
+void PrimitiveCache::printStats() {
+    const Stats s = stats();
+    printf("PrimitiveCache information:\n");
+    printf("meshes   : %d, shared by %d handles\n", s.meshes, s.handles);
+    printf("requests : %d, %d of them uploaded a mesh\n", s.requests, s.uploads);
+    printf("GPU bytes: %zu (%zu more without sharing)\n", s.gpubytes, s.savedbytes);
+}
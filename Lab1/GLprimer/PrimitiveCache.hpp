@@ -0,0 +1,70 @@
+/*
+ * One shared copy on the GPU of each procedural mesh, for any number of users.
+ *
+ * Usage: PrimitiveCache::get() returns a handle to the mesh of a shape, a reference counted
+ *        std::shared_ptr to a TriangleSoup. The first request creates and uploads the mesh,
+ *        and later requests for the same shape, number of segments and vertex format get a
+ *        handle to the same one. The mesh and its buffers are deleted when the last handle
+ *        goes away, and a later request creates it again.
+ *
+ *        The meshes have unit size: the spheres have radius 1, and the box and the triangle
+ *        reach from -1 to 1. The size of an object goes in its transform instead, such as the
+ *        'transform' uniform of meshvertex.glsl or the scale of an InstanceBuffer instance,
+ *        so objects of all sizes share one mesh. A shared mesh must not be edited, see Handle.
+ *
+ *        The handles hold OpenGL objects, so drop them all before the context is destroyed.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <map>
+#include <memory>
+
+#include "VertexFormat.hpp"
+
+class TriangleSoup;
+
+class PrimitiveCache {
+public:
+    // The procedural meshes of TriangleSoup
+    enum class Shape {
+        Triangle,   // createTriangle()
+        Box,        // createBox(1, 1, 1)
+        Sphere,     // createSphere(1, segments)
+        CubeSphere  // createCubeSphere(1, segments)
+    };
+
+    /* A shared mesh. Only draw it and ask about it through a handle: render(),
+       renderInstanced(), pick(), gpuBytes() and the like. Anything that changes the mesh,
+       such as translate(), optimize(), setVertexFormat(), setLOD() or a create...() or
+       readOBJ() call, changes it for every handle, and for later get() calls as well. */
+    using Handle = std::shared_ptr<TriangleSoup>;
+
+    // Use of the cache since the start of the program
+    struct Stats {
+        int meshes = 0;         // Meshes with handles alive
+        int handles = 0;        // Handles alive, to all of them
+        int requests = 0;       // Calls to get()
+        int uploads = 0;        // Requests that created a mesh
+        size_t gpubytes = 0;    // GPU memory of the shared meshes
+        size_t savedbytes = 0;  // GPU memory that a mesh per handle would have taken on top
+    };
+
+    /* Return a handle to the mesh of 'shape', with 'segments' for the spheres (ignored for the
+       other shapes), in the vertex format 'format' on the GPU */
+    static Handle get(Shape shape, int segments = 0, const VertexFormat& format = VertexFormat());
+
+    static Stats stats();
+
+    /* Print stats() */
+    static void printStats();
+
+private:
+    // Shape, segments and VertexFormat::key()
+    using Key = std::pair<std::pair<int, int>, int>;
+
+    static std::map<Key, std::weak_ptr<TriangleSoup>> meshes_;
+    static int requests_;
+    static int uploads_;
+};
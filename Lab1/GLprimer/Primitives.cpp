@@ -0,0 +1,453 @@
+/*
+ * Procedural meshes, see Primitives.hpp
+ *
+ * This code is in the public domain.
+ */
+#if defined(WIN32) && !defined(_USE_MATH_DEFINES)
+#define _USE_MATH_DEFINES
+#endif
+
+#include "Primitives.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+
+#include "ThreadPool.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PRIMITIVES_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+// Meshes with fewer vertices than this are not worth splitting over the thread pool
+const int parallelVertices = 1 << 16;
+
+/* Write one vertex, with the position at the unit vector (x, y, z) scaled by 'radius' */
+inline void writeVertex(float* v, float radius, float x, float y, float z, float s, float t) {
+    v[0] = radius * x;
+    v[1] = radius * y;
+    v[2] = radius * z;
+    v[3] = x;
+    v[4] = y;
+    v[5] = z;
+    v[6] = s;
+    v[7] = t;
+}
+
+/*
+ * Write the vertices of one latitude ring of sphere(), at height 'z' with radius 'r' in the
+ * unit sphere. With SSE, four vertices are computed side by side, and transposed into the
+ * interleaved format in registers.
+ */
+void writeRing(float* v, float radius, float r, float z, float t, const std::vector<float>& cosphi,
+               const std::vector<float>& sinphi, const std::vector<float>& s) {
+    const size_t count = cosphi.size();
+    size_t i = 0;
+#ifdef PRIMITIVES_SSE
+    const __m128 r4 = _mm_set1_ps(r);
+    const __m128 radius4 = _mm_set1_ps(radius);
+    const __m128 radiusz4 = _mm_set1_ps(radius * z);
+    const __m128 z4 = _mm_set1_ps(z);
+    const __m128 t4 = _mm_set1_ps(t);
+    for (; i + 4 <= count; i += 4) {
+        const __m128 x = _mm_mul_ps(r4, _mm_loadu_ps(&cosphi[i]));
+        const __m128 y = _mm_mul_ps(r4, _mm_loadu_ps(&sinphi[i]));
+        __m128 lo0 = _mm_mul_ps(radius4, x);
+        __m128 lo1 = _mm_mul_ps(radius4, y);
+        __m128 lo2 = radiusz4;
+        __m128 lo3 = x;
+        __m128 hi0 = y;
+        __m128 hi1 = z4;
+        __m128 hi2 = _mm_loadu_ps(&s[i]);
+        __m128 hi3 = t4;
+        _MM_TRANSPOSE4_PS(lo0, lo1, lo2, lo3);
+        _MM_TRANSPOSE4_PS(hi0, hi1, hi2, hi3);
+        float* out = v + 8 * i;
+        _mm_storeu_ps(out, lo0);
+        _mm_storeu_ps(out + 4, hi0);
+        _mm_storeu_ps(out + 8, lo1);
+        _mm_storeu_ps(out + 12, hi1);
+        _mm_storeu_ps(out + 16, lo2);
+        _mm_storeu_ps(out + 20, hi2);
+        _mm_storeu_ps(out + 24, lo3);
+        _mm_storeu_ps(out + 28, hi3);
+    }
+#endif
+    for (; i < count; i++) {
+        writeVertex(v + 8 * i, radius, r * cosphi[i], r * sinphi[i], z, s[i], t);
+    }
+}
+
+// pi / 2 split into the nearest double and the rest, for an accurate argument reduction
+constexpr double halfPiHi = 1.5707963267948966;
+constexpr double halfPiLo = 6.123233995736766e-17;
+
+/* Taylor series of sine and cosine, for |x| <= pi / 4 */
+constexpr double sinSeries(double x) {
+    double term = x;
+    double sum = x;
+    for (int n = 1; n <= 12; n++) {
+        term *= -x * x / ((2.0 * n) * (2.0 * n + 1.0));
+        sum += term;
+    }
+    return sum;
+}
+
+constexpr double cosSeries(double x) {
+    double term = 1.0;
+    double sum = 1.0;
+    for (int n = 1; n <= 12; n++) {
+        term *= -x * x / ((2.0 * n - 1.0) * (2.0 * n));
+        sum += term;
+    }
+    return sum;
+}
+
+/* Sine and cosine of an angle >= 0 that can be evaluated while compiling */
+constexpr void sinCos(double angle, double& s, double& c) {
+    const int quadrant = static_cast<int>(angle / halfPiHi + 0.5);
+    const double x = (angle - quadrant * halfPiHi) - quadrant * halfPiLo;
+    const double sx = sinSeries(x);
+    const double cx = cosSeries(x);
+    switch (quadrant & 3) {
+        case 0:
+            s = sx;
+            c = cx;
+            break;
+        case 1:
+            s = cx;
+            c = -sx;
+            break;
+        case 2:
+            s = -sx;
+            c = -cx;
+            break;
+        default:
+            s = -cx;
+            c = sx;
+            break;
+    }
+}
+
+// The unit sphere of sphere() with a fixed number of segments
+template <int Segments>
+struct SphereData {
+    static constexpr int vsegs = Segments;
+    static constexpr int hsegs = 2 * Segments;
+    static constexpr int numvertices = 1 + (vsegs - 1) * (hsegs + 1) + 1;
+    static constexpr int numindices = 3 * (hsegs + (vsegs - 2) * hsegs * 2 + hsegs);
+    std::array<float, 8 * numvertices> vertices;
+    std::array<unsigned int, numindices> indices;
+};
+
+/* The same vertices and indices as sphere(), with radius 1 */
+template <int Segments>
+constexpr SphereData<Segments> makeSphere() {
+    using Data = SphereData<Segments>;
+    constexpr int vsegs = Data::vsegs;
+    constexpr int hsegs = Data::hsegs;
+    Data data{};
+    auto vertex = [&data](int v, float x, float y, float z, float s, float t) {
+        const float values[8] = {x, y, z, x, y, z, s, t};
+        for (int k = 0; k < 8; k++) {
+            data.vertices[static_cast<size_t>(8 * v + k)] = values[k];
+        }
+    };
+    vertex(0, 0.0f, 0.0f, 1.0f, 0.5f, 1.0f);
+    vertex(Data::numvertices - 1, 0.0f, 0.0f, -1.0f, 0.5f, 0.0f);
+    for (int j = 0; j < vsegs - 1; j++) {
+        double sintheta = 0.0;
+        double costheta = 0.0;
+        sinCos(static_cast<double>(j + 1) / vsegs * M_PI, sintheta, costheta);
+        const float z = static_cast<float>(costheta);
+        const float r = static_cast<float>(sintheta);
+        const float t = 1.0f - static_cast<float>(j + 1) / static_cast<float>(vsegs);
+        for (int i = 0; i <= hsegs; i++) {
+            double sinphi = 0.0;
+            double cosphi = 0.0;
+            sinCos(static_cast<double>(i) / hsegs * 2.0 * M_PI, sinphi, cosphi);
+            vertex(1 + j * (hsegs + 1) + i, r * static_cast<float>(cosphi),
+                   r * static_cast<float>(sinphi), z,
+                   static_cast<float>(i) / static_cast<float>(hsegs), t);
+        }
+    }
+
+    auto triangle = [&data](int t, int a, int b, int c) {
+        data.indices[static_cast<size_t>(3 * t)] = static_cast<unsigned int>(a);
+        data.indices[static_cast<size_t>(3 * t + 1)] = static_cast<unsigned int>(b);
+        data.indices[static_cast<size_t>(3 * t + 2)] = static_cast<unsigned int>(c);
+    };
+    const int bottom = Data::numvertices - 1;
+    for (int i = 0; i < hsegs; i++) {
+        triangle(i, 0, 1 + i, 2 + i);
+        triangle(hsegs + 2 * (vsegs - 2) * hsegs + i, bottom, bottom - 1 - i, bottom - 2 - i);
+    }
+    for (int j = 0; j < vsegs - 2; j++) {
+        for (int i = 0; i < hsegs; i++) {
+            const int t = hsegs + 2 * (j * hsegs + i);
+            const int i0 = 1 + j * (hsegs + 1) + i;
+            triangle(t, i0, i0 + hsegs + 1, i0 + 1);
+            triangle(t + 1, i0 + 1, i0 + hsegs + 1, i0 + hsegs + 2);
+        }
+    }
+    return data;
+}
+
+// The tables, evaluated by the compiler
+constexpr float triangleVertices[] = {
+    -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 0
+    1.0f,  -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,  // Vertex 1
+    0.0f,  1.0f,  0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 1.0f   // Vertex 2
+};
+constexpr unsigned int triangleIndices[] = {0, 1, 2};
+
+constexpr float boxVertices[] = {
+    -1.0f, -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 0
+    1.0f,  -1.0f, -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 1
+    -1.0f, 1.0f,  -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 2
+    1.0f,  1.0f,  -1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 3
+    -1.0f, -1.0f, 1.0f,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 4
+    1.0f,  -1.0f, 1.0f,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 5
+    -1.0f, 1.0f,  1.0f,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 6
+    1.0f,  1.0f,  1.0f,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f   // Vertex 7
+};
+constexpr unsigned int boxIndices[] = {0, 3, 1, 0, 2, 3, 1, 4, 0, 1, 5, 4, 4, 2, 0, 4, 6, 2,
+                                       1, 3, 7, 1, 7, 5, 7, 2, 6, 7, 3, 2, 4, 5, 7, 4, 7, 6};
+
+constexpr SphereData<6> sphere6 = makeSphere<6>();
+constexpr SphereData<8> sphere8 = makeSphere<8>();
+constexpr SphereData<16> sphere16 = makeSphere<16>();
+constexpr SphereData<32> sphere32 = makeSphere<32>();
+
+template <int Segments>
+constexpr primitives::Table makeTable(const SphereData<Segments>& data) {
+    return {data.vertices.data(), SphereData<Segments>::numvertices, data.indices.data(),
+            SphereData<Segments>::numindices};
+}
+
+constexpr primitives::Table triangleMesh = {triangleVertices, 3, triangleIndices, 3};
+constexpr primitives::Table boxMesh = {boxVertices, 8, boxIndices, 36};
+constexpr int sphereSegments[] = {6, 8, 16, 32};
+constexpr primitives::Table sphereMeshes[] = {makeTable(sphere6), makeTable(sphere8),
+                                              makeTable(sphere16), makeTable(sphere32)};
+
+/* Run task(0) ... task(count - 1), on the thread pool if the mesh is large */
+void forEach(int count, int numvertices, const std::function<void(int)>& task) {
+    if (numvertices < parallelVertices) {
+        for (int i = 0; i < count; i++) {
+            task(i);
+        }
+    } else {
+        ThreadPool::instance().parallelFor(count, task);
+    }
+}
+
+}  // namespace
+
+namespace primitives {
+
+const Table& triangleTable() { return triangleMesh; }
+
+const Table& boxTable() { return boxMesh; }
+
+const Table* sphereTable(int segments) {
+    for (size_t i = 0; i < 4; i++) {
+        if (sphereSegments[i] == segments) {
+            return &sphereMeshes[i];
+        }
+    }
+    return nullptr;
+}
+
+void copyTable(const Table& table, const float* scale, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray) {
+    vertexarray.assign(table.vertices, table.vertices + 8 * table.numvertices);
+    indexarray.assign(table.indices, table.indices + table.numindices);
+    for (size_t i = 0; i < vertexarray.size(); i += 8) {
+        vertexarray[i] *= scale[0];
+        vertexarray[i + 1] *= scale[1];
+        vertexarray[i + 2] *= scale[2];
+    }
+}
+
+/*
+ * The vertices are: the top pole, vsegs - 1 rings of hsegs + 1 vertices from the top down,
+ * and the bottom pole. The triangles are: a fan around the top pole, two per quad of each
+ * band between two rings, and a fan around the bottom pole.
+ */
+void sphere(float radius, int segments, std::vector<float>& vertexarray,
+            std::vector<unsigned int>& indexarray) {
+    const int vsegs = std::max(segments, 2);
+    const int hsegs = vsegs * 2;
+    const int numvertices = 1 + (vsegs - 1) * (hsegs + 1) + 1;       // top + middle + bottom
+    const int numtriangles = hsegs + (vsegs - 2) * hsegs * 2 + hsegs;  // top + middle + bottom
+    vertexarray.resize(8 * static_cast<size_t>(numvertices));
+    indexarray.resize(3 * static_cast<size_t>(numtriangles));
+
+    // The longitudes are the same for all rings
+    std::vector<float> cosphi(static_cast<size_t>(hsegs + 1));
+    std::vector<float> sinphi(cosphi.size());
+    std::vector<float> s(cosphi.size());
+    for (int i = 0; i <= hsegs; i++) {
+        const double phi = static_cast<double>(i) / hsegs * 2.0 * M_PI;
+        cosphi[static_cast<size_t>(i)] = static_cast<float>(std::cos(phi));
+        sinphi[static_cast<size_t>(i)] = static_cast<float>(std::sin(phi));
+        s[static_cast<size_t>(i)] = static_cast<float>(i) / static_cast<float>(hsegs);
+    }
+
+    // The poles (+z is "up" in object local coords)
+    writeVertex(vertexarray.data(), radius, 0.0f, 0.0f, 1.0f, 0.5f, 1.0f);
+    writeVertex(vertexarray.data() + 8 * static_cast<size_t>(numvertices - 1), radius, 0.0f,
+                0.0f, -1.0f, 0.5f, 0.0f);
+
+    // Each task does one ring, and the band of triangles below it unless that is the bottom cap
+    unsigned int* bands = indexarray.data() + 3 * hsegs;
+    forEach(vsegs - 1, numvertices, [&](int j) {
+        const double theta = static_cast<double>(j + 1) / vsegs * M_PI;
+        const float z = static_cast<float>(std::cos(theta));
+        const float r = static_cast<float>(std::sin(theta));
+        const float t = 1.0f - static_cast<float>(j + 1) / static_cast<float>(vsegs);
+        writeRing(vertexarray.data() + 8 * (1 + static_cast<size_t>(j) * (hsegs + 1)), radius, r,
+                  z, t, cosphi, sinphi, s);
+        if (j == vsegs - 2) {
+            return;
+        }
+        unsigned int* band = bands + 6 * static_cast<size_t>(j) * hsegs;
+        for (int i = 0; i < hsegs; i++) {
+            const unsigned int i0 = static_cast<unsigned int>(1 + j * (hsegs + 1) + i);
+            const unsigned int below = i0 + static_cast<unsigned int>(hsegs) + 1;
+            unsigned int* quad = band + 6 * i;
+            quad[0] = i0;
+            quad[1] = below;
+            quad[2] = i0 + 1;
+            quad[3] = i0 + 1;
+            quad[4] = below;
+            quad[5] = below + 1;
+        }
+    });
+
+    // The caps
+    const unsigned int bottom = static_cast<unsigned int>(numvertices - 1);
+    unsigned int* topcap = indexarray.data();
+    unsigned int* bottomcap = indexarray.data() + 3 * (hsegs + 2 * (vsegs - 2) * hsegs);
+    for (int i = 0; i < hsegs; i++) {
+        const unsigned int u = static_cast<unsigned int>(i);
+        topcap[3 * i] = 0;
+        topcap[3 * i + 1] = 1 + u;
+        topcap[3 * i + 2] = 2 + u;
+        bottomcap[3 * i] = bottom;
+        bottomcap[3 * i + 1] = bottom - 1 - u;
+        bottomcap[3 * i + 2] = bottom - 2 - u;
+    }
+}
+
+/*
+ * The strip of a band alternates between the ring above and the ring below. For the caps,
+ * one of them is the pole.
+ */
+void sphereStrip(int segments, std::vector<unsigned int>& strip, unsigned int restart) {
+    const int vsegs = std::max(segments, 2);
+    const int hsegs = vsegs * 2;
+    const unsigned int bottom = static_cast<unsigned int>(1 + (vsegs - 1) * (hsegs + 1));
+    auto ring = [hsegs, vsegs, bottom](int j, int i) {
+        if (j < 0) {
+            return 0u;
+        }
+        return j == vsegs - 1 ? bottom : static_cast<unsigned int>(1 + j * (hsegs + 1) + i);
+    };
+    strip.clear();
+    strip.reserve(static_cast<size_t>(vsegs) * static_cast<size_t>(2 * hsegs + 3));
+    for (int j = 0; j < vsegs; j++) {
+        if (j > 0) {
+            strip.push_back(restart);
+        }
+        for (int i = 0; i <= hsegs; i++) {
+            strip.push_back(ring(j - 1, i));
+            strip.push_back(ring(j, i));
+        }
+    }
+}
+
+/*
+ * The faces are in the order +x, -x, +y, -y, +z, -z, each a grid of (segments + 1)^2 vertices.
+ * A point on a face is found on the cube [-1, 1]^3, and normalized.
+ */
+void cubeSphere(float radius, int segments, std::vector<float>& vertexarray,
+                std::vector<unsigned int>& indexarray) {
+    const int n = std::max(segments, 1);
+    const size_t side = static_cast<size_t>(n) + 1;
+    const size_t facevertices = side * side;
+    const int numvertices = static_cast<int>(6 * facevertices);
+    vertexarray.resize(8 * 6 * facevertices);
+    indexarray.resize(6 * 6 * static_cast<size_t>(n) * static_cast<size_t>(n));
+
+    // Grid lines at equal angles from the centre of the face. The table is mirrored exactly,
+    // so a vertex on the edge between two faces gets the same position on both.
+    std::vector<float> grid(side, 0.0f);
+    for (int i = 0; 2 * i < n; i++) {
+        const double angle = (2.0 * i / n - 1.0) * 0.25 * M_PI;
+        grid[static_cast<size_t>(i)] = static_cast<float>(std::tan(angle));
+        grid[static_cast<size_t>(n - i)] = -grid[static_cast<size_t>(i)];
+    }
+    grid[0] = -1.0f;
+    grid[side - 1] = 1.0f;
+
+    // The axis of each face, its sign, and the axes of the grid, with a x b pointing outwards
+    const int faces[6][4] = {{0, 1, 1, 2}, {0, -1, 2, 1}, {1, 1, 2, 0},
+                             {1, -1, 0, 2}, {2, 1, 0, 1}, {2, -1, 1, 0}};
+    forEach(6, numvertices, [&](int f) {
+        const int* face = faces[f];
+        float* v = vertexarray.data() + 8 * facevertices * static_cast<size_t>(f);
+        for (size_t j = 0; j < side; j++) {
+            for (size_t i = 0; i < side; i++, v += 8) {
+                float p[3];
+                p[face[0]] = static_cast<float>(face[1]);
+                p[face[2]] = grid[i];
+                p[face[3]] = grid[j];
+                const float length = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+                writeVertex(v, radius, p[0] / length, p[1] / length, p[2] / length,
+                            static_cast<float>(i) / static_cast<float>(n),
+                            static_cast<float>(j) / static_cast<float>(n));
+            }
+        }
+
+        // Two triangles per quad, counter-clockwise seen from outside, split along the shorter
+        // diagonal. The quads towards the corners of the face are skewed, and the longer
+        // diagonal would cut deeper into the sphere.
+        const float* normals = vertexarray.data() + 8 * facevertices * static_cast<size_t>(f) + 3;
+        const unsigned int base = static_cast<unsigned int>(facevertices * static_cast<size_t>(f));
+        unsigned int* tri =
+            indexarray.data() + 6 * (side - 1) * (side - 1) * static_cast<size_t>(f);
+        for (size_t j = 0; j < side - 1; j++) {
+            for (size_t i = 0; i < side - 1; i++, tri += 6) {
+                const size_t q00 = j * side + i;
+                const size_t q11 = q00 + side + 1;
+                const unsigned int v00 = base + static_cast<unsigned int>(q00);
+                const unsigned int v10 = v00 + 1;
+                const unsigned int v01 = v00 + static_cast<unsigned int>(side);
+                const unsigned int v11 = v01 + 1;
+                // For unit vectors, the shorter diagonal has the larger dot product
+                const float* n00 = normals + 8 * q00;
+                const float* n10 = normals + 8 * (q00 + 1);
+                const float* n01 = normals + 8 * (q00 + side);
+                const float* n11 = normals + 8 * q11;
+                const float dot0011 = n00[0] * n11[0] + n00[1] * n11[1] + n00[2] * n11[2];
+                const float dot1001 = n10[0] * n01[0] + n10[1] * n01[1] + n10[2] * n01[2];
+                if (dot0011 >= dot1001) {
+                    const unsigned int quad[6] = {v00, v10, v11, v00, v11, v01};
+                    std::copy(quad, quad + 6, tri);
+                } else {
+                    const unsigned int quad[6] = {v00, v10, v01, v10, v11, v01};
+                    std::copy(quad, quad + 6, tri);
+                }
+            }
+        }
+    });
+}
+
+}  // namespace primitives
@@ -0,0 +1,79 @@
+/*
+ * Procedural meshes in the interleaved vertex format used by TriangleSoup, 8 floats per vertex
+ * (x, y, z, nx, ny, nz, s, t), with three indices per triangle.
+ *
+ * Usage: sphere() creates the latitude and longitude sphere of TriangleSoup::createSphere().
+ *        The sines and cosines are computed once per ring and once per column instead of
+ *        once per vertex, each vertex is written with two 4-float SIMD stores, and large
+ *        spheres are split by rings over the shared ThreadPool. The vertices and indices are
+ *        the same, bit for bit, as those of the original one-vertex-at-a-time loop.
+ *
+ *        cubeSphere() projects a subdivided cube onto the sphere instead, with the grid of
+ *        each face spaced by equal angles, so the triangles are all close to the same size.
+ *        The latitude and longitude sphere crowds its triangles at the poles, where they do
+ *        nothing for the silhouette, so the cube sphere needs fewer triangles for the same
+ *        largest distance from the true sphere. Each face has texture coordinates [0, 1]^2
+ *        of its own.
+ *
+ *        sphereStrip() gives the same triangles as triangle strips, one per band of latitude,
+ *        at about a third of the indices.
+ *
+ *        The fixed meshes (the triangle and the box of TriangleSoup) and the unit spheres of
+ *        sphere() for a few common segment counts are also available as tables, which are
+ *        generated by constexpr functions while compiling and stored in the read-only data
+ *        of the program. The sines and cosines of the sphere tables are evaluated by a
+ *        constexpr series, which rounds to the same floats as std::sin() and std::cos() for
+ *        all the angles used, so a table is the same as the output of sphere().
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <vector>
+
+namespace primitives {
+
+// A mesh in read-only memory, in the same format as the arrays
+struct Table {
+    const float* vertices;
+    int numvertices;
+    const unsigned int* indices;
+    int numindices;
+};
+
+/* The single triangle of TriangleSoup::createTriangle() */
+const Table& triangleTable();
+
+/* The box of TriangleSoup::createBox(), from -1 to 1 along each axis */
+const Table& boxTable();
+
+/* The unit sphere of sphere() for 'segments', if it is one of the precomputed counts (6, 8, 16
+   and 32). Returns nullptr for other counts. */
+const Table* sphereTable(int segments);
+
+/* Copy a table to arrays, with the positions multiplied by 'scale' (x, y, z) */
+void copyTable(const Table& table, const float* scale, std::vector<float>& vertexarray,
+               std::vector<unsigned int>& indexarray);
+
+/*
+ * A sphere of 'segments' bands of latitude (at least 2) and twice as many of longitude,
+ * centred at the origin with +z up. The seam at s = 0 and s = 1 has a copy of each vertex.
+ */
+void sphere(float radius, int segments, std::vector<float>& vertexarray,
+            std::vector<unsigned int>& indexarray);
+
+/*
+ * Triangle strips for the triangles of sphere() and the sphere tables with 'segments', with
+ * 'restart' between them. Each band between two rings is one strip, and so is each cap, as a
+ * band to the pole repeated, with every other triangle degenerate.
+ */
+void sphereStrip(int segments, std::vector<unsigned int>& strip, unsigned int restart = ~0u);
+
+/*
+ * A cube sphere with a grid of 'segments' by 'segments' quads on each of the six faces (at
+ * least 1). The edges of the faces have a copy of each vertex, in the same position.
+ */
+void cubeSphere(float radius, int segments, std::vector<float>& vertexarray,
+                std::vector<unsigned int>& indexarray);
+
+}  // namespace primitives
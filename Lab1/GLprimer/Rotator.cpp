@@ -14,6 +14,55 @@
 #include <GLFW/glfw3.h>
 #include <cmath>
 
+namespace {
+
+// Invert the 4 x 4 matrix 'm' by cofactors. Returns false if it is singular.
+bool invert(const double* m, double* inverse) {
+    double c[16];
+    c[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] +
+           m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+    c[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] -
+           m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+    c[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] +
+           m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+    c[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] -
+            m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+    c[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] -
+           m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+    c[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] +
+           m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+    c[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] -
+           m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+    c[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] +
+            m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+    c[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] +
+           m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+    c[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] -
+           m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+    c[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] +
+            m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+    c[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] -
+            m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+    c[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] -
+           m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+    c[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] +
+           m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+    c[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] -
+            m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+    c[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] +
+            m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+    const double det = m[0] * c[0] + m[1] * c[4] + m[2] * c[8] + m[3] * c[12];
+    if (det == 0.0) {
+        return false;
+    }
+    for (int i = 0; i < 16; i++) {
+        inverse[i] = c[i] / det;
+    }
+    return true;
+}
+
+}  // namespace
+
 KeyRotator::KeyRotator(GLFWwindow* window)
     : window_(window), phi_(0.0), theta_(0.0), lastTime_(glfwGetTime()) {}
 
@@ -101,3 +150,53 @@ void MouseRotator::poll() {
 double MouseRotator::phi() const { return phi_; }
 
 double MouseRotator::theta() const { return theta_; }
+
+bool MouseRotator::cursorRay(const float* mvp, float* origin, float* direction) const {
+    double x;
+    double y;
+    glfwGetCursorPos(window_, &x, &y);
+    int windowWidth;
+    int windowHeight;
+    glfwGetWindowSize(window_, &windowWidth, &windowHeight);
+    if (windowWidth <= 0 || windowHeight <= 0) {
+        return false;
+    }
+
+    // Normalized device coordinates: the cursor is in screen coordinates from the top left
+    // corner of the window, already a continuous position rather than a pixel index
+    const double ndcX = 2.0 * x / windowWidth - 1.0;
+    const double ndcY = 1.0 - 2.0 * y / windowHeight;
+
+    double m[16];
+    double inverse[16];
+    for (int i = 0; i < 16; i++) {
+        m[i] = mvp[i];
+    }
+    if (!invert(m, inverse)) {
+        return false;
+    }
+
+    // Map the points on the near (z = -1) and far (z = 1) planes back, column major
+    double points[2][3];
+    for (int p = 0; p < 2; p++) {
+        const double clip[4] = {ndcX, ndcY, p == 0 ? -1.0 : 1.0, 1.0};
+        double result[4];
+        for (int row = 0; row < 4; row++) {
+            result[row] = 0.0;
+            for (int col = 0; col < 4; col++) {
+                result[row] += inverse[4 * col + row] * clip[col];
+            }
+        }
+        if (result[3] == 0.0) {
+            return false;
+        }
+        for (int c = 0; c < 3; c++) {
+            points[p][c] = result[c] / result[3];
+        }
+    }
+    for (int c = 0; c < 3; c++) {
+        origin[c] = static_cast<float>(points[0][c]);
+        direction[c] = static_cast<float>(points[1][c] - points[0][c]);
+    }
+    return true;
+}
@@ -5,6 +5,8 @@
  * Usage: call init() before the rendering loop, call poll() once per frame,
  * read public members phi and theta to construct a rotation matrix.
  * The suggested composite rotation matrix is RotX(theta)*RotY(phi).
+ * MouseRotator::cursorRay() gives the ray through the mouse pointer, to pick
+ * objects with, for example TriangleSoup::pick().
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2015
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -39,6 +41,11 @@ public:
     double phi() const;
     double theta() const;
 
+    /* Compute the ray through the mouse pointer, in the coordinates that the column major
+       matrix 'mvp' maps to clip space. 'origin' is on the near plane, and 'direction' reaches
+       the far plane. Returns false if the matrix can not be inverted. */
+    bool cursorRay(const float* mvp, float* origin, float* direction) const;
+
 private:
     GLFWwindow* window_;
 
@@ -12,11 +12,13 @@
 #include "Shader.hpp"
 
 #include <iostream>
+#include <utility>
 #include <fstream>
 
 Shader::Shader() : programID_(0) {}
 
-Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile) {
+Shader::Shader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile)
+    : programID_(0) {
     createShader(vertexshaderfile, fragmentshaderfile);
 }
 
@@ -26,6 +28,18 @@ Shader::~Shader() {
     }
 }
 
+Shader::Shader(Shader&& other) noexcept : programID_(std::exchange(other.programID_, 0)) {}
+
+Shader& Shader::operator=(Shader&& other) noexcept {
+    if (this != &other) {
+        if (programID_ != 0) {
+            glDeleteProgram(programID_);
+        }
+        programID_ = std::exchange(other.programID_, 0);
+    }
+    return *this;
+}
+
 GLuint Shader::id() const { return programID_; }
 
 std::string readFile(const std::string& filename) {
@@ -26,6 +26,14 @@ public:
     // Destructor
     ~Shader();
 
+    // Move constructor and assignment: the program changes owner, and 'other' is left
+    // invalid. Copies are deleted, since both would delete the same program.
+    Shader(Shader&& other) noexcept;
+    Shader& operator=(Shader&& other) noexcept;
+
+    Shader(const Shader&) = delete;
+    Shader& operator=(const Shader&) = delete;
+
     // createShader() - create, load, compile and link the GLSL shader objects.
     void createShader(const std::string& vertexshaderfile, const std::string& fragmentshaderfile);
 
@@ -0,0 +1,338 @@
+/*
+ * A draw call stress test: a grid of many small spheres, each a TriangleSoup of its own in the
+ * shared GeometryArena, drawn either with one TriangleSoup::render() call per sphere or all
+ * at once by a BatchRenderer. For comparison, the same grid can also be drawn as instances of
+ * a single sphere with TriangleSoup::renderInstanced(), with the instance data (spinning
+ * spheres) streamed to the GPU every frame. That sphere is the shared unit sphere of the
+ * PrimitiveCache, with the size in the instance scale. Or the instances can be procedural
+ * spheres, with no geometry in memory, and more segments the further up the grid they are.
+ *
+ * Usage: tnm046-stress [number of spheres]
+ *        The default is 10000 spheres. Run it from the source directory, like the lab
+ *        executable, so the shaders are found. Keys:
+ *          M - cycle between TriangleSoup::render() per sphere, the BatchRenderer,
+ *              renderInstanced() and renderInstanced() of a procedural sphere
+ *          I - switch the BatchRenderer between glMultiDrawElementsIndirect() and
+ *              glMultiDrawElementsBaseVertex()
+ *          Z - zoom in and out over the grid, so that most spheres leave the view
+ *          C - skip the spheres outside the view with a FrustumCuller (not for instances)
+ *          R - cycle the residency of the sphere arrays between positions only, discard and
+ *              keep (arrays that are already dropped stay dropped), and print the memory
+ *              held by all meshes
+ *        A left click prints the sphere and the triangle under the mouse pointer, found with
+ *        MouseRotator::cursorRay() and TriangleSoup::pick().
+ *        The window title shows the frame time, and the CPU time spent submitting the draws
+ *        is printed every second.
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "BatchRenderer.hpp"
+#include "Bvh.hpp"
+#include "FrustumCuller.hpp"
+#include "GeometryArena.hpp"
+#include "InstanceBuffer.hpp"
+#include "PrimitiveCache.hpp"
+#include "Rotator.hpp"
+#include "Shader.hpp"
+#include "TriangleSoup.hpp"
+#include "Utilities.hpp"
+
+namespace {
+
+enum class Mode { PerMesh, Batched, Instanced, Procedural };
+
+// A key press, not counting the frames while it is held down
+bool keyPressed(GLFWwindow* window, int key, bool& wasdown) {
+    const bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    const bool pressed = down && !wasdown;
+    wasdown = down;
+    return pressed;
+}
+
+/* Find the sphere under the mouse pointer in the view of 'transform', and print the hit */
+void pickSphere(const MouseRotator& rotator, const GLfloat* transform,
+                std::vector<TriangleSoup>& spheres) {
+    float origin[3];
+    float direction[3];
+    if (!rotator.cursorRay(transform, origin, direction)) {
+        return;
+    }
+    const double starttime = glfwGetTime();
+    const float length2 =
+        direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+    RayHit nearest = {0, 0.0f, 0.0f, 0.0f};
+    int picked = -1;
+    for (size_t i = 0; i < spheres.size(); i++) {
+        // Only the spheres whose bounding sphere the ray passes through are tested
+        const GLfloat* center = spheres[i].sphereCenter();
+        const float radius = spheres[i].sphereRadius();
+        const float oc[3] = {center[0] - origin[0], center[1] - origin[1], center[2] - origin[2]};
+        const float t = (oc[0] * direction[0] + oc[1] * direction[1] + oc[2] * direction[2]) /
+                        length2;
+        const float d[3] = {oc[0] - t * direction[0], oc[1] - t * direction[1],
+                            oc[2] - t * direction[2]};
+        if (d[0] * d[0] + d[1] * d[1] + d[2] * d[2] > radius * radius) {
+            continue;
+        }
+        RayHit hit;
+        if (spheres[i].pick(origin, direction, hit) &&
+            (picked < 0 || hit.distance < nearest.distance)) {
+            nearest = hit;
+            picked = static_cast<int>(i);
+        }
+    }
+    const double picktime = 1000.0 * (glfwGetTime() - starttime);
+    if (picked < 0) {
+        printf("Nothing under the pointer (%.3f ms)\n", picktime);
+        return;
+    }
+    printf("Sphere %d, triangle %u at (%.3f, %.3f, %.3f), barycentric (%.2f, %.2f) (%.3f ms)\n",
+           picked, nearest.triangle, origin[0] + nearest.distance * direction[0],
+           origin[1] + nearest.distance * direction[1],
+           origin[2] + nearest.distance * direction[2], nearest.u, nearest.v, picktime);
+}
+
+/* Create the spheres and draw them until the window is closed */
+void run(GLFWwindow* window, int numspheres) {
+    // Spheres on a square grid that fills the window, in clip coordinates
+    const int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(numspheres))));
+    const float spacing = 2.0f / static_cast<float>(side);
+    // The spheres are stored by value, and moved into place
+    std::vector<TriangleSoup> spheres;
+    spheres.reserve(static_cast<size_t>(numspheres));
+    const double starttime = glfwGetTime();
+    for (int i = 0; i < numspheres; i++) {
+        TriangleSoup sphere;
+        sphere.setUseArena(true);
+        sphere.createSphere(0.4f * spacing, 6);
+        sphere.translate(-1.0f + spacing * (static_cast<float>(i % side) + 0.5f),
+                         -1.0f + spacing * (static_cast<float>(i / side) + 0.5f), 0.0f);
+        spheres.push_back(std::move(sphere));
+    }
+    printf("Created %d spheres in %.0f ms\n", numspheres, 1000.0 * (glfwGetTime() - starttime));
+    GeometryArena::get(VertexFormat())->printStats();
+
+    // The shared unit sphere for the instances, scaled per instance
+    PrimitiveCache::Handle instancesphere = PrimitiveCache::get(PrimitiveCache::Shape::Sphere, 6);
+    PrimitiveCache::printStats();
+    TriangleSoup proceduralsphere;
+    proceduralsphere.createProceduralSphere(1.0f, 6);
+    InstanceBuffer instancebuffer(true);
+    std::vector<InstanceBuffer::Instance> instances(static_cast<size_t>(numspheres));
+
+    Shader shader("meshvertex.glsl", "fragment.glsl");
+    Shader instanceshader("instancevertex.glsl", "fragment.glsl");
+    Shader sphereshader("spherevertex.glsl", "fragment.glsl");
+    BatchRenderer batch;
+    FrustumCuller culler;
+    std::vector<TriangleSoup*> meshes;
+    for (TriangleSoup& sphere : spheres) {
+        meshes.push_back(&sphere);
+    }
+    culler.setMeshes(meshes);
+    Mode mode = Mode::Batched;
+    bool zoom = false;
+    bool cull = false;
+    bool mdown = false;
+    bool idown = false;
+    bool zdown = false;
+    bool cdown = false;
+    bool rdown = false;
+    bool clickdown = false;
+    MouseRotator rotator(window);
+    double submittime = 0.0;
+    int frames = 0;
+    double lastreport = glfwGetTime();
+
+    glfwSwapInterval(0);  // Do not wait for screen refresh between frames
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+
+    while (!glfwWindowShouldClose(window)) {
+        util::displayFPS(window);
+        int width, height;
+        glfwGetWindowSize(window, &width, &height);
+        glViewport(0, 0, width, height);
+        glClearColor(0.3f, 0.3f, 0.3f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        // A view that zooms in up to 5 times on a point moving over the grid
+        const double t0 = glfwGetTime();
+        GLfloat transform[16] = {1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+                                 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+        if (zoom) {
+            const float scale = 3.0f - 2.0f * static_cast<float>(std::cos(0.5 * t0));
+            transform[0] = scale;
+            transform[5] = scale;
+            transform[12] = -scale * 0.5f * static_cast<float>(std::sin(0.3 * t0));
+            transform[13] = -scale * 0.5f * static_cast<float>(std::cos(0.2 * t0));
+        }
+
+        // Time only the culling and the submission. The GPU works on it in parallel.
+        const bool instanced = mode == Mode::Instanced || mode == Mode::Procedural;
+        if (!instanced && cull) {
+            culler.cull(transform);
+        }
+        if (mode == Mode::Batched) {
+            glUseProgram(shader.id());
+            glUniformMatrix4fv(glGetUniformLocation(shader.id(), "transform"), 1, GL_FALSE,
+                               transform);
+            for (size_t i = 0; i < spheres.size(); i++) {
+                if (!cull || culler.isVisible(i)) {
+                    batch.add(spheres[i]);
+                }
+            }
+            batch.render();
+        } else if (mode == Mode::PerMesh) {
+            glUseProgram(shader.id());
+            glUniformMatrix4fv(glGetUniformLocation(shader.id(), "transform"), 1, GL_FALSE,
+                               transform);
+            if (cull) {
+                culler.render();
+            } else {
+                for (TriangleSoup& sphere : spheres) {
+                    sphere.render();
+                }
+            }
+        } else {
+            // Spin each sphere about the y axis, with a different phase
+            const float time = static_cast<float>(t0);
+            for (int i = 0; i < numspheres; i++) {
+                InstanceBuffer::Instance& instance = instances[static_cast<size_t>(i)];
+                const int column = i % side;
+                const int row = i / side;
+                const float angle = time + 0.1f * static_cast<float>(i);
+                instance.position[0] = -1.0f + spacing * (static_cast<float>(column) + 0.5f);
+                instance.position[1] = -1.0f + spacing * (static_cast<float>(row) + 0.5f);
+                instance.scale = 0.4f * spacing;
+                instance.rotation[1] = std::sin(0.5f * angle);
+                instance.rotation[3] = std::cos(0.5f * angle);
+                instance.color[0] = static_cast<GLubyte>(255 * column / side);
+                instance.color[2] = static_cast<GLubyte>(255 * row / side);
+                instance.segments = static_cast<GLuint>(2 + 8 * row / side);
+            }
+            instancebuffer.update(instances);
+            if (mode == Mode::Instanced) {
+                glUseProgram(instanceshader.id());
+                glUniformMatrix4fv(glGetUniformLocation(instanceshader.id(), "transform"), 1,
+                                   GL_FALSE, transform);
+                instancesphere->renderInstanced(numspheres, instancebuffer);
+            } else {
+                glUseProgram(sphereshader.id());
+                glUniformMatrix4fv(glGetUniformLocation(sphereshader.id(), "transform"), 1,
+                                   GL_FALSE, transform);
+                proceduralsphere.setDecodeUniforms(sphereshader.id());
+                proceduralsphere.renderInstanced(numspheres, instancebuffer);
+            }
+        }
+        submittime += glfwGetTime() - t0;
+        frames++;
+
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+
+        if (glfwGetTime() - lastreport >= 1.0) {
+            if (mode == Mode::Batched) {
+                printf("%s: %d draws in %d calls, %.3f ms CPU per frame\n",
+                       batch.usesIndirect() ? "glMultiDrawElementsIndirect"
+                                            : "glMultiDrawElementsBaseVertex",
+                       batch.drawCount(), batch.callCount(), 1000.0 * submittime / frames);
+            } else if (mode == Mode::PerMesh) {
+                printf("TriangleSoup::render(): %d calls, %.3f ms CPU per frame\n",
+                       cull ? culler.visibleCount() : numspheres, 1000.0 * submittime / frames);
+            } else {
+                printf("TriangleSoup::renderInstanced()%s: %d instances, %.3f ms CPU per frame\n",
+                       mode == Mode::Procedural ? " of a procedural sphere" : "", numspheres,
+                       1000.0 * submittime / frames);
+            }
+            if (!instanced && cull) {
+                printf("  frustum culling: %d visible, %d culled\n", culler.visibleCount(),
+                       culler.culledCount());
+            }
+            submittime = 0.0;
+            frames = 0;
+            lastreport = glfwGetTime();
+        }
+
+        if (keyPressed(window, GLFW_KEY_M, mdown)) {
+            mode = mode == Mode::PerMesh     ? Mode::Batched
+                   : mode == Mode::Batched   ? Mode::Instanced
+                   : mode == Mode::Instanced ? Mode::Procedural
+                                             : Mode::PerMesh;
+        }
+        if (keyPressed(window, GLFW_KEY_I, idown)) {
+            batch.setUseIndirect(!batch.usesIndirect());
+        }
+        if (keyPressed(window, GLFW_KEY_Z, zdown)) {
+            zoom = !zoom;
+        }
+        if (keyPressed(window, GLFW_KEY_C, cdown)) {
+            cull = !cull;
+        }
+        if (keyPressed(window, GLFW_KEY_R, rdown)) {
+            using Residency = TriangleSoup::Residency;
+            const Residency residency = spheres[0].residency();
+            const Residency next = residency == Residency::Keep        ? Residency::Positions
+                                   : residency == Residency::Positions ? Residency::Discard
+                                                                       : Residency::Keep;
+            for (TriangleSoup& sphere : spheres) {
+                sphere.setResidency(next);
+            }
+            TriangleSoup::printMemoryReport();
+        }
+        const bool click = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+        if (click && !clickdown) {
+            pickSphere(rotator, transform, spheres);
+        }
+        clickdown = click;
+        if (glfwGetKey(window, GLFW_KEY_ESCAPE)) {
+            glfwSetWindowShouldClose(window, GL_TRUE);
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    const int numspheres = argc > 1 ? std::max(std::atoi(argv[1]), 1) : 10000;
+
+    glfwInit();
+    const GLFWvidmode* vidmode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    GLFWwindow* window = glfwCreateWindow(vidmode->height / 2, vidmode->height / 2,
+                                          "Draw call stress test", nullptr, nullptr);
+    if (!window) {
+        std::cout << "Unable to open window. Terminating.\n";
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    GLenum err = glewInit();
+    if (GLEW_OK != err) {
+        std::cerr << "Error: " << glewGetErrorString(err) << "\n";
+        glfwTerminate();
+        return -1;
+    }
+    std::cout << "GL renderer:     " << glGetString(GL_RENDERER)
+              << "\nGL version:      " << glGetString(GL_VERSION) << "\n";
+
+    // All meshes, and with them the arenas, are deleted when run() returns
+    run(window, numspheres);
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
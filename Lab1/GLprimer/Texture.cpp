@@ -12,6 +12,7 @@
 #include <fstream>
 #include <algorithm>
 #include <array>
+#include <utility>
 
 #include <GL/glew.h>
 
@@ -27,6 +28,21 @@ Texture::~Texture() {
     }
 }
 
+Texture::Texture(Texture&& other) noexcept
+    : textureID_(std::exchange(other.textureID_, 0)),
+      image_(std::exchange(other.image_, ImageData())) {}
+
+Texture& Texture::operator=(Texture&& other) noexcept {
+    if (this != &other) {
+        if (textureID_ != 0) {
+            glDeleteTextures(1, &textureID_);
+        }
+        textureID_ = std::exchange(other.textureID_, 0);
+        image_ = std::exchange(other.image_, ImageData());
+    }
+    return *this;
+}
+
 GLuint Texture::id() const { return textureID_; }
 
 GLuint Texture::width() const { return image_.width; }
@@ -27,6 +27,15 @@ public:
     /* Destructor */
     ~Texture();
 
+    /* Move constructor and assignment: the texture and the image data change owner, and
+       'other' is left without a texture. Copies are deleted, since both would delete the
+       same texture. */
+    Texture(Texture&& other) noexcept;
+    Texture& operator=(Texture&& other) noexcept;
+
+    Texture(const Texture&) = delete;
+    Texture& operator=(const Texture&) = delete;
+
     // The external entry point for loading a texture from a TGA file
     void createTexture(const std::string& filename);  // Load GL texture from file
 
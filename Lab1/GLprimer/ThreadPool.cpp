@@ -0,0 +1,106 @@
+/*
+ * A small pool of worker threads
+ *
+ * This code is in the public domain.
+ */
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+/* Constructor: start a number of worker threads (0 means one per hardware thread) */
+ThreadPool::ThreadPool(int threads) : stop_(false) {
+    if (threads <= 0) {
+        threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    }
+    for (int i = 0; i < threads; i++) {
+        workers_.emplace_back([this]() { work(); });
+    }
+}
+
+/* Destructor: finish the queued tasks and join the worker threads */
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wakeup_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+int ThreadPool::size() const { return static_cast<int>(workers_.size()); }
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& task) {
+    if (count <= 0) {
+        return;
+    }
+    if (count == 1) {
+        task(0);
+        return;
+    }
+
+    // Items are handed out from a shared counter. The helpers queued on the pool and the
+    // calling thread all grab items until none are left, so a busy pool only means that
+    // the calling thread does more of the work itself.
+    struct State {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto state = std::make_shared<State>();
+
+    auto run = [state, count, &task]() {
+        int item;
+        while ((item = state->next.fetch_add(1)) < count) {
+            task(item);
+            if (state->done.fetch_add(1) + 1 == count) {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                state->finished.notify_all();
+            }
+        }
+    };
+
+    const int helpers = std::min(count - 1, size());
+    for (int i = 0; i < helpers; i++) {
+        enqueue(run);
+    }
+    run();
+
+    // Wait for the items that were picked up by the helpers
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state, count]() { return state->done.load() == count; });
+}
+
+/* A pool shared by the whole program, created on first use */
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::enqueue(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    wakeup_.notify_one();
+}
+
+void ThreadPool::work() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wakeup_.wait(lock, [this]() { return stop_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;  // stop_ is set and there is nothing left to do
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,49 @@
+/*
+ * A small pool of worker threads for splitting CPU work over several cores.
+ *
+ * Usage: Call parallelFor() with a number of work items and a function taking the item index.
+ *        The call returns when all items are done. The calling thread takes part in the work,
+ *        so it is safe to call parallelFor() from inside a task running on the pool.
+ *        ThreadPool::instance() returns a shared pool with one thread per hardware thread.
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    /* Constructor: start a number of worker threads (0 means one per hardware thread) */
+    ThreadPool(int threads = 0);
+
+    /* Destructor: finish the queued tasks and join the worker threads */
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // returns the number of worker threads
+    int size() const;
+
+    /* Run task(0) ... task(count - 1) on the pool and wait for all of them to finish */
+    void parallelFor(int count, const std::function<void(int)>& task);
+
+    /* A pool shared by the whole program, created on first use */
+    static ThreadPool& instance();
+
+private:
+    void enqueue(std::function<void()> task);
+    void work();
+
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable wakeup_;
+    bool stop_;
+};
@@ -16,70 +16,458 @@
 #include <cstdio>
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <utility>
 
 #include "TriangleSoup.hpp"
+#include "Bvh.hpp"
+#include "GeometryArena.hpp"
+#include "InstanceBuffer.hpp"
+#include "MappedFile.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "ObjReader.hpp"
+#include "Primitives.hpp"
+
+namespace {
+
+/* Free the memory of a vector, which clear() keeps */
+template <typename T>
+void release(std::vector<T>& v) {
+    std::vector<T>().swap(v);
+}
+
+/*
+ * Convert indices to 16 bits. The triangles are split into consecutive ranges whose indices
+ * span less than 65536 vertices, and each range is stored relative to its lowest vertex, to be
+ * drawn with that as the base vertex. A range also starts at each index in 'breaks' (sorted),
+ * so the levels of detail get ranges of their own. Returns false if a single triangle spans
+ * too far.
+ */
+bool splitIndices(const GLuint* indexdata, int numindices, const std::vector<GLsizei>& breaks,
+                  std::vector<GLushort>& shortindices,
+                  std::vector<TriangleSoup::IndexRange>& ranges) {
+    const GLuint maxspan = 65535;
+    shortindices.resize(static_cast<size_t>(numindices));
+    ranges.clear();
+    int first = 0;
+    GLuint lo = ~0u;
+    GLuint hi = 0;
+    auto nextbreak = breaks.begin();
+    for (int i = 0; i < numindices; i += 3) {
+        const GLuint* tri = indexdata + i;
+        const GLuint trilo = std::min({tri[0], tri[1], tri[2]});
+        const GLuint trihi = std::max({tri[0], tri[1], tri[2]});
+        if (trihi - trilo > maxspan) {
+            return false;
+        }
+        while (nextbreak != breaks.end() && *nextbreak < i) {
+            ++nextbreak;
+        }
+        const bool isbreak = nextbreak != breaks.end() && *nextbreak == i;
+        if (i > first && (isbreak || std::max(hi, trihi) - std::min(lo, trilo) > maxspan)) {
+            ranges.push_back({first, i - first, static_cast<GLint>(lo)});
+            first = i;
+            lo = ~0u;
+            hi = 0;
+        }
+        lo = std::min(lo, trilo);
+        hi = std::max(hi, trihi);
+    }
+    if (numindices > first) {
+        ranges.push_back({first, numindices - first, static_cast<GLint>(lo)});
+    }
+    for (const TriangleSoup::IndexRange& range : ranges) {
+        for (int i = range.first; i < range.first + range.count; i++) {
+            shortindices[static_cast<size_t>(i)] =
+                static_cast<GLushort>(indexdata[i] - static_cast<GLuint>(range.basevertex));
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+// All live meshes, for printMemoryReport()
+TriangleSoup* TriangleSoup::firstmesh_ = nullptr;
+
+// A mesh loaded from an OBJ file or its cache file, but not yet sent to OpenGL
+struct TriangleSoup::ObjData {
+    std::vector<GLfloat> vertexarray;
+    std::vector<GLuint> indexarray;
+    MeshCache cache;  // Holds the data instead of the arrays if 'cached' is set
+    bool cached = false;
+};
 
 /* Constructor: initialize a TriangleSoup object to an empty object */
-TriangleSoup::TriangleSoup() : vao_(0), vertexbuffer_(0), indexbuffer_(0), nverts_(0), ntris_(0) {}
+TriangleSoup::TriangleSoup()
+    : vao_(0),
+      nverts_(0),
+      ntris_(0),
+      nrawverts_(0),
+      vertexbuffer_(0),
+      indexbuffer_(0),
+      streamtime_(0),
+      countfragments_(false),
+      fragmentquery_(0),
+      querypending_(false),
+      fragments_(0),
+      indextype_(GL_UNSIGNED_INT),
+      usestrips_(false),
+      mode_(GL_TRIANGLES),
+      nstripindices_(0),
+      proceduralsegments_(0),
+      usearena_(false),
+      arenablock_(-1),
+      lod_(0),
+      boundsmin_{0.0f, 0.0f, 0.0f},
+      boundsmax_{0.0f, 0.0f, 0.0f},
+      center_{0.0f, 0.0f, 0.0f},
+      radius_(0.0f),
+      meshletculling_(false),
+      residency_(Residency::Keep),
+      sourceloader_(Loader::Parallel),
+      sourceoptimizations_(0),
+      sourcetable_(nullptr),
+      sourcescale_{1.0f, 1.0f, 1.0f} {
+    link();
+}
 
 /* Destructor: clean up allocated data in a TriangleSoup object */
-TriangleSoup::~TriangleSoup() { clean(); }
+TriangleSoup::~TriangleSoup() {
+    clean();
+    unlink();
+}
+
+/*
+ * Move constructor: take over the GL objects, the arrays and the settings, and leave 'other'
+ * with no geometry and no GL objects, so its destructor makes no GL calls. Nothing here
+ * allocates, not even the entry in the list of all meshes.
+ */
+TriangleSoup::TriangleSoup(TriangleSoup&& other) noexcept
+    : vao_(std::exchange(other.vao_, 0)),
+      nverts_(std::exchange(other.nverts_, 0)),
+      ntris_(std::exchange(other.ntris_, 0)),
+      nrawverts_(std::exchange(other.nrawverts_, 0)),
+      vertexbuffer_(std::exchange(other.vertexbuffer_, 0)),
+      indexbuffer_(std::exchange(other.indexbuffer_, 0)),
+      vertexarray_(std::move(other.vertexarray_)),
+      indexarray_(std::move(other.indexarray_)),
+      stream_(std::move(other.stream_)),
+      streamfilename_(std::move(other.streamfilename_)),
+      streamtime_(std::exchange(other.streamtime_, 0)),
+      pending_(std::move(other.pending_)),
+      pendingdata_(std::move(other.pendingdata_)),
+      countfragments_(other.countfragments_),
+      fragmentquery_(std::exchange(other.fragmentquery_, 0)),
+      querypending_(std::exchange(other.querypending_, false)),
+      fragments_(std::exchange(other.fragments_, 0)),
+      format_(other.format_),
+      layout_(std::exchange(other.layout_, VertexFormat())),
+      decode_(std::exchange(other.decode_, VertexDecode())),
+      indextype_(std::exchange(other.indextype_, GLenum(GL_UNSIGNED_INT))),
+      ranges_(std::move(other.ranges_)),
+      usestrips_(other.usestrips_),
+      mode_(std::exchange(other.mode_, GLenum(GL_TRIANGLES))),
+      nstripindices_(std::exchange(other.nstripindices_, 0)),
+      proceduralsegments_(std::exchange(other.proceduralsegments_, 0)),
+      usearena_(other.usearena_),
+      arena_(std::move(other.arena_)),
+      arenablock_(std::exchange(other.arenablock_, -1)),
+      lods_(std::move(other.lods_)),
+      lod_(std::exchange(other.lod_, 0)),
+      boundsmin_{other.boundsmin_[0], other.boundsmin_[1], other.boundsmin_[2]},
+      boundsmax_{other.boundsmax_[0], other.boundsmax_[1], other.boundsmax_[2]},
+      center_{other.center_[0], other.center_[1], other.center_[2]},
+      radius_(std::exchange(other.radius_, 0.0f)),
+      meshlets_(std::move(other.meshlets_)),
+      meshletvisible_(std::move(other.meshletvisible_)),
+      meshletculling_(std::exchange(other.meshletculling_, false)),
+      meshletcounts_(std::move(other.meshletcounts_)),
+      meshletoffsets_(std::move(other.meshletoffsets_)),
+      meshletbasevertices_(std::move(other.meshletbasevertices_)),
+      bvh_(std::move(other.bvh_)),
+      residency_(other.residency_),
+      positions_(std::move(other.positions_)),
+      sourcefile_(std::move(other.sourcefile_)),
+      sourceloader_(other.sourceloader_),
+      sourceoptimizations_(other.sourceoptimizations_),
+      sourcetable_(std::exchange(other.sourcetable_, nullptr)),
+      sourcescale_{other.sourcescale_[0], other.sourcescale_[1], other.sourcescale_[2]} {
+    // A moved-from string is only valid, not necessarily empty
+    other.streamfilename_.clear();
+    other.sourcefile_.clear();
+    for (int c = 0; c < 3; c++) {
+        other.boundsmin_[c] = 0.0f;
+        other.boundsmax_[c] = 0.0f;
+        other.center_[c] = 0.0f;
+    }
+    link();
+}
+
+/*
+ * Move assignment: delete our own content first, so 'other' is left empty. Like clean(), this
+ * waits for our own pending load to finish, if any.
+ */
+TriangleSoup& TriangleSoup::operator=(TriangleSoup&& other) {
+    if (this != &other) {
+        clean();
+        swap(other);
+    }
+    return *this;
+}
+
+/*
+ * Exchange all members, except the links of the list of all meshes, which stay with the
+ * objects. A pending asynchronous load only refers to its ObjData, never to the
+ * object, so it can change owner too.
+ */
+void TriangleSoup::swap(TriangleSoup& other) noexcept {
+    using std::swap;
+    swap(vao_, other.vao_);
+    swap(nverts_, other.nverts_);
+    swap(ntris_, other.ntris_);
+    swap(nrawverts_, other.nrawverts_);
+    swap(vertexbuffer_, other.vertexbuffer_);
+    swap(indexbuffer_, other.indexbuffer_);
+    swap(vertexarray_, other.vertexarray_);
+    swap(indexarray_, other.indexarray_);
+    swap(stream_, other.stream_);
+    swap(streamfilename_, other.streamfilename_);
+    swap(streamtime_, other.streamtime_);
+    swap(pending_, other.pending_);
+    swap(pendingdata_, other.pendingdata_);
+    swap(countfragments_, other.countfragments_);
+    swap(fragmentquery_, other.fragmentquery_);
+    swap(querypending_, other.querypending_);
+    swap(fragments_, other.fragments_);
+    swap(format_, other.format_);
+    swap(layout_, other.layout_);
+    swap(decode_, other.decode_);
+    swap(indextype_, other.indextype_);
+    swap(ranges_, other.ranges_);
+    swap(usestrips_, other.usestrips_);
+    swap(mode_, other.mode_);
+    swap(nstripindices_, other.nstripindices_);
+    swap(proceduralsegments_, other.proceduralsegments_);
+    swap(usearena_, other.usearena_);
+    swap(arena_, other.arena_);
+    swap(arenablock_, other.arenablock_);
+    swap(lods_, other.lods_);
+    swap(lod_, other.lod_);
+    swap(boundsmin_, other.boundsmin_);
+    swap(boundsmax_, other.boundsmax_);
+    swap(center_, other.center_);
+    swap(radius_, other.radius_);
+    swap(meshlets_, other.meshlets_);
+    swap(meshletvisible_, other.meshletvisible_);
+    swap(meshletculling_, other.meshletculling_);
+    swap(meshletcounts_, other.meshletcounts_);
+    swap(meshletoffsets_, other.meshletoffsets_);
+    swap(meshletbasevertices_, other.meshletbasevertices_);
+    swap(bvh_, other.bvh_);
+    swap(residency_, other.residency_);
+    swap(positions_, other.positions_);
+    swap(sourcefile_, other.sourcefile_);
+    swap(sourceloader_, other.sourceloader_);
+    swap(sourceoptimizations_, other.sourceoptimizations_);
+    swap(sourcetable_, other.sourcetable_);
+    swap(sourcescale_, other.sourcescale_);
+}
+
+/* Add this object to the list of all meshes, for printMemoryReport() */
+void TriangleSoup::link() noexcept {
+    prevmesh_ = nullptr;
+    nextmesh_ = firstmesh_;
+    if (firstmesh_) {
+        firstmesh_->prevmesh_ = this;
+    }
+    firstmesh_ = this;
+}
+
+void TriangleSoup::unlink() noexcept {
+    (prevmesh_ ? prevmesh_->nextmesh_ : firstmesh_) = nextmesh_;
+    if (nextmesh_) {
+        nextmesh_->prevmesh_ = prevmesh_;
+    }
+}
 
 /* Clean up, remembering to de-allocate arrays and GL resources */
 void TriangleSoup::clean() {
-    if (glIsVertexArray(vao_)) {
+    // Wait for a pending load to finish, and throw away its result
+    if (pending_.valid()) {
+        pending_.wait();
+        pending_ = std::shared_future<bool>();
+        pendingdata_.reset();
+    }
+
+    deleteBuffers();
+
+    if (fragmentquery_ != 0) {
+        glDeleteQueries(1, &fragmentquery_);
+        fragmentquery_ = 0;
+    }
+    querypending_ = false;
+    fragments_ = 0;
+
+    vertexarray_.clear();
+    indexarray_.clear();
+    nverts_ = 0;
+    ntris_ = 0;
+    nrawverts_ = 0;
+    lods_.clear();
+    lod_ = 0;
+    for (int c = 0; c < 3; c++) {
+        boundsmin_[c] = 0.0f;
+        boundsmax_[c] = 0.0f;
+        center_[c] = 0.0f;
+    }
+    radius_ = 0.0f;
+    proceduralsegments_ = 0;
+    layout_ = VertexFormat();
+    decode_ = VertexDecode();
+    indextype_ = GL_UNSIGNED_INT;
+    ranges_.clear();
+    meshlets_.clear();
+    meshletvisible_.clear();
+    meshletculling_ = false;
+    meshletcounts_.clear();
+    meshletoffsets_.clear();
+    meshletbasevertices_.clear();
+    bvh_.reset();
+    release(positions_);
+    sourcefile_.clear();
+    sourcetable_ = nullptr;
+    stream_.reset();
+    streamfilename_.clear();
+}
+
+/*
+ * Delete the VAO and the vertex and index buffers, or free the room in the shared arena,
+ * keeping the vertex and index arrays
+ */
+void TriangleSoup::deleteBuffers() {
+    if (arena_) {
+        arena_->release(arenablock_);
+        arena_.reset();  // Deletes the arena if we were the last mesh in it
+        arenablock_ = -1;
+    }
+
+    // Only names that exist are deleted, so an empty or moved-from mesh makes no GL calls
+    if (vao_ != 0) {
         glDeleteVertexArrays(1, &vao_);
         vao_ = 0;
     }
 
-    if (glIsBuffer(vertexbuffer_)) {
+    if (vertexbuffer_ != 0) {
         glDeleteBuffers(1, &vertexbuffer_);
         vertexbuffer_ = 0;
     }
 
-    if (glIsBuffer(indexbuffer_)) {
+    if (indexbuffer_ != 0) {
         glDeleteBuffers(1, &indexbuffer_);
         indexbuffer_ = 0;
     }
-
-    vertexarray_.clear();
-    indexarray_.clear();
-    nverts_ = 0;
-    ntris_ = 0;
+    mode_ = GL_TRIANGLES;
+    nstripindices_ = 0;
 }
 
-/* Create a demo object with a single triangle */
-void TriangleSoup::createTriangle() {
-
-    // Constant data arrays for this simple test.
-    // Note, however, that they are copied to dynamic arrays
-    // in the class, to handle this object in the same manner
-    // as the larger objects loaded from file.
-    //
-    // The data array contains 8 floats per vertex:
-    // coordinate xyz, normal xyz, texcoords st
-    const GLfloat vertex_array_data[] = {
-        -1.0f, -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 0
-        1.0f,  -1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f,  // Vertex 1
-        0.0f,  1.0f,  0.0f, 0.0f, 0.0f, 1.0f, 0.5f, 1.0f   // Vertex 2
-    };
-    const GLuint index_array_data[] = {0, 1, 2};
+/*
+ * Create the VAO and the vertex and index buffers, with room for 'numvertices' vertices and
+ * 'numindices' indices. The data may come from vertexarray_ and indexarray_, or from anywhere
+ * else in memory. It is converted to format_ on the way, see VertexFormat.hpp. The indices
+ * are stored as 16 bits when possible, split into ranges with a base vertex each if the mesh
+ * has more than 65536 vertices. With setStrips(true), the triangles are converted to strips
+ * first, unless 'strip' already has them. With null pointers the buffers are allocated but
+ * left undefined, and the vertices are floats and the indices 32 bits.
+ */
+void TriangleSoup::upload(const GLfloat* vertexdata, int numvertices, const GLuint* indexdata,
+                          int numindices, GLenum usage, const std::vector<GLuint>* strip) {
+    std::vector<unsigned char> packed;
+    layout_ = VertexFormat();
+    decode_ = VertexDecode();
+    if (vertexdata && !format_.isFloat()) {
+        packVertices(vertexdata, numvertices, format_, packed, decode_);
+        layout_ = format_;
+    }
+    const void* vertexbytes = packed.empty() ? static_cast<const void*>(vertexdata) : packed.data();
 
-    nverts_ = 3;
-    ntris_ = 1;
+    if (vertexdata) {
+        computeBounds(vertexdata, numvertices);
+    }
+    meshletculling_ = false;  // The draws of the visible meshlets are for the old buffers
+    bvh_.reset();
+
+    // Triangle strips for the full mesh only, since the levels of detail and the meshlets are
+    // drawn as ranges of triangles. A stripifier that had to leave out degenerate triangles
+    // would lose track of the triangle count, so such meshes keep the list.
+    std::vector<GLuint> strips;
+    mode_ = GL_TRIANGLES;
+    nstripindices_ = 0;
+    if (usestrips_ && vertexdata && indexdata && lods_.empty() && meshlets_.empty()) {
+        size_t striptriangles = static_cast<size_t>(numindices / 3);
+        if (strip) {
+            strips = *strip;
+        } else {
+            const std::vector<GLuint> triangles(indexdata, indexdata + numindices);
+            striptriangles = meshopt::stripify(triangles, numvertices, strips);
+        }
+        if (striptriangles == static_cast<size_t>(numindices / 3)) {
+            mode_ = GL_TRIANGLE_STRIP;
+            nstripindices_ = static_cast<GLsizei>(strips.size());
+            indexdata = strips.data();
+            numindices = nstripindices_;
+        }
+    }
 
-    vertexarray_.resize(8 * nverts_);
-    indexarray_.resize(3 * ntris_);
+    // Use 16 bit indices if they fit, with separate ranges for the levels of detail. Strips
+    // are drawn in one piece, so they need all vertices below the restart index 0xFFFF.
+    std::vector<GLushort> shortindices;
+    std::vector<GLsizei> breaks;
+    for (const Lod& lod : lods_) {
+        breaks.push_back(lod.first);
+    }
+    indextype_ = GL_UNSIGNED_INT;
+    ranges_.clear();
+    if (mode_ == GL_TRIANGLE_STRIP) {
+        if (numvertices <= 0xFFFF) {
+            shortindices.resize(static_cast<size_t>(numindices));
+            for (size_t i = 0; i < shortindices.size(); i++) {
+                shortindices[i] = static_cast<GLushort>(indexdata[i]);  // ~0u becomes 0xFFFF
+            }
+            indextype_ = GL_UNSIGNED_SHORT;
+        }
+    } else if (indexdata && splitIndices(indexdata, numindices, breaks, shortindices, ranges_)) {
+        indextype_ = GL_UNSIGNED_SHORT;
+    }
+    for (Lod& lod : lods_) {
+        lod.firstrange = 0;
+        lod.numranges = 0;
+        for (size_t r = 0; r < ranges_.size(); r++) {
+            if (ranges_[r].first < lod.first) {
+                lod.firstrange = r + 1;
+            } else if (ranges_[r].first < lod.first + lod.count) {
+                lod.numranges++;
+            }
+        }
+    }
 
-    for (int i = 0; i < 8 * nverts_; i++) {
-        vertexarray_[i] = vertex_array_data[i];
+    // In the shared arena, the mesh is always drawn in ranges relative to its first vertex
+    if (usearena_ && vertexdata && indextype_ == GL_UNSIGNED_SHORT && mode_ == GL_TRIANGLES) {
+        arena_ = GeometryArena::get(layout_);
+        arenablock_ = arena_->allocate(vertexbytes, numvertices, shortindices.data(), numindices);
+        applyResidency();
+        return;
     }
-    for (int i = 0; i < 3 * ntris_; i++) {
-        indexarray_[i] = index_array_data[i];
+    if (ranges_.size() == 1 && lods_.empty() && ranges_[0].basevertex == 0) {
+        ranges_.clear();  // All in one range from vertex 0, so a plain draw will do
     }
 
     // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
+    glGenVertexArrays(1, &vao_);
     glBindVertexArray(vao_);
 
     // Generate two buffer IDs
@@ -88,32 +476,20 @@ void TriangleSoup::createTriangle() {
 
     // Activate the vertex buffer
     glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL (8 * nverts_)
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 floats (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
+    // Present our vertex data to OpenGL (numvertices * stride bytes)
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(numvertices) * layout_.stride(),
+                 vertexbytes, usage);
+    layout_.setAttributes();
 
     // Activate the index buffer
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL (3 * ntris_)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
+    // Present our vertex indices to OpenGL
+    if (indextype_ == GL_UNSIGNED_SHORT) {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(GLushort),
+                     shortindices.data(), usage);
+    } else {
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, numindices * sizeof(GLuint), indexdata, usage);
+    }
 
     // Deactivate (unbind) the VAO and the buffers again.
     // Do NOT unbind the index buffer while the VAO is still bound.
@@ -121,83 +497,89 @@ void TriangleSoup::createTriangle() {
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (vertexdata) {
+        applyResidency();
+    }
 }
 
-/* Create a simple box geometry */
-/* TODO: Split to 24 vertices to get the normals and texcoords right. */
-void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
+/* Choose between the shared arena and buffers of our own for geometry created from now on */
+void TriangleSoup::setUseArena(bool use) { usearena_ = use; }
 
-    // The data array contains 8 floats per vertex:
-    // coordinate xyz, normal xyz, texcoords st
-    const GLfloat vertex_array_data[] = {
-        -xsize, -ysize, -zsize, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 0
-        xsize,  -ysize, -zsize, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 1
-        -xsize, ysize,  -zsize, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 2
-        xsize,  ysize,  -zsize, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 3
-        -xsize, -ysize, zsize,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 0
-        xsize,  -ysize, zsize,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 1
-        -xsize, ysize,  zsize,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f,  // Vertex 2
-        xsize,  ysize,  zsize,  0.0f, 0.0f, 1.0f, 0.0f, 0.0f   // Vertex 3
-    };
-    const GLuint index_array_data[] = {0, 3, 1, 0, 2, 3, 1, 4, 0, 1, 5, 4, 4, 2, 0, 4, 6, 2,
-                                       1, 3, 7, 1, 7, 5, 7, 2, 6, 7, 3, 2, 4, 5, 7, 4, 7, 6};
+/* Choose between triangle strips and lists of triangles for geometry created from now on */
+void TriangleSoup::setStrips(bool use) { usestrips_ = use; }
 
-    nverts_ = 8;
-    ntris_ = 12;
+bool TriangleSoup::usesStrips() const { return mode_ == GL_TRIANGLE_STRIP; }
 
-    vertexarray_.resize(8 * nverts_);
-    indexarray_.resize(3 * ntris_);
+/* Select the format of the vertex buffer for geometry created or loaded from now on */
+void TriangleSoup::setVertexFormat(const VertexFormat& format) { format_ = format; }
 
-    for (int i = 0; i < 8 * nverts_; i++) {
-        vertexarray_[i] = vertex_array_data[i];
-    }
-    for (int i = 0; i < 3 * ntris_; i++) {
-        indexarray_[i] = index_array_data[i];
+/* Select what is kept of the arrays after an upload, and drop the rest now */
+void TriangleSoup::setResidency(Residency residency) {
+    residency_ = residency;
+    applyResidency();
+}
+
+TriangleSoup::Residency TriangleSoup::residency() const { return residency_; }
+
+/*
+ * Set the uniforms of meshvertex.glsl that decode the current vertex format. The program must
+ * be in use (glUseProgram()).
+ */
+void TriangleSoup::setDecodeUniforms(GLuint programID) const {
+    glUniform3fv(glGetUniformLocation(programID, "positionScale"), 1, decode_.positionscale);
+    glUniform3fv(glGetUniformLocation(programID, "positionOffset"), 1, decode_.positionoffset);
+    glUniform2fv(glGetUniformLocation(programID, "texcoordScale"), 1, decode_.texcoordscale);
+    glUniform2fv(glGetUniformLocation(programID, "texcoordOffset"), 1, decode_.texcoordoffset);
+    glUniform1i(glGetUniformLocation(programID, "octahedralNormals"),
+                layout_.normal == VertexFormat::Normal::Octahedral);
+    if (proceduralsegments_ > 0) {
+        glUniform1i(glGetUniformLocation(programID, "sphereSegments"), proceduralsegments_);
+        glUniform1f(glGetUniformLocation(programID, "sphereRadius"), radius_);
     }
+}
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
-    glBindVertexArray(vao_);
+/* Create a demo object with a single triangle */
+void TriangleSoup::createTriangle() {
+    // Delete any previous content in the TriangleSoup object
+    clean();
 
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
+    // The data is a constant table in Primitives.cpp, which is uploaded as it is. It is only
+    // copied to the arrays in the class when they are needed, see restoreArrays().
+    const GLfloat scale[3] = {1.0f, 1.0f, 1.0f};
+    uploadTable(primitives::triangleTable(), scale);
+}
 
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL (8 * nverts_)
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 floats (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3 or 6 floats (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
+/* Create a simple box geometry */
+/* TODO: Split to 24 vertices to get the normals and texcoords right. */
+void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
 
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL (3 * ntris_)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
+    // A box from -1 to 1 along each axis, scaled to the size
+    const GLfloat scale[3] = {xsize, ysize, zsize};
+    uploadTable(primitives::boxTable(), scale);
+}
 
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Do NOT unbind the index buffer while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+/*
+ * Upload a table from Primitives.hpp with its positions scaled. At scale 1, the table is
+ * uploaded straight from the read-only data of the program, and the arrays stay empty.
+ * 'strip' is passed on to upload().
+ */
+void TriangleSoup::uploadTable(const primitives::Table& table, const GLfloat* scale,
+                               const std::vector<GLuint>* strip) {
+    nverts_ = table.numvertices;
+    ntris_ = table.numindices / 3;
+    nrawverts_ = nverts_;
+    sourcetable_ = &table;
+    std::copy(scale, scale + 3, sourcescale_);
+
+    if (scale[0] == 1.0f && scale[1] == 1.0f && scale[2] == 1.0f) {
+        upload(table.vertices, nverts_, table.indices, table.numindices, GL_STATIC_DRAW, strip);
+        return;
+    }
+    primitives::copyTable(table, scale, vertexarray_, indexarray_);
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_, GL_STATIC_DRAW, strip);
 }
 
 /*
@@ -206,6 +588,9 @@ void TriangleSoup::createBox(float xsize, float ysize, float zsize) {
  * Create a TriangleSoup object with vertex and index arrays
  * to draw a textured sphere with normals.
  * Increasing the parameter 'segments' yields more triangles.
+ * The arrays are generated by primitives::sphere(), see Primitives.hpp, except for the
+ * segment counts that have a table there, which is only scaled to the radius.
+ * With setStrips(true), each band of latitude is drawn as one triangle strip.
  * The vertex array is on interleaved format. For each vertex, there
  * are 8 floats: three for the vertex coordinates (x, y, z), three
  * for the normal vector (n_x, n_y, n_z) and finally two for texture
@@ -220,358 +605,448 @@ void TriangleSoup::createSphere(float radius, int segments) {
     // Delete any previous content in the TriangleSoup object
     clean();
 
-    const int vsegs = std::max(segments, 2);
-    const int hsegs = vsegs * 2;
-
-    nverts_ = 1 + (vsegs - 1) * (hsegs + 1) + 1;       // top + middle + bottom
-    ntris_ = hsegs + (vsegs - 2) * hsegs * 2 + hsegs;  // top + middle + bottom
-    vertexarray_.resize(nverts_ * 8);
-    indexarray_.resize(ntris_ * 3);
-
-    const int stride = 8;  // the stride is based on the position, the normal, and texture coord
-
-    // The vertex array: 3D xyz, 3D normal, 2D st (8 floats per vertex)
-    // First vertex: top pole (+z is "up" in object local coords)
-    vertexarray_[0] = 0.0f;
-    vertexarray_[1] = 0.0f;
-    vertexarray_[2] = radius;
-    vertexarray_[3] = 0.0f;
-    vertexarray_[4] = 0.0f;
-    vertexarray_[5] = 1.0f;
-    vertexarray_[6] = 0.5f;
-    vertexarray_[7] = 1.0f;
-    // Last vertex: bottom pole
-    int base = (nverts_ - 1) * stride;
-    vertexarray_[base] = 0.0f;
-    vertexarray_[base + 1] = 0.0f;
-    vertexarray_[base + 2] = -radius;
-    vertexarray_[base + 3] = 0.0f;
-    vertexarray_[base + 4] = 0.0f;
-    vertexarray_[base + 5] = -1.0f;
-    vertexarray_[base + 6] = 0.5f;
-    vertexarray_[base + 7] = 0.0f;
-    // All other vertices:
-    // vsegs-1 latitude rings of hsegs+1 vertices each
-    // (duplicates at texture seam s=0 / s=1)
-
-    for (int j = 0; j < vsegs - 1; j++) {  // vsegs-1 latitude rings of vertices
-        const double theta = static_cast<double>(j + 1) / vsegs * M_PI;
-        const float z = static_cast<float>(std::cos(theta));
-        const float R = static_cast<float>(std::sin(theta));
-
-        for (int i = 0; i <= hsegs;
-             i++) {  // hsegs+1 vertices in each ring (duplicate for texcoords)
-            const double phi = static_cast<double>(i) / hsegs * 2.0 * M_PI;
-            const float x = R * static_cast<float>(std::cos(phi));
-            const float y = R * static_cast<float>(std::sin(phi));
-            base = (1 + j * (hsegs + 1) + i) * stride;
-            vertexarray_[base] = radius * x;
-            vertexarray_[base + 1] = radius * y;
-            vertexarray_[base + 2] = radius * z;
-            vertexarray_[base + 3] = x;
-            vertexarray_[base + 4] = y;
-            vertexarray_[base + 5] = z;
-            vertexarray_[base + 6] = (float)i / hsegs;
-            vertexarray_[base + 7] = 1.0f - (float)(j + 1) / vsegs;
-        }
+    // The bands map straight to strips, without the stripifier
+    std::vector<GLuint> strip;
+    if (usestrips_) {
+        primitives::sphereStrip(segments, strip);
     }
 
-    // The index array: triplets of integers, one for each triangle
-    // Top cap
-    for (int i = 0; i < hsegs; i++) {
-        indexarray_[3 * i] = 0;
-        indexarray_[3 * i + 1] = 1 + i;
-        indexarray_[3 * i + 2] = 2 + i;
-    }
-    // Middle part (possibly empty if vsegs=2)
-    for (int j = 0; j < vsegs - 2; j++) {
-        for (int i = 0; i < hsegs; i++) {
-            base = 3 * (hsegs + 2 * (j * hsegs + i));
-            const int i0 = 1 + j * (hsegs + 1) + i;
-            indexarray_[base] = i0;
-            indexarray_[base + 1] = i0 + hsegs + 1;
-            indexarray_[base + 2] = i0 + 1;
-            indexarray_[base + 3] = i0 + 1;
-            indexarray_[base + 4] = i0 + hsegs + 1;
-            indexarray_[base + 5] = i0 + hsegs + 2;
-        }
-    }
-    // Bottom cap
-    base = 3 * (hsegs + 2 * (vsegs - 2) * hsegs);
-    for (int i = 0; i < hsegs; i++) {
-        indexarray_[base + 3 * i] = nverts_ - 1;
-        indexarray_[base + 3 * i + 1] = nverts_ - 2 - i;
-        indexarray_[base + 3 * i + 2] = nverts_ - 3 - i;
+    const primitives::Table* table = primitives::sphereTable(segments);
+    if (table) {
+        const GLfloat scale[3] = {radius, radius, radius};
+        uploadTable(*table, scale, usestrips_ ? &strip : nullptr);
+        return;
     }
+    primitives::sphere(radius, segments, vertexarray_, indexarray_);
+    nverts_ = static_cast<int>(vertexarray_.size() / 8);
+    ntris_ = static_cast<int>(indexarray_.size() / 3);
+    nrawverts_ = nverts_;
+
+    // Send the data off to OpenGL
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_, GL_STATIC_DRAW,
+           usestrips_ ? &strip : nullptr);
+}
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &(vao_));
-    glBindVertexArray(vao_);
+/*
+ * Create a sphere from a subdivided cube, see Primitives.hpp. For the same largest distance
+ * from the true sphere, it needs fewer triangles than createSphere().
+ */
+void TriangleSoup::createCubeSphere(float radius, int segments) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
 
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
+    primitives::cubeSphere(radius, segments, vertexarray_, indexarray_);
+    nverts_ = static_cast<int>(vertexarray_.size() / 8);
+    ntris_ = static_cast<int>(indexarray_.size() / 3);
+    nrawverts_ = nverts_;
 
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3, 6 (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
+    // Send the data off to OpenGL
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_);
+}
 
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
+/*
+ * Create a sphere that exists only as a number of segments and a radius. spherevertex.glsl
+ * computes the vertices of createSphere() from gl_VertexID, so the VAO has no attributes and
+ * no buffers. The bounds are known without any vertices.
+ */
+void TriangleSoup::createProceduralSphere(float radius, int segments) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
 
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Note that the order of these operations matter:
-    // do NOT unbind the buffers while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    proceduralsegments_ = std::max(segments, 2);
+    ntris_ = 4 * proceduralsegments_ * (proceduralsegments_ - 1);
+    for (int c = 0; c < 3; c++) {
+        boundsmin_[c] = -radius;
+        boundsmax_[c] = radius;
+    }
+    radius_ = radius;
+
+    // The core profile draws nothing without a VAO, even an empty one
+    glGenVertexArrays(1, &vao_);
 }
 
 /*
- * readObj(const char* filename)
+ * readOBJ(const std::string& filename, Loader loader, int threads, int optimizations)
  *
  * Load TriangleSoup geometry data from an OBJ file.
  * The vertex array is on interleaved format. For each vertex, there
  * are 8 floats: three for the vertex coordinates (x, y, z), three
  * for the normal vector (n_x, n_y, n_z) and finally two for texture
- * coordinates (s, t). The arrays are allocated by "new" inside the
- * function and should be disposed of using "delete" when they are no longer
- * needed. This is done by the method clean() called by the destructor.
+ * coordinates (s, t). The parsing itself is done by the functions in
+ * ObjReader.hpp, selected by 'loader', and the time spent parsing is printed
+ * to allow comparing them. Face corners that refer to the same v/t/n triple
+ * are welded into one vertex, except by the reference scanf() loader.
+ * The other loaders write the result to a binary cache file next to the OBJ
+ * file, see MeshCache.hpp, and load from it when it is up to date.
  *
  * Author: Stefan Gustavson (stegu@itn.liu.se) 2014.
  * This code is in the public domain.
  */
-void TriangleSoup::readOBJ(const std::string& filename) {
-    FILE* objfile = fopen(filename.c_str(), "r");
+void TriangleSoup::readOBJ(const std::string& filename, Loader loader, int threads,
+                           int optimizations) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
 
-    if (!objfile) {
-        std::cerr << "File not found: " << filename << "\n";
-        return;
+    ObjData data;
+    if (loadOBJData(filename, loader, threads, optimizations, data)) {
+        sourcefile_ = filename;
+        sourceloader_ = loader;
+        sourceoptimizations_ = optimizations;
+        adopt(data);
     }
+}
 
-    // Scan through the file to count the number of data elements
-    char line[256];
-    char tag[3];
-
-    int numverts = 0;
-    int numnormals = 0;
-    int numtexcoords = 0;
-    int numfaces = 0;
-    while (fgets(line, 256, objfile)) {
-        sscanf(line, "%2s ", tag);
-        if (!strcmp(tag, "v")) {
-            numverts++;
-        } else if (!strcmp(tag, "vn")) {
-            numnormals++;
-        } else if (!strcmp(tag, "vt")) {
-            numtexcoords++;
-        } else if (!strcmp(tag, "f")) {
-            numfaces++;
-        }
-        // else {
-        //     std::cout << "Ignoring line starting with \"" << tag << "\"\n";
-        // }
-    }
-
-    std::cout << "loadObj(\"" << filename << "\"): found " << numverts << " vertices, "
-              << numnormals << " normals, " << numtexcoords << " texcoords, " << numfaces
-              << " faces.\n";
-
-    std::vector<float> verts(3 * numverts);
-    std::vector<float> normals(3 * numnormals);
-    std::vector<float> texcoords(2 * numtexcoords);
-
-    vertexarray_.resize(8 * 3 * numfaces);
-    indexarray_.resize(3 * numfaces);
-    nverts_ = 3 * numfaces;
-    ntris_ = numfaces;
-
-    rewind(objfile);  // Start from the top again to read data
-
-    int i_v = 0;
-    int i_n = 0;
-    int i_t = 0;
-    int i_f = 0;
-
-    int readerror = 0;
-    while (fgets(line, 256, objfile)) {
-        tag[0] = '\0';
-        sscanf(line, "%2s ", tag);
-        if (!strcmp(tag, "v")) {
-            // A vertex with three coordinates
-            // std::cout << "Reading vertex " << i_v + 1 << "\n";
-
-            int numargs = sscanf(line, "v %f %f %f", &verts[3 * i_v], &verts[3 * i_v + 1],
-                                 &verts[3 * i_v + 2]);
-            if (numargs != 3) {
-                std::cerr << "Malformed vertex data found at vertex " << i_v + 1 << "\nAborting\n";
-                readerror = 1;
-                break;
-            }
-            i_v++;
-        } else if (!strcmp(tag, "vn")) {
-            // A vertex normal with three components
-            // std::cout << "Reading normal " << i_n + 1 << "\n";
-
-            int numargs = sscanf(line, "vn %f %f %f", &normals[3 * i_n], &normals[3 * i_n + 1],
-                                 &normals[3 * i_n + 2]);
-            if (numargs != 3) {
-                std::cerr << "Malformed normal data found at normal" << i_n + 1 << "\nAborting\n";
-                readerror = 1;
-                break;
-            }
-            i_n++;
-        } else if (!strcmp(tag, "vt")) {
-            // A vertex texture coordinate, two components
-            // std::cout << "Reading texcoord " << i_t + 1 << "\n";
-
-            int numargs = sscanf(line, "vt %f %f", &texcoords[2 * i_t], &texcoords[2 * i_t + 1]);
-            if (numargs != 2) {
-                std::cerr << "Malformed texcoord data found at texcoord " << i_t + 1
-                          << "\nAborting\n";
-                readerror = 1;
-                break;
-            }
-            i_t++;
-        } else if (!strcmp(tag, "f")) {
-            // A face with three or more vertex indices
-            // std::cout << "Reading face " << i_f + 1 << "\n";
-
-            int v1, v2, v3, n1, n2, n3, t1, t2, t3;
-            int numargs = sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", &v1, &t1, &n1, &v2, &t2, &n2,
-                                 &v3, &t3, &n3);
-            if (numargs != 9) {  // Accept only triangles. Quads cause an error.
-                std::cerr << "Malformed face data found at vertex " << i_f + 1 << "\nAborting\n";
-                readerror = 1;
-                break;
+/*
+ * Start loading an OBJ file on a worker thread. The returned future becomes ready when the
+ * file is parsed. The GL objects can only be created on the thread that owns the context, so
+ * that is left to the first call to render() or isReady() after the parsing is done.
+ */
+std::shared_future<bool> TriangleSoup::readOBJAsync(const std::string& filename, Loader loader,
+                                                    int threads, int optimizations) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
+
+    // The worker only touches its own ObjData, never the members of this object
+    std::shared_ptr<ObjData> data = std::make_shared<ObjData>();
+    pendingdata_ = data;
+    sourcefile_ = filename;
+    sourceloader_ = loader;
+    sourceoptimizations_ = optimizations;
+    pending_ = std::async(std::launch::async, [filename, loader, threads, optimizations, data]() {
+                   return loadOBJData(filename, loader, threads, optimizations, *data);
+               }).share();
+    return pending_;
+}
+
+/* Check whether an asynchronous load has finished, and if so create its GL objects */
+bool TriangleSoup::isReady() {
+    if (!pending_.valid()) {
+        return true;
+    }
+    if (pending_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return false;
+    }
+    if (pending_.get()) {
+        adopt(*pendingdata_);
+    } else {
+        sourcefile_.clear();  // Recorded by readOBJAsync(), but there is nothing to reload
+    }
+    pending_ = std::shared_future<bool>();
+    pendingdata_.reset();
+    return true;
+}
+
+/*
+ * Load an OBJ file into 'data', from the cache file if it is valid, otherwise by parsing it.
+ * No OpenGL calls are made here, so this is safe to run on any thread.
+ */
+bool TriangleSoup::loadOBJData(const std::string& filename, Loader loader, int threads,
+                               int optimizations, ObjData& data) {
+    const auto starttime = std::chrono::steady_clock::now();
+
+    // The scanf() loader does not weld, so it is not expected to match the cache contents
+    if (loader != Loader::Scanf && openCache(filename, optimizations, data)) {
+        return true;
+    }
+
+    // The cache is keyed on the contents that are parsed here, from the same mapping. The
+    // time is taken first, so a change made while the file is parsed makes the cache stale.
+    int64_t sourcetime = 0;
+    const bool cacheable = loader != Loader::Scanf && MeshCache::sourceTime(filename, sourcetime);
+    MappedFile file;
+    obj::Counts counts;
+    bool success = false;
+    switch (loader) {
+        case Loader::Scanf:
+            success = obj::readScanf(filename, data.vertexarray, data.indexarray, counts);
+            break;
+        case Loader::Mapped:
+        case Loader::Parallel:
+            if (!file.open(filename)) {
+                std::cerr << "File not found: " << filename << "\n";
+            } else if (loader == Loader::Mapped) {
+                success = obj::parse(file.data(), file.data() + file.size(), data.vertexarray,
+                                     data.indexarray, counts, true);
+            } else {
+                success = obj::parseParallel(file.data(), file.data() + file.size(),
+                                             data.vertexarray, data.indexarray, counts, threads,
+                                             true);
             }
-            //			printf("Read vertex data %d/%d/%d %d/%d/%d %d/%d/%d\n",
-            //			v1, t1, n1, v2, t2, n2, v3, t3, n3);
-            // Indices in OBJ files start at 1, but C++ arrays start at index 0.
-            --v1;
-            --v2;
-            --v3;
-            --n1;
-            --n2;
-            --n3;
-            --t1;
-            --t2;
-            --t3;
-
-            const int currentv = 8 * 3 * i_f;
-            vertexarray_[currentv] = verts[3 * v1];
-            vertexarray_[currentv + 1] = verts[3 * v1 + 1];
-            vertexarray_[currentv + 2] = verts[3 * v1 + 2];
-            vertexarray_[currentv + 3] = normals[3 * n1];
-            vertexarray_[currentv + 4] = normals[3 * n1 + 1];
-            vertexarray_[currentv + 5] = normals[3 * n1 + 2];
-            vertexarray_[currentv + 6] = texcoords[2 * t1];
-            vertexarray_[currentv + 7] = texcoords[2 * t1 + 1];
-            vertexarray_[currentv + 8] = verts[3 * v2];
-            vertexarray_[currentv + 9] = verts[3 * v2 + 1];
-            vertexarray_[currentv + 10] = verts[3 * v2 + 2];
-            vertexarray_[currentv + 11] = normals[3 * n2];
-            vertexarray_[currentv + 12] = normals[3 * n2 + 1];
-            vertexarray_[currentv + 13] = normals[3 * n2 + 2];
-            vertexarray_[currentv + 14] = texcoords[2 * t2];
-            vertexarray_[currentv + 15] = texcoords[2 * t2 + 1];
-            vertexarray_[currentv + 16] = verts[3 * v3];
-            vertexarray_[currentv + 17] = verts[3 * v3 + 1];
-            vertexarray_[currentv + 18] = verts[3 * v3 + 2];
-            vertexarray_[currentv + 19] = normals[3 * n3];
-            vertexarray_[currentv + 20] = normals[3 * n3 + 1];
-            vertexarray_[currentv + 21] = normals[3 * n3 + 2];
-            vertexarray_[currentv + 22] = texcoords[2 * t3];
-            vertexarray_[currentv + 23] = texcoords[2 * t3 + 1];
-            indexarray_[3 * i_f] = 3 * i_f;
-            indexarray_[3 * i_f + 1] = 3 * i_f + 1;
-            indexarray_[3 * i_f + 2] = 3 * i_f + 2;
-            i_f++;
-        }
+            break;
     }
 
-    // Clean up the temporary arrays we created
-    fclose(objfile);
+    if (!success) {  // Delete corrupt data and bail out if a read error occured
+        std::cerr << "Mesh read error: No mesh data generated\n";
+        data.vertexarray.clear();
+        data.indexarray.clear();
+        return false;
+    }
+
+    const std::chrono::duration<double, std::milli> parsetime =
+        std::chrono::steady_clock::now() - starttime;
+
+    const char* loadername[] = {"scanf", "mapped", "parallel"};
+    std::cout << "readOBJ(\"" << filename << "\"): found " << counts.verts << " vertices, "
+              << counts.normals << " normals, " << counts.texcoords << " texcoords, "
+              << counts.faces << " faces in " << parsetime.count() << " ms ("
+              << loadername[static_cast<int>(loader)] << " loader).\n";
+
+    optimizeArrays(data.vertexarray, data.indexarray, optimizations);
+
+    // Save the result for next time. The options of the cache file record the optimizations.
+    if (cacheable) {
+        MeshCache::write(filename, MeshCache::source(file.data(), file.size(), sourcetime),
+                         data.vertexarray, data.indexarray, static_cast<uint32_t>(optimizations));
+    }
+    return true;
+}
+
+/*
+ * Open a valid binary cache file for an OBJ file. The data stays in the mapped file, and is
+ * uploaded straight from there by adopt().
+ */
+bool TriangleSoup::openCache(const std::string& filename, int optimizations, ObjData& data) {
+    const auto starttime = std::chrono::steady_clock::now();
+    if (!data.cache.open(filename, static_cast<uint32_t>(optimizations))) {
+        return false;
+    }
+    data.cached = true;
+
+    const std::chrono::duration<double, std::milli> loadtime =
+        std::chrono::steady_clock::now() - starttime;
+    std::cout << "readOBJ(\"" << filename << "\"): loaded " << data.cache.numVertices()
+              << " vertices, " << data.cache.numIndices() / 3 << " faces from \""
+              << MeshCache::cacheFilename(filename) << "\" in " << loadtime.count() << " ms.\n";
+    return true;
+}
+
+/*
+ * Take over a loaded mesh and send it off to OpenGL. Data from a cache file is uploaded from
+ * the mapped file, and the vertex and index arrays are left empty, so print() and printInfo()
+ * have less to show.
+ */
+void TriangleSoup::adopt(ObjData& data) {
+    if (data.cached) {
+        nverts_ = data.cache.numVertices();
+        ntris_ = data.cache.numIndices() / 3;
+        nrawverts_ = 3 * ntris_;
+        upload(data.cache.vertices(), nverts_, data.cache.indices(), 3 * ntris_);
+        return;
+    }
+    vertexarray_.swap(data.vertexarray);
+    indexarray_.swap(data.indexarray);
+    nverts_ = static_cast<int>(vertexarray_.size() / 8);
+    ntris_ = static_cast<int>(indexarray_.size() / 3);
+    nrawverts_ = 3 * ntris_;
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_);
+}
+
+/*
+ * Start a progressive load. The faces are counted first, which gives the exact size of the
+ * index buffer and an upper bound for the vertex buffer (three vertices per face, before
+ * welding). Both are allocated empty, and continueReadOBJ() fills them from the start.
+ */
+void TriangleSoup::beginReadOBJ(const std::string& filename) {
+    // Delete any previous content in the TriangleSoup object
+    clean();
+
+    ObjData data;
+    if (openCache(filename, 0, data)) {
+        sourcefile_ = filename;
+        sourceloader_ = Loader::Parallel;
+        sourceoptimizations_ = 0;
+        adopt(data);
+        return;
+    }
 
-    if (readerror) {  // Delete corrupt data and bail out if a read error occured
+    // Taken before the file is mapped, like in readOBJ()
+    streamtime_ = 0;
+    MeshCache::sourceTime(filename, streamtime_);
+    stream_.reset(new obj::StreamParser);
+    if (!stream_->open(filename, true)) {
         std::cerr << "Mesh read error: No mesh data generated\n";
         clean();
         return;
     }
+    streamfilename_ = filename;
 
-    // Generate one vertex array object (VAO) and bind it
-    glGenVertexArrays(1, &vao_);
-    glBindVertexArray(vao_);
+    const int maxindices = 3 * stream_->totalFaces();
+    upload(nullptr, maxindices, nullptr, maxindices, GL_DYNAMIC_DRAW);
+}
 
-    // Generate two buffer IDs
-    glGenBuffers(1, &vertexbuffer_);
-    glGenBuffers(1, &indexbuffer_);
+/*
+ * Parse slices of the file until the time is up, then upload the vertices and indices that
+ * were added. render() only draws the first ntris_ triangles, so it always sees a consistent
+ * prefix of the mesh. When the file is done, the vertex buffer is shrunk to its final size.
+ */
+bool TriangleSoup::continueReadOBJ(double milliseconds) {
+    if (!stream_) {
+        return true;  // Nothing is loading
+    }
 
-    // Activate the vertex buffer
-    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
-    // Present our vertex coordinates to OpenGL
-    glBufferData(GL_ARRAY_BUFFER, vertexarray_.size() * sizeof(GLfloat), vertexarray_.data(),
-                 GL_STATIC_DRAW);
-
-    // Specify how many attribute arrays we have in our VAO
-    glEnableVertexAttribArray(0);  // Vertex coordinates
-    glEnableVertexAttribArray(1);  // Normals
-    glEnableVertexAttribArray(2);  // Texture coordinates
-    // Specify how OpenGL should interpret the vertex buffer data:
-    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
-    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
-    // Type GL_FLOAT
-    // Not normalized (GL_FALSE)
-    // Stride 8 (interleaved array with 8 floats per vertex)
-    // Array buffer offset 0, 3, 6 (offset into first vertex)
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)0);  // xyz coordinates
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(3 * sizeof(GLfloat)));  // normals
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(GLfloat),
-                          (void*)(6 * sizeof(GLfloat)));  // texcoords
+    // Parse in slices small enough to keep close to the time budget
+    const size_t slicebytes = 64 * 1024;
+    const auto starttime = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> elapsed(0.0);
+    while (!stream_->done() && elapsed.count() < milliseconds) {
+        if (!stream_->parse(slicebytes, vertexarray_, indexarray_)) {
+            std::cerr << "Mesh read error: No mesh data generated\n";
+            clean();
+            return true;
+        }
+        elapsed = std::chrono::steady_clock::now() - starttime;
+    }
 
-    // Activate the index buffer
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexbuffer_);
-    // Present our vertex indices to OpenGL
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexarray_.size() * sizeof(GLuint), indexarray_.data(),
-                 GL_STATIC_DRAW);
+    // Upload the new vertices before the indices that refer to them
+    const int numvertices = static_cast<int>(vertexarray_.size() / 8);
+    const int numtris = static_cast<int>(indexarray_.size() / 3);
+    if (numvertices > nverts_) {
+        glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+        glBufferSubData(GL_ARRAY_BUFFER, 8 * nverts_ * sizeof(GLfloat),
+                        8 * (numvertices - nverts_) * sizeof(GLfloat),
+                        vertexarray_.data() + 8 * nverts_);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (numtris > ntris_) {
+        glBindVertexArray(vao_);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 3 * ntris_ * sizeof(GLuint),
+                        3 * (numtris - ntris_) * sizeof(GLuint), indexarray_.data() + 3 * ntris_);
+        glBindVertexArray(0);
+    }
+    nverts_ = numvertices;
+    ntris_ = numtris;
+    nrawverts_ = 3 * ntris_;
 
-    // Deactivate (unbind) the VAO and the buffers again.
-    // Do NOT unbind the buffers while the VAO is still bound.
-    // The index buffer is an essential part of the VAO state.
+    if (!stream_->done()) {
+        return false;
+    }
+
+    const obj::Counts& counts = stream_->counts();
+    std::cout << "readOBJ(\"" << streamfilename_ << "\"): found " << counts.verts
+              << " vertices, " << counts.normals << " normals, " << counts.texcoords
+              << " texcoords, " << counts.faces << " faces (progressive loader).\n";
+
+    MeshCache::write(streamfilename_,
+                     MeshCache::source(stream_->data(), stream_->size(), streamtime_),
+                     vertexarray_, indexarray_);
+    // The cache file is written like readOBJ() does, so the mesh can be reloaded from it
+    sourcefile_ = streamfilename_;
+    sourceloader_ = Loader::Parallel;
+    sourceoptimizations_ = 0;
+    stream_.reset();
+    streamfilename_.clear();
+
+    if (!format_.isFloat() || usestrips_ || usearena_) {
+        // The buffers were filled as floats, 32 bit indices and lists of triangles. Upload the
+        // finished mesh again in the form that was asked for.
+        deleteBuffers();
+        upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_);
+        applyResidency();
+        return true;
+    }
+
+    // Welding left the end of the vertex buffer unused. Copy the vertices to a buffer of the
+    // right size on the GPU, and point the VAO to it.
+    GLuint finalbuffer;
+    glGenBuffers(1, &finalbuffer);
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexbuffer_);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, finalbuffer);
+    glBufferData(GL_COPY_WRITE_BUFFER, 8 * nverts_ * sizeof(GLfloat), nullptr, GL_STATIC_DRAW);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0,
+                        8 * nverts_ * sizeof(GLfloat));
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glDeleteBuffers(1, &vertexbuffer_);
+    vertexbuffer_ = finalbuffer;
+    glBindVertexArray(vao_);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer_);
+    layout_.setAttributes();
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    computeBounds(vertexarray_.data(), nverts_);
+    applyResidency();
+    return true;
+}
+
+/* Reorder the geometry for faster rendering, see MeshOptimizer.hpp */
+void TriangleSoup::optimize(int optimizations) {
+    if (!restoreArrays()) {
+        printf("TriangleSoup has no complete vertex data to optimize.\n");
+        return;
+    }
+    detachSource();
+    // The vertices are renumbered, so the levels of detail no longer fit
+    if (!lods_.empty()) {
+        printf("Dropping the levels of detail, call buildLODs() again.\n");
+        indexarray_.resize(3 * static_cast<size_t>(ntris_));
+        lods_.clear();
+        lod_ = 0;
+    }
+    if (!meshlets_.empty()) {
+        printf("Dropping the meshlets, call buildMeshlets() again.\n");
+        meshlets_.clear();
+    }
+    optimizeArrays(vertexarray_, indexarray_, optimizations);
+
+    // Upload again, which also packs the vertices again if the format is not floats
+    deleteBuffers();
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), 3 * ntris_);
+}
+
+/* Move all vertices, and upload them again */
+void TriangleSoup::translate(float dx, float dy, float dz) {
+    if (!restoreArrays()) {
+        printf("TriangleSoup has no complete vertex data to translate.\n");
+        return;
+    }
+    detachSource();
+    for (size_t i = 0; i < vertexarray_.size(); i += 8) {
+        vertexarray_[i] += dx;
+        vertexarray_[i + 1] += dy;
+        vertexarray_[i + 2] += dz;
+    }
+    for (meshopt::Meshlet& meshlet : meshlets_) {
+        const float d[3] = {dx, dy, dz};
+        for (int c = 0; c < 3; c++) {
+            meshlet.center[c] += d[c];
+            meshlet.coneapex[c] += d[c];
+        }
+    }
+
+    // All levels of detail, if there are any
+    deleteBuffers();
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), static_cast<int>(indexarray_.size()));
+}
+
+void TriangleSoup::optimizeArrays(std::vector<GLfloat>& vertexarray,
+                                  std::vector<GLuint>& indexarray, int optimizations) {
+    // Overdraw optimization works on clusters of a cache optimized triangle order
+    if (!(optimizations & (OptimizeVertexCache | OptimizeOverdraw))) {
+        return;
+    }
+    const int numvertices = static_cast<int>(vertexarray.size() / 8);
+    const meshopt::CacheStats before = meshopt::analyzeVertexCache(indexarray, numvertices);
+    const auto starttime = std::chrono::steady_clock::now();
 
-    return;
+    meshopt::optimizeVertexCache(indexarray, numvertices);
+    if (optimizations & OptimizeOverdraw) {
+        meshopt::optimizeOverdraw(vertexarray, indexarray);
+    }
+    meshopt::optimizeVertexFetch(vertexarray, indexarray);
+
+    const std::chrono::duration<double, std::milli> optimizetime =
+        std::chrono::steady_clock::now() - starttime;
+    const meshopt::CacheStats after = meshopt::analyzeVertexCache(indexarray, numvertices);
+    printf("Vertex cache: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%.2f ms)\n", before.acmr,
+           after.acmr, before.atvr, after.atvr, optimizetime.count());
 }
 
 /* Print data from a TriangleSoup object, for debugging purposes */
 void TriangleSoup::print() {
+    if (nverts_ > 0 && !restoreArrays()) {
+        printf("TriangleSoup has no complete vertex data to print.\n");
+        return;
+    }
     printf("TriangleSoup vertex data:\n\n");
     for (int i = 0; i < nverts_; i++) {
         printf("%d: %8.2f %8.2f %8.2f\n", i, vertexarray_[8 * i], vertexarray_[8 * i + 1],
@@ -582,45 +1057,635 @@ void TriangleSoup::print() {
         printf("%d: %d %d %d\n", i, indexarray_[3 * i], indexarray_[3 * i + 1],
                indexarray_[3 * i + 2]);
     }
+    applyResidency();  // Drop the arrays again if they were read back
 }
 
 /* Print information about a TriangleSoup object (stats and extents) */
 void TriangleSoup::printInfo() {
     printf("TriangleSoup information:\n");
-    printf("vertices : %d\n", nverts_);
+    printf("vertices : %d (%d before welding)\n", nverts_, nrawverts_);
     printf("triangles: %d\n", ntris_);
-    float xmin = vertexarray_[0];
-    float xmax = xmin;
-    float ymin = vertexarray_[1];
-    float ymax = ymin;
-    float zmin = vertexarray_[2];
-    float zmax = zmin;
-
-    for (int i = 1; i < nverts_; i++) {
-        const float x = vertexarray_[8 * i];
-        const float y = vertexarray_[8 * i + 1];
-        const float z = vertexarray_[8 * i + 2];
-        //         printf("x y z : %8.2f %8.2f %8.2f\n", x, y, z);
-
-        xmin = std::min(xmin, x);
-        xmax = std::max(xmax, x);
-        ymin = std::min(ymin, y);
-        ymax = std::max(ymax, y);
-        zmin = std::min(zmin, z);
-        zmax = std::max(zmax, z);
-    }
-    printf("xmin: %8.2f\n", xmin);
-    printf("xmax: %8.2f\n", xmax);
-    printf("ymin: %8.2f\n", ymin);
-    printf("ymax: %8.2f\n", ymax);
-    printf("zmin: %8.2f\n", zmin);
-    printf("zmax: %8.2f\n", zmax);
+    if (proceduralsegments_ > 0) {
+        printf("procedural sphere: %d segments, no vertex or index buffer\n",
+               proceduralsegments_);
+    }
+    for (size_t i = 1; i < lods_.size(); i++) {
+        printf("LOD %zu    : %d triangles, error %g\n", i, lods_[i].count / 3, lods_[i].error);
+    }
+    if (!meshlets_.empty()) {
+        printf("meshlets : %zu\n", meshlets_.size());
+    }
+    // GPU memory for the vertex and index buffers, now and as it would be without welding
+    if (mode_ == GL_TRIANGLE_STRIP) {
+        printf("strips   : %d indices, %.2f per triangle\n", nstripindices_,
+               static_cast<double>(nstripindices_) / std::max(ntris_, 1));
+    }
+    const size_t indexbytes = bufferIndexCount() *
+                              (indextype_ == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+    const size_t stride = static_cast<size_t>(layout_.stride());
+    printf("GPU bytes: %zu (%zu before welding, %zu bytes per vertex)\n",
+           static_cast<size_t>(nverts_) * stride + indexbytes,
+           static_cast<size_t>(nrawverts_) * stride + indexbytes, stride);
+    const char* residencyname[] = {"keep", "discard", "positions"};
+    printf("CPU bytes: %zu (residency %s)\n", cpuBytes(),
+           residencyname[static_cast<int>(residency_)]);
+    // The bounds are found when the vertices are uploaded, also for cached meshes
+    printf("xmin: %8.2f\n", boundsmin_[0]);
+    printf("xmax: %8.2f\n", boundsmax_[0]);
+    printf("ymin: %8.2f\n", boundsmin_[1]);
+    printf("ymax: %8.2f\n", boundsmax_[1]);
+    printf("zmin: %8.2f\n", boundsmin_[2]);
+    printf("zmax: %8.2f\n", boundsmax_[2]);
+    printf("bounding sphere: centre (%.2f, %.2f, %.2f), radius %.2f\n", center_[0], center_[1],
+           center_[2], radius_);
 }
 
 /* Render the geometry in a TriangleSoup object */
 void TriangleSoup::render() {
-    glBindVertexArray(vao_);
-    glDrawElements(GL_TRIANGLES, 3 * ntris_, GL_UNSIGNED_INT, (void*)0);
-    // (mode, vertex count, type, element array buffer offset)
+    // Nothing to draw until an asynchronous load is done
+    if (!isReady() || (vao_ == 0 && !arena_)) {
+        return;
+    }
+
+    // Read the result of the previous query before starting a new one. It was issued a frame
+    // ago, so it is normally available without waiting.
+    if (countfragments_) {
+        if (fragmentquery_ == 0) {
+            glGenQueries(1, &fragmentquery_);
+        }
+        if (querypending_) {
+            glGetQueryObjectuiv(fragmentquery_, GL_QUERY_RESULT, &fragments_);
+        }
+        glBeginQuery(GL_SAMPLES_PASSED, fragmentquery_);
+    }
+
+    bindVertexArray();
+    if (proceduralsegments_ > 0) {
+        // The instance attributes of spherevertex.glsl are disabled in our VAO, so they read
+        // these values: no translation or rotation, scale 1, white, and the mesh segments
+        glVertexAttrib4f(3, 0.0f, 0.0f, 0.0f, 1.0f);
+        glVertexAttrib4f(4, 0.0f, 0.0f, 0.0f, 1.0f);
+        glVertexAttrib4f(5, 1.0f, 1.0f, 1.0f, 1.0f);
+        glVertexAttribI4ui(6, 0, 0, 0, 0);
+        drawProcedural(1, proceduralsegments_);
+    } else if (meshletculling_ && lod_ == 0) {
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES, meshletcounts_.data(), indextype_,
+                                      meshletoffsets_.data(),
+                                      static_cast<GLsizei>(meshletcounts_.size()),
+                                      meshletbasevertices_.data());
+    } else {
+        drawElements(1);
+    }
     glBindVertexArray(0);
+
+    if (countfragments_) {
+        glEndQuery(GL_SAMPLES_PASSED);
+        querypending_ = true;
+    }
+}
+
+/* Render 'count' copies of the geometry, with the per-instance data in 'instances' */
+void TriangleSoup::renderInstanced(int count, const InstanceBuffer& instances) {
+    if (!isReady() || (vao_ == 0 && !arena_) || count <= 0 || instances.count() <= 0) {
+        return;
+    }
+    bindVertexArray();
+    instances.setAttributes();
+    if (proceduralsegments_ > 0) {
+        // Enough vertices for the instance with the most segments
+        drawProcedural(std::min(count, instances.count()),
+                       std::max(proceduralsegments_, instances.maxSegments()));
+    } else {
+        drawElements(std::min(count, instances.count()));
+    }
+    // The VAO may be drawn without instances later, and the arena VAO is shared
+    instances.clearAttributes();
+    glBindVertexArray(0);
+}
+
+/* Bind our own VAO, or the VAO of the arena that holds the geometry */
+void TriangleSoup::bindVertexArray() const { glBindVertexArray(arena_ ? arena_->vao() : vao_); }
+
+/* Issue the draw calls for the bound VAO, for 'instances' copies of the geometry */
+void TriangleSoup::drawElements(GLsizei instances) const {
+    size_t begin, end;
+    lodRanges(begin, end);
+    if (mode_ == GL_TRIANGLE_STRIP) {
+        // All strips in one draw, split at the largest value of the index type. The restart
+        // is global state, so it is only enabled for this draw.
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(indextype_ == GL_UNSIGNED_SHORT ? 0xFFFF : 0xFFFFFFFF);
+        glDrawElementsInstanced(GL_TRIANGLE_STRIP, nstripindices_, indextype_, nullptr,
+                                instances);
+        glDisable(GL_PRIMITIVE_RESTART);
+    } else if (arena_) {
+        // All meshes in the arena share its VAO, and each range is offset by our block
+        const GeometryArena::Block& block = arena_->block(arenablock_);
+        for (size_t r = begin; r < end; r++) {
+            const IndexRange& range = ranges_[r];
+            const size_t first = static_cast<size_t>(block.firstindex + range.first);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT,
+                                              (void*)(first * sizeof(GLushort)), instances,
+                                              block.firstvertex + range.basevertex);
+        }
+    } else if (ranges_.empty()) {
+        const GLsizei first = lods_.empty() ? 0 : lods_[static_cast<size_t>(lod_)].first;
+        const GLsizei count = lods_.empty() ? 3 * ntris_ : lods_[static_cast<size_t>(lod_)].count;
+        const size_t indexsize =
+            indextype_ == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        glDrawElementsInstanced(GL_TRIANGLES, count, indextype_,
+                                (void*)(static_cast<size_t>(first) * indexsize), instances);
+        // (mode, vertex count, type, element array buffer offset, instance count)
+    } else {
+        // Meshes with more than 65536 vertices or with levels of detail, drawn in ranges of
+        // 16 bit indices
+        for (size_t r = begin; r < end; r++) {
+            const IndexRange& range = ranges_[r];
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.count, GL_UNSIGNED_SHORT,
+                                              (void*)(range.first * sizeof(GLushort)), instances,
+                                              range.basevertex);
+        }
+    }
+}
+
+/*
+ * Draw one triangle strip through all bands of the sphere, with 2 * 2 * segments + 6 vertices
+ * per band, see spherevertex.glsl. The vertices past the end of an instance with fewer
+ * segments are all at the same point, so their triangles are degenerate.
+ */
+void TriangleSoup::drawProcedural(GLsizei instances, int segments) const {
+    const int vsegs = std::max(segments, 2);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, vsegs * (4 * vsegs + 6), instances);
+}
+
+/* Find the index ranges of the current level of detail, [begin, end) in ranges_ */
+void TriangleSoup::lodRanges(size_t& begin, size_t& end) const {
+    if (lods_.empty()) {
+        begin = 0;
+        end = ranges_.size();
+    } else {
+        const Lod& lod = lods_[static_cast<size_t>(lod_)];
+        begin = lod.firstrange;
+        end = lod.firstrange + lod.numranges;
+    }
+}
+
+/*
+ * Simplify the mesh into a chain of coarser levels of detail, see MeshSimplifier.hpp. Each
+ * level is simplified from the one before, so its error is the sum of the errors on the way.
+ * The indices of all levels go after each other in indexarray_, and in the index buffer.
+ */
+void TriangleSoup::buildLODs(int levels, float ratio) {
+    if (!restoreArrays()) {
+        printf("TriangleSoup has no complete vertex data to simplify.\n");
+        return;
+    }
+    detachSource();
+    const auto starttime = std::chrono::steady_clock::now();
+    indexarray_.resize(3 * static_cast<size_t>(ntris_));
+    lods_.clear();
+    lod_ = 0;
+    lods_.push_back({0, 3 * ntris_, 0, 0, 0.0f});
+
+    std::vector<GLuint> previous = indexarray_;
+    std::vector<GLuint> simplified;
+    for (int level = 1; level <= levels; level++) {
+        const size_t target =
+            3 * static_cast<size_t>(static_cast<float>(previous.size() / 3) * ratio);
+        const float error = meshopt::simplify(vertexarray_, previous, target,
+                                              std::numeric_limits<float>::max(), simplified);
+        if (simplified.empty() || simplified.size() >= previous.size()) {
+            break;  // Nothing left to collapse
+        }
+        meshopt::optimizeVertexCache(simplified, nverts_);
+        const float totalerror = lods_.back().error + error;
+        lods_.push_back({static_cast<GLsizei>(indexarray_.size()),
+                         static_cast<GLsizei>(simplified.size()), 0, 0, totalerror});
+        indexarray_.insert(indexarray_.end(), simplified.begin(), simplified.end());
+        previous.swap(simplified);
+    }
+
+    const std::chrono::duration<double, std::milli> simplifytime =
+        std::chrono::steady_clock::now() - starttime;
+    printf("Levels of detail (%.2f ms):\n", simplifytime.count());
+    for (size_t i = 0; i < lods_.size(); i++) {
+        printf("  LOD %zu: %7d triangles, error %g\n", i, lods_[i].count / 3, lods_[i].error);
+    }
+
+    deleteBuffers();
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), static_cast<int>(indexarray_.size()));
 }
+
+/* Cluster the triangles of the full mesh for culling, see Meshlets.hpp */
+void TriangleSoup::buildMeshlets(int maxtriangles) {
+    if (!restoreArrays()) {
+        printf("TriangleSoup has no complete vertex data to build meshlets from.\n");
+        return;
+    }
+    detachSource();
+    // Only the full mesh is reordered. The coarser levels follow it unchanged.
+    const auto starttime = std::chrono::steady_clock::now();
+    const size_t numindices = 3 * static_cast<size_t>(ntris_);
+    std::vector<GLuint> indices(indexarray_.begin(), indexarray_.begin() + numindices);
+    meshopt::buildMeshlets(vertexarray_, indices, meshlets_,
+                           static_cast<size_t>(std::max(maxtriangles, 1)));
+    std::copy(indices.begin(), indices.end(), indexarray_.begin());
+
+    const std::chrono::duration<double, std::milli> buildtime =
+        std::chrono::steady_clock::now() - starttime;
+    int cones = 0;
+    for (const meshopt::Meshlet& meshlet : meshlets_) {
+        cones += meshlet.conecutoff < 1.0f;
+    }
+    printf("Meshlets: %zu, %d of them with a normal cone (%.2f ms)\n", meshlets_.size(), cones,
+           buildtime.count());
+
+    deleteBuffers();
+    upload(vertexarray_.data(), nverts_, indexarray_.data(), static_cast<int>(indexarray_.size()));
+}
+
+int TriangleSoup::meshletCount() const { return static_cast<int>(meshlets_.size()); }
+
+/*
+ * Cull the meshlets, and gather the draws for the visible ones. Consecutive visible meshlets
+ * are merged into one draw, which is then split where the 16 bit index ranges of the full
+ * mesh begin, since each range has its own base vertex.
+ */
+meshopt::MeshletCullStats TriangleSoup::cullMeshlets(const GLfloat* mvp) {
+    meshopt::MeshletCullStats stats;
+    if (meshlets_.empty() || (vao_ == 0 && !arena_)) {
+        return stats;
+    }
+    stats = meshopt::cullMeshlets(meshlets_, mvp, meshletvisible_);
+
+    std::vector<IndexRange> fullranges;
+    if (ranges_.empty()) {
+        fullranges.push_back({0, 3 * ntris_, 0});
+    } else {
+        const size_t end = lods_.empty() ? ranges_.size() : lods_[0].numranges;
+        fullranges.assign(ranges_.begin(), ranges_.begin() + static_cast<std::ptrdiff_t>(end));
+    }
+    GLsizei firstindex = 0;
+    GLint firstvertex = 0;
+    if (arena_) {
+        const GeometryArena::Block& block = arena_->block(arenablock_);
+        firstindex = block.firstindex;
+        firstvertex = block.firstvertex;
+    }
+    const size_t indexsize = indextype_ == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+
+    meshletcounts_.clear();
+    meshletoffsets_.clear();
+    meshletbasevertices_.clear();
+    size_t r = 0;
+    for (size_t m = 0; m < meshlets_.size(); m++) {
+        if (!meshletvisible_[m]) {
+            continue;
+        }
+        const GLsizei begin = static_cast<GLsizei>(meshlets_[m].firstindex);
+        while (m + 1 < meshlets_.size() && meshletvisible_[m + 1]) {
+            m++;
+        }
+        const GLsizei end = static_cast<GLsizei>(meshlets_[m].firstindex + meshlets_[m].indexcount);
+        for (; r < fullranges.size(); r++) {
+            const IndexRange& range = fullranges[r];
+            const GLsizei first = std::max(begin, range.first);
+            const GLsizei last = std::min(end, range.first + range.count);
+            if (first < last) {
+                meshletcounts_.push_back(last - first);
+                meshletoffsets_.push_back(
+                    (void*)(static_cast<size_t>(firstindex + first) * indexsize));
+                meshletbasevertices_.push_back(firstvertex + range.basevertex);
+            }
+            if (range.first + range.count > end) {
+                break;  // The next draw may start in this range too
+            }
+        }
+    }
+    meshletculling_ = true;
+    return stats;
+}
+
+void TriangleSoup::showAllMeshlets() { meshletculling_ = false; }
+
+/* Cast a ray against the full mesh, see Bvh.hpp */
+bool TriangleSoup::pick(const float* origin, const float* direction, RayHit& hit) {
+    if (stream_ || pending_.valid() || ntris_ == 0) {
+        return false;
+    }
+    if (!bvh_) {
+        if ((positions_.empty() || indexarray_.empty()) && !restoreArrays()) {
+            return false;
+        }
+        const auto starttime = std::chrono::steady_clock::now();
+        bvh_ = std::make_unique<Bvh>();
+        if (vertexarray_.empty()) {
+            bvh_->build(positions_.data(), indexarray_.data(), static_cast<size_t>(ntris_), 3);
+        } else {
+            bvh_->build(vertexarray_.data(), indexarray_.data(), static_cast<size_t>(ntris_));
+        }
+        const std::chrono::duration<double, std::milli> buildtime =
+            std::chrono::steady_clock::now() - starttime;
+        printf("BVH: %zu nodes, depth %d (%.2f ms)\n", bvh_->nodeCount(), bvh_->depth(),
+               buildtime.count());
+        applyResidency();  // Drop the arrays again if they were read back
+    }
+    return bvh_->intersect(origin, direction, hit);
+}
+
+const GLfloat* TriangleSoup::boundsMin() const { return boundsmin_; }
+
+const GLfloat* TriangleSoup::boundsMax() const { return boundsmax_; }
+
+const GLfloat* TriangleSoup::sphereCenter() const { return center_; }
+
+GLfloat TriangleSoup::sphereRadius() const { return radius_; }
+
+int TriangleSoup::lodCount() const { return std::max(static_cast<int>(lods_.size()), 1); }
+
+int TriangleSoup::lod() const { return lod_; }
+
+void TriangleSoup::setLOD(int lod) { lod_ = std::min(std::max(lod, 0), lodCount() - 1); }
+
+/*
+ * Choose the level of detail from the size of the bounding sphere on screen. 'mvp' maps the
+ * mesh to clip space. Near the sphere, a step of one unit in the mesh moves at most the length
+ * of the first two rows of the matrix in clip space x and y, divided by w, and a viewport of
+ * 'height' pixels shows 2 units of normalized device coordinates. The nearest point of the
+ * sphere gives the largest scale, and so the most detailed level.
+ */
+int TriangleSoup::selectLOD(const GLfloat* mvp, int height, float maxpixelerror) {
+    if (lods_.empty()) {
+        return 0;
+    }
+    // Column major, as OpenGL expects: element (row, column) is mvp[4 * column + row]
+    const float w = mvp[3] * center_[0] + mvp[7] * center_[1] + mvp[11] * center_[2] + mvp[15];
+    const float wscale = std::sqrt(mvp[3] * mvp[3] + mvp[7] * mvp[7] + mvp[11] * mvp[11]);
+    const float nearw = w - radius_ * wscale;
+    if (nearw <= 0.0f) {
+        setLOD(0);  // The camera is inside or close to the bounds
+        return lod_;
+    }
+    const float xscale = std::sqrt(mvp[0] * mvp[0] + mvp[4] * mvp[4] + mvp[8] * mvp[8]);
+    const float yscale = std::sqrt(mvp[1] * mvp[1] + mvp[5] * mvp[5] + mvp[9] * mvp[9]);
+    const float pixelsperunit =
+        std::max(xscale, yscale) / nearw * 0.5f * static_cast<float>(height);
+
+    int lod = 0;
+    while (lod + 1 < static_cast<int>(lods_.size()) &&
+           lods_[static_cast<size_t>(lod + 1)].error * pixelsperunit <= maxpixelerror) {
+        lod++;
+    }
+    setLOD(lod);
+    return lod_;
+}
+
+/* Find the bounding box of the vertices, and a bounding sphere centred in the box */
+void TriangleSoup::computeBounds(const GLfloat* vertexdata, int numvertices) {
+    if (numvertices <= 0) {
+        return;
+    }
+    float* lo = boundsmin_;
+    float* hi = boundsmax_;
+    for (int c = 0; c < 3; c++) {
+        lo[c] = vertexdata[c];
+        hi[c] = vertexdata[c];
+    }
+    for (int i = 1; i < numvertices; i++) {
+        for (int c = 0; c < 3; c++) {
+            const float x = vertexdata[8 * static_cast<size_t>(i) + static_cast<size_t>(c)];
+            lo[c] = std::min(lo[c], x);
+            hi[c] = std::max(hi[c], x);
+        }
+    }
+    float r2 = 0.0f;
+    for (int c = 0; c < 3; c++) {
+        center_[c] = 0.5f * (lo[c] + hi[c]);
+    }
+    for (int i = 0; i < numvertices; i++) {
+        const GLfloat* p = vertexdata + 8 * static_cast<size_t>(i);
+        const float dx = p[0] - center_[0];
+        const float dy = p[1] - center_[1];
+        const float dz = p[2] - center_[2];
+        r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+    }
+    radius_ = std::sqrt(r2);
+}
+
+size_t TriangleSoup::indexCount() const {
+    return lods_.empty() ? 3 * static_cast<size_t>(ntris_)
+                         : static_cast<size_t>(lods_.back().first + lods_.back().count);
+}
+
+size_t TriangleSoup::bufferIndexCount() const {
+    if (proceduralsegments_ > 0) {
+        return 0;
+    }
+    return mode_ == GL_TRIANGLE_STRIP ? static_cast<size_t>(nstripindices_) : indexCount();
+}
+
+/*
+ * Drop the arrays that the residency does not keep. Packed vertices can not be read back as
+ * floats, and the OBJ file or the table only match the mesh until it is edited, so if no way
+ * back is open the arrays are kept.
+ */
+void TriangleSoup::applyResidency() {
+    if (residency_ != Residency::Positions) {
+        release(positions_);
+    }
+    if (residency_ == Residency::Keep || vertexarray_.empty() || stream_ || pending_.valid()) {
+        return;
+    }
+    if (!layout_.isFloat() && sourcefile_.empty() && !sourcetable_) {
+        return;
+    }
+    if (residency_ == Residency::Positions) {
+        positions_.resize(3 * static_cast<size_t>(nverts_));
+        for (size_t v = 0; v < static_cast<size_t>(nverts_); v++) {
+            positions_[3 * v] = vertexarray_[8 * v];
+            positions_[3 * v + 1] = vertexarray_[8 * v + 1];
+            positions_[3 * v + 2] = vertexarray_[8 * v + 2];
+        }
+    } else {
+        release(indexarray_);
+    }
+    release(vertexarray_);
+}
+
+/*
+ * Make the arrays resident again. A table is just copied. Reading the buffers back waits for
+ * the GPU to finish with them, and the OBJ file is the fallback for packed vertex formats.
+ */
+bool TriangleSoup::restoreArrays() {
+    if (stream_ || pending_.valid() || nverts_ == 0) {
+        return false;
+    }
+    if (!vertexarray_.empty()) {
+        return true;
+    }
+    if (sourcetable_) {
+        primitives::copyTable(*sourcetable_, sourcescale_, vertexarray_, indexarray_);
+        return true;
+    }
+    const auto starttime = std::chrono::steady_clock::now();
+    const bool frombuffers = layout_.isFloat() && readBuffers();
+    if (!frombuffers && !readSourceFile()) {
+        std::cerr << "TriangleSoup: the vertex data was not kept and can not be read back\n";
+        return false;
+    }
+    const std::chrono::duration<double, std::milli> readtime =
+        std::chrono::steady_clock::now() - starttime;
+    printf("TriangleSoup: read back %d vertices from %s (%.2f ms)\n", nverts_,
+           frombuffers ? "the GPU buffers" : sourcefile_.c_str(), readtime.count());
+    return true;
+}
+
+/*
+ * Read the vertices, and the indices unless they are resident, from our buffers or the arena.
+ * With 16 bit indices, the base vertex of each range is added back.
+ */
+bool TriangleSoup::readBuffers() {
+    GLuint vertexbuffer = vertexbuffer_;
+    GLuint indexbuffer = indexbuffer_;
+    GLintptr vertexoffset = 0;
+    GLintptr indexoffset = 0;
+    if (arena_) {
+        const GeometryArena::Block& block = arena_->block(arenablock_);
+        vertexbuffer = arena_->vertexBuffer();
+        indexbuffer = arena_->indexBuffer();
+        vertexoffset = static_cast<GLintptr>(block.firstvertex) * layout_.stride();
+        indexoffset = static_cast<GLintptr>(block.firstindex) * sizeof(GLushort);
+    }
+    if (vertexbuffer == 0 || indexbuffer == 0) {
+        return false;
+    }
+
+    // GL_COPY_READ_BUFFER leaves the bindings of the VAOs alone
+    vertexarray_.resize(8 * static_cast<size_t>(nverts_));
+    glBindBuffer(GL_COPY_READ_BUFFER, vertexbuffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, vertexoffset,
+                       static_cast<GLsizeiptr>(vertexarray_.size() * sizeof(GLfloat)),
+                       vertexarray_.data());
+    if (indexarray_.empty() && mode_ == GL_TRIANGLE_STRIP) {
+        // The strips give back the same triangles, in another order and rotation
+        std::vector<GLuint> strip(static_cast<size_t>(nstripindices_));
+        glBindBuffer(GL_COPY_READ_BUFFER, indexbuffer);
+        if (indextype_ == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> shortindices(strip.size());
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexoffset,
+                               static_cast<GLsizeiptr>(strip.size() * sizeof(GLushort)),
+                               shortindices.data());
+            for (size_t i = 0; i < strip.size(); i++) {
+                strip[i] = shortindices[i] == 0xFFFF ? ~0u : shortindices[i];
+            }
+        } else {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexoffset,
+                               static_cast<GLsizeiptr>(strip.size() * sizeof(GLuint)),
+                               strip.data());
+        }
+        meshopt::unstripify(strip, indexarray_);
+    } else if (indexarray_.empty()) {
+        const size_t numindices = indexCount();
+        indexarray_.resize(numindices);
+        glBindBuffer(GL_COPY_READ_BUFFER, indexbuffer);
+        if (indextype_ == GL_UNSIGNED_SHORT) {
+            std::vector<GLushort> shortindices(numindices);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexoffset,
+                               static_cast<GLsizeiptr>(numindices * sizeof(GLushort)),
+                               shortindices.data());
+            std::copy(shortindices.begin(), shortindices.end(), indexarray_.begin());
+            for (const IndexRange& range : ranges_) {
+                for (GLsizei i = range.first; i < range.first + range.count; i++) {
+                    indexarray_[static_cast<size_t>(i)] += static_cast<GLuint>(range.basevertex);
+                }
+            }
+        } else {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, indexoffset,
+                               static_cast<GLsizeiptr>(numindices * sizeof(GLuint)),
+                               indexarray_.data());
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return true;
+}
+
+/* The arrays are about to change, so the file or the table no longer match them */
+void TriangleSoup::detachSource() {
+    sourcefile_.clear();
+    sourcetable_ = nullptr;
+}
+
+/* Load the OBJ file again (or its cache file), the way it was loaded the first time */
+bool TriangleSoup::readSourceFile() {
+    ObjData data;
+    if (sourcefile_.empty() ||
+        !loadOBJData(sourcefile_, sourceloader_, 0, sourceoptimizations_, data)) {
+        return false;
+    }
+    if (data.cached) {
+        data.vertexarray.assign(data.cache.vertices(),
+                                data.cache.vertices() + 8 * data.cache.numVertices());
+        data.indexarray.assign(data.cache.indices(),
+                               data.cache.indices() + data.cache.numIndices());
+    }
+    if (data.vertexarray.size() != 8 * static_cast<size_t>(nverts_) ||
+        data.indexarray.size() != indexCount()) {
+        std::cerr << "Mesh read error: \"" << sourcefile_ << "\" has changed since it was loaded\n";
+        return false;
+    }
+    vertexarray_.swap(data.vertexarray);
+    indexarray_.swap(data.indexarray);
+    return true;
+}
+
+/* Memory held on the CPU. Capacities count, since that is what is allocated. */
+size_t TriangleSoup::cpuBytes() const {
+    size_t bytes = (vertexarray_.capacity() + positions_.capacity()) * sizeof(GLfloat) +
+                   indexarray_.capacity() * sizeof(GLuint) +
+                   meshlets_.capacity() * sizeof(meshopt::Meshlet);
+    if (bvh_) {
+        bytes += bvh_->bytes();
+    }
+    return bytes;
+}
+
+/* Memory of the vertex and index buffers, or of our part of the arena buffers */
+size_t TriangleSoup::gpuBytes() const {
+    const size_t indexsize = indextype_ == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+    return static_cast<size_t>(nverts_) * static_cast<size_t>(layout_.stride()) +
+           bufferIndexCount() * indexsize;
+}
+
+/* Sum up cpuBytes() and gpuBytes() of all TriangleSoup objects, for each residency */
+void TriangleSoup::printMemoryReport() {
+    const char* residencyname[] = {"keep", "discard", "positions"};
+    int meshes[3] = {0, 0, 0};
+    size_t cpubytes[3] = {0, 0, 0};
+    size_t gpubytes[3] = {0, 0, 0};
+    size_t total = 0;
+    for (const TriangleSoup* mesh = firstmesh_; mesh; mesh = mesh->nextmesh_) {
+        total++;
+        const int r = static_cast<int>(mesh->residency_);
+        meshes[r]++;
+        cpubytes[r] += mesh->cpuBytes();
+        gpubytes[r] += mesh->gpuBytes();
+    }
+    printf("TriangleSoup memory, %zu meshes:\n", total);
+    for (int r = 0; r < 3; r++) {
+        if (meshes[r] > 0) {
+            printf("  %-9s: %6d meshes, CPU %12zu bytes, GPU %12zu bytes\n", residencyname[r],
+                   meshes[r], cpubytes[r], gpubytes[r]);
+        }
+    }
+    printf("  total    : %6zu meshes, CPU %12zu bytes, GPU %12zu bytes\n", total,
+           cpubytes[0] + cpubytes[1] + cpubytes[2], gpubytes[0] + gpubytes[1] + gpubytes[2]);
+}
+
+/* Turn the fragment counting in render() on or off */
+void TriangleSoup::setCountFragments(bool count) {
+    countfragments_ = count;
+    querypending_ = false;
+    fragments_ = 0;
+}
+
+GLuint TriangleSoup::fragmentCount() const { return fragments_; }
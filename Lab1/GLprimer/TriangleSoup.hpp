@@ -3,9 +3,55 @@
  *
  * Usage: The methods createXXX() create geometry from fixed arrays or procedural
  *        descriptions.
- *        The method loadOBJ() loads geometry from an OBJ file. Only the mesh is loaded. Material
+ *        The method readOBJ() loads geometry from an OBJ file. Only the mesh is loaded. Material
  *        information is ignored. Only triangles are supported. OBJ files with quads are rejected.
- *        Call render() to draw the mesh in OpenGL.
+ *        Face corners with the same v/t/n indices are welded into one vertex, so the result
+ *        is a properly indexed mesh (except for Loader::Scanf, which is kept as a reference).
+ *        By default the file is memory mapped and parsed in chunks on several threads.
+ *        Loader::Mapped parses it in a single pass on the calling thread, and the original
+ *        two pass fgets()/sscanf() loader can still be selected with Loader::Scanf.
+ *        Except for Loader::Scanf, the mesh is saved to a binary cache file next to the OBJ
+ *        file, which is used instead of the OBJ file as long as it is up to date.
+ *        readOBJAsync() does the same on a worker thread, so the render loop keeps running.
+ *        The GL objects are created by the first render() or isReady() call once the file
+ *        is parsed, and render() draws nothing until then.
+ *        For large files, beginReadOBJ() starts a progressive load instead. Each call to
+ *        continueReadOBJ() parses the file for a given time and uploads the finished faces,
+ *        and render() draws the part of the mesh that has arrived so far.
+ *        Indices are stored as 16 bits on the GPU when the mesh has at most 65536 vertices.
+ *        Larger meshes are split into ranges that each span fewer vertices, drawn with a
+ *        base vertex each, and only fall back to 32 bits if a single triangle spans too far.
+ *        With setUseArena(true), the geometry goes into the GeometryArena shared by all meshes
+ *        with the same vertex format, instead of buffers of its own. Such meshes can also be
+ *        drawn together by a BatchRenderer, with one call for many meshes.
+ *        With setStrips(true), the index buffer holds triangle strips with primitive restart
+ *        instead of a list of triangles, at less than half the indices. Spheres get one strip
+ *        per band of latitude, other meshes go through meshopt::stripify(). The arrays keep
+ *        the list of triangles, and render() draws each mesh with the mode of its buffer.
+ *        createProceduralSphere() makes a sphere with no geometry in memory at all. It is
+ *        drawn with glDrawArrays() from spherevertex.glsl, which computes each vertex from
+ *        gl_VertexID, and each instance of renderInstanced() may have a number of segments
+ *        of its own.
+ *        buildLODs() simplifies the mesh into a chain of levels of detail in the same buffers,
+ *        and selectLOD() picks one from the size of the mesh on screen.
+ *        The bounding box and a bounding sphere are found when the vertices are uploaded, and
+ *        a FrustumCuller uses them to skip the meshes that are out of view.
+ *        For large meshes, buildMeshlets() splits the full mesh into clusters of triangles,
+ *        and cullMeshlets() makes render() skip the clusters that are out of view or that
+ *        face away from the camera, see Meshlets.hpp.
+ *        pick() finds the triangle hit by a ray, such as the one through the mouse cursor from
+ *        MouseRotator::cursorRay(), with a BVH over the full mesh, see Bvh.hpp.
+ *        By default the vertex and index arrays stay in memory after they are uploaded
+ *        (geometry uploaded straight from a cache file or a constant table has none until
+ *        they are needed).
+ *        setResidency() can drop them instead, or keep only the positions and the indices
+ *        for pick(). Edits that need the arrays read them back from the GPU buffers, or from
+ *        the OBJ file if the vertex format on the GPU is not floats. printMemoryReport()
+ *        sums up the CPU and GPU memory held by all meshes.
+ *        setVertexFormat() selects a compact vertex format for the GPU, see VertexFormat.hpp.
+ *        Use meshvertex.glsl to decode it, with uniforms set by setDecodeUniforms().
+ *        Call render() to draw the mesh in OpenGL, or renderInstanced() to draw many copies
+ *        of it in one call, with per-instance transforms from an InstanceBuffer.
  *
  * Authors: Stefan Gustavson (stegu@itn.liu.se) 2013-2014
  *          Martin Falk (martin.falk@liu.se) 2021
@@ -15,32 +61,229 @@
 #pragma once
 
 #include <GLFW/glfw3.h>  // To use OpenGL datatypes
+#include <cstdint>
+#include <future>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "Meshlets.hpp"
+#include "VertexFormat.hpp"
+
+class Bvh;
+class GeometryArena;
+class InstanceBuffer;
+struct RayHit;
+
+namespace obj {
+class StreamParser;
+}
+
+namespace primitives {
+struct Table;
+}
+
 // A class to hold geometry data and send it off for rendering
 class TriangleSoup {
 public:
+    // Available OBJ parsers for readOBJ(), see ObjReader.hpp
+    enum class Loader {
+        Scanf,  // Two passes with fgets() and sscanf()
+        Mapped,   // Memory mapped file, single pass with a hand-written tokenizer
+        Parallel  // Memory mapped file, chunks parsed on a thread pool
+    };
+
+    // Mesh optimizations for readOBJ() and optimize(), combined with |. See MeshOptimizer.hpp
+    enum Optimization {
+        OptimizeVertexCache = 1,  // Triangles in vertex cache order, vertices in first use order
+        OptimizeOverdraw = 2      // Also draw the most occluding clusters of triangles first
+    };
+
+    // What is kept of the vertex and index arrays after they are uploaded, see setResidency()
+    enum class Residency {
+        Keep,       // Both arrays
+        Discard,    // Nothing, the arrays are read back when they are needed
+        Positions   // The positions (x, y, z) and the indices, for pick()
+    };
+
+    // A range of 16 bit indices, relative to a base vertex
+    struct IndexRange {
+        GLsizei first;     // First index in the index buffer
+        GLsizei count;     // Number of indices
+        GLint basevertex;  // Added to each index
+    };
+
     /* Constructor: initialize a triangleSoup object to all zeros */
     TriangleSoup();
 
     /* Destructor: clean up allocated data in a triangleSoup object */
     ~TriangleSoup();
 
+    /* Move constructor and assignment: the GL objects, the arrays and the settings change
+       owner, without any GL calls or allocations (except deleting what the target held
+       before), and the moved-from object is left empty, so its destructor makes no GL
+       calls. Copies are deleted, since both would delete the same GL objects. The assignment
+       is not noexcept, since it waits for a pending readOBJAsync() of the target to finish,
+       like clean() does. An std::async() result can not be abandoned without waiting. */
+    TriangleSoup(TriangleSoup&& other) noexcept;
+    TriangleSoup& operator=(TriangleSoup&& other);
+
+    TriangleSoup(const TriangleSoup&) = delete;
+    TriangleSoup& operator=(const TriangleSoup&) = delete;
+
     /* Clean up allocated data in a triangleSoup object */
     void clean();
 
-    /* Create a very simple demo mesh with a single triangle */
+    /* Select the vertex format on the GPU for geometry created or loaded after this call.
+       The vertex array is still kept as floats. Progressive loads upload floats while the
+       file is parsed, and the finished mesh again in this format. */
+    void setVertexFormat(const VertexFormat& format);
+
+    /* Put geometry created or loaded after this call in the shared GeometryArena for its
+       vertex format. Meshes that need 32 bit indices still get buffers of their own, and so
+       do progressive loads until the whole mesh has arrived. */
+    void setUseArena(bool use);
+
+    /* Store the indices of geometry created or loaded after this call as triangle strips
+       with primitive restart. Meshes with levels of detail or meshlets, which are drawn in
+       ranges of triangles, and meshes in the arena, still get lists of triangles. So do
+       progressive loads until the whole mesh has arrived. */
+    void setStrips(bool use);
+
+    // returns true if the index buffer holds triangle strips
+    bool usesStrips() const;
+
+    /* Select what is kept of the vertex and index arrays after each upload. Applies to the
+       current geometry too, but Keep does not read back arrays that are already dropped.
+       Meshes that can not be read back again (a packed vertex format, edited after loading)
+       keep their arrays whatever the setting. */
+    void setResidency(Residency residency);
+
+    // returns the residency set by setResidency(), Keep by default
+    Residency residency() const;
+
+    /* Make the vertex and index arrays resident again, reading them back from the GPU
+       buffers if they hold floats, or else from the OBJ file the mesh was loaded from.
+       They stay until the next upload. Returns false if that is not possible. */
+    bool restoreArrays();
+
+    // returns the memory held on the CPU (arrays, meshlets, BVH) and on the GPU, in bytes
+    size_t cpuBytes() const;
+    size_t gpuBytes() const;
+
+    /* Print the CPU and GPU memory held by all TriangleSoup objects, by residency */
+    static void printMemoryReport();
+
+    /* Set the uniforms in meshvertex.glsl that decode the vertex format of this object, or
+       the radius and segments in spherevertex.glsl for a procedural sphere.
+       Call after glUseProgram(), before render() */
+    void setDecodeUniforms(GLuint programID) const;
+
+    /* Create a very simple demo mesh with a single triangle, uploaded from a constant table */
     void createTriangle();
 
-    /* Create a simple box geometry */
+    /* Create a simple box geometry, from a constant table */
     void createBox(float xsize, float ysize, float zsize);
 
-    /* Create a sphere (approximated by polygon segments) */
+    /* Create a sphere (approximated by polygon segments). With 6, 8, 16 or 32 segments it
+       comes from a table computed at compile time, see Primitives.hpp */
     void createSphere(float radius, int segments);
 
-    /* Load geometry from an OBJ file */
-    void readOBJ(const std::string& filename);
+    /* Create a sphere from a cube with 'segments' by 'segments' quads on each face, with
+       triangles of close to even size, see Primitives.hpp */
+    void createCubeSphere(float radius, int segments);
+
+    /* Create a sphere with no vertex or index buffer, like createSphere() but computed by
+       the vertex shader, which must be spherevertex.glsl. Instances with segments of their
+       own (see InstanceBuffer.hpp) override 'segments'. With no arrays, it can not be edited
+       or picked. */
+    void createProceduralSphere(float radius, int segments);
+
+    /* Load geometry from an OBJ file. 'threads' limits the number of threads used by
+       Loader::Parallel (0 means one per hardware thread). 'optimizations' are applied after
+       parsing, and the cache file keeps the optimized mesh. */
+    void readOBJ(const std::string& filename, Loader loader = Loader::Parallel, int threads = 0,
+                 int optimizations = 0);
+
+    /* Start loading geometry from an OBJ file on a worker thread, like readOBJ(). The future
+       becomes ready when parsing is done, with true on success. Must be called on the thread
+       that owns the OpenGL context, like render() and isReady(). */
+    std::shared_future<bool> readOBJAsync(const std::string& filename,
+                                          Loader loader = Loader::Parallel, int threads = 0,
+                                          int optimizations = 0);
+
+    /* Returns true unless an asynchronous load is still in progress. When it has just
+       finished, the geometry is sent off to OpenGL first. */
+    bool isReady();
+
+    /* Start loading geometry from an OBJ file progressively. The buffers are allocated for
+       the whole mesh up front, and filled by continueReadOBJ(). A valid cache file is still
+       loaded all at once. The finished mesh can be evicted and reloaded like after readOBJ(),
+       and is uploaded again at the end if setVertexFormat(), setUseArena() or setStrips()
+       asked for anything but floats, own buffers and lists of triangles. */
+    void beginReadOBJ(const std::string& filename);
+
+    /* Parse more of the file started by beginReadOBJ() for about 'milliseconds' and upload
+       the new faces. Returns true when the mesh is complete (or failed to load) */
+    bool continueReadOBJ(double milliseconds);
+
+    /* Reorder the geometry for faster rendering, and print the vertex cache statistics before
+       and after. Needs the vertex and index arrays, see restoreArrays(). */
+    void optimize(int optimizations = OptimizeVertexCache);
+
+    /* Simplify the mesh into 'levels' coarser levels of detail, each with about 'ratio' times
+       the triangles of the one before (fewer if the mesh can not be simplified further). All
+       levels share the vertex buffer, and their indices go in the same index buffer, so
+       switching costs nothing. Needs the vertex array, see restoreArrays(). */
+    void buildLODs(int levels = 4, float ratio = 0.5f);
+
+    // returns the number of levels of detail, 1 without buildLODs()
+    int lodCount() const;
+
+    // returns the level of detail drawn by render(), 0 being the full mesh
+    int lod() const;
+
+    /* Select the level of detail to draw */
+    void setLOD(int lod);
+
+    /* Select the coarsest level of detail whose error stays below 'maxpixelerror' pixels on
+       screen, from the projected size of the bounding sphere. 'mvp' is the column major
+       matrix from the mesh to clip space, and 'height' the height of the viewport in pixels.
+       Returns the selected level. */
+    int selectLOD(const GLfloat* mvp, int height, float maxpixelerror = 1.0f);
+
+    /* Reorder the triangles of the full mesh into meshlets of at most 'maxtriangles' triangles,
+       and upload it again. The levels of detail are kept, since the vertices do not change.
+       Needs the vertex array, see restoreArrays(). */
+    void buildMeshlets(int maxtriangles = 64);
+
+    // returns the number of meshlets, 0 without buildMeshlets()
+    int meshletCount() const;
+
+    /* Cull the meshlets against the view of 'mvp', the column major matrix from the mesh to
+       clip space. Until the next call, render() draws only the visible meshlets when the full
+       mesh is selected, in one multi-draw call with consecutive meshlets merged. */
+    meshopt::MeshletCullStats cullMeshlets(const GLfloat* mvp);
+
+    /* Make render() draw all meshlets again */
+    void showAllMeshlets();
+
+    /* Find the nearest triangle of the full mesh hit by the ray from 'origin' in 'direction',
+       in mesh coordinates. The BVH is built by the first call after the geometry changed,
+       from the positions if only they are resident, or else from restoreArrays(). */
+    bool pick(const float* origin, const float* direction, RayHit& hit);
+
+    /* Move the geometry by (dx, dy, dz) and upload it again. Needs the vertex array, see
+       restoreArrays(). */
+    void translate(float dx, float dy, float dz);
+
+    // returns the corners of the axis aligned bounding box of the vertices (x, y, z)
+    const GLfloat* boundsMin() const;
+    const GLfloat* boundsMax() const;
+
+    // returns the centre and radius of a bounding sphere of the vertices
+    const GLfloat* sphereCenter() const;
+    GLfloat sphereRadius() const;
 
     /* Print data from a triangleSoup object, for debugging purposes */
     void print();
@@ -51,14 +294,148 @@ public:
     /* Render the geometry in a triangleSoup object */
     void render();
 
+    /* Render 'count' instances of the geometry (at most instances.count()), each with its
+       own transform and colour from 'instances'. Use instancevertex.glsl as the shader. */
+    void renderInstanced(int count, const InstanceBuffer& instances);
+
+    /* Count the fragments that pass the depth test in render(), with an occlusion query.
+       Compare the counts with and without OptimizeOverdraw to see the reduction in overdraw */
+    void setCountFragments(bool count);
+
+    /* Return the fragment count from the previous call to render(), after setCountFragments() */
+    GLuint fragmentCount() const;
+
 private:
+    friend class BatchRenderer;  // Reads the arena block and ranges to queue the draws
+
     void printError(const char* errtype, const char* errmsg);
 
+    /* Exchange all members with 'other', for the move assignment */
+    void swap(TriangleSoup& other) noexcept;
+
+    /* Add the object to the list of all meshes, or remove it */
+    void link() noexcept;
+    void unlink() noexcept;
+
+    /* Create the VAO and buffers with room for the given number of vertices and indices */
+    void upload(const GLfloat* vertexdata, int numvertices, const GLuint* indexdata,
+                int numindices, GLenum usage = GL_STATIC_DRAW,
+                const std::vector<GLuint>* strip = nullptr);
+
+    /* Delete the VAO and the buffers, or release the room in the arena */
+    void deleteBuffers();
+
+    /* Bind the VAO that holds the geometry */
+    void bindVertexArray() const;
+
+    /* Draw the geometry from the bound VAO, 'instances' times */
+    void drawElements(GLsizei instances) const;
+
+    /* Draw the procedural sphere with enough vertices for 'segments', 'instances' times */
+    void drawProcedural(GLsizei instances, int segments) const;
+
+    /* Find the index ranges of the current level of detail in ranges_ */
+    void lodRanges(size_t& begin, size_t& end) const;
+
+    /* Compute the bounding box and sphere of interleaved vertices */
+    void computeBounds(const GLfloat* vertexdata, int numvertices);
+
+    // returns the number of indices of all levels of detail
+    size_t indexCount() const;
+
+    /* Drop the arrays that residency_ does not keep, if they can be restored */
+    void applyResidency();
+
+    /* Read the arrays back from the GPU buffers, or from sourcefile_ */
+    bool readBuffers();
+    bool readSourceFile();
+
+    /* Forget sourcefile_ and sourcetable_, before the arrays are edited */
+    void detachSource();
+
+    /* Upload a constant table from Primitives.hpp, with the positions scaled */
+    void uploadTable(const primitives::Table& table, const GLfloat* scale,
+                     const std::vector<GLuint>* strip = nullptr);
+
+    // returns the number of indices in the index buffer, as strips or triangles
+    size_t bufferIndexCount() const;
+
+    // A level of detail, a part of the index array and the index buffer
+    struct Lod {
+        GLsizei first;      // First index
+        GLsizei count;      // Number of indices
+        size_t firstrange;  // Its 16 bit ranges in ranges_, if any
+        size_t numranges;
+        float error;        // Distance from the full mesh, in the units of the vertices
+    };
+
+    struct ObjData;
+
+    /* Load an OBJ file into CPU arrays (or a mapped cache file), without any OpenGL calls */
+    static bool loadOBJData(const std::string& filename, Loader loader, int threads,
+                            int optimizations, ObjData& data);
+
+    /* Open a valid cache file for an OBJ file, if there is one */
+    static bool openCache(const std::string& filename, int optimizations, ObjData& data);
+
+    /* Apply optimizations to vertex and index arrays and print the vertex cache statistics */
+    static void optimizeArrays(std::vector<GLfloat>& vertexarray, std::vector<GLuint>& indexarray,
+                               int optimizations);
+
+    /* Take over the data of a loaded mesh and upload it */
+    void adopt(ObjData& data);
+
     GLuint vao_;                        // Vertex array object, the main handle for geometry
     int nverts_;                        // Number of vertices in the vertex array
     int ntris_;                         // Number of triangles in the index array (may be zero)
+    int nrawverts_;                     // Number of vertices before welding (OBJ: 3 per face)
     GLuint vertexbuffer_;               // Buffer ID to bind to GL_ARRAY_BUFFER
     GLuint indexbuffer_;                // Buffer ID to bind to GL_ELEMENT_ARRAY_BUFFER
     std::vector<GLfloat> vertexarray_;  // Vertex array on interleaved format: x y z nx ny nz s t
-    std::vector<GLuint> indexarray_;    // Element index array
+    std::vector<GLuint> indexarray_;    // Element index array, followed by the coarser LODs
+    std::unique_ptr<obj::StreamParser> stream_;  // Parser state while loading progressively
+    std::string streamfilename_;                 // OBJ file being loaded progressively
+    int64_t streamtime_;                         // Its modification time when loading started
+    std::shared_future<bool> pending_;           // Parsing result of readOBJAsync()
+    std::shared_ptr<ObjData> pendingdata_;       // Mesh being loaded by readOBJAsync()
+    bool countfragments_;                        // Wrap render() in an occlusion query
+    GLuint fragmentquery_;                       // GL_SAMPLES_PASSED query, 0 when not created
+    bool querypending_;                          // The query has a result that is not read yet
+    GLuint fragments_;                           // Result of the last finished query
+    VertexFormat format_;                        // Vertex format for the next upload
+    VertexFormat layout_;                        // Vertex format of the vertex buffer
+    VertexDecode decode_;                        // Decoding of layout_ for the shader
+    GLenum indextype_;                           // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    std::vector<IndexRange> ranges_;             // 16 bit ranges, empty for a single draw
+    bool usestrips_;                             // Upload triangle strips
+    GLenum mode_;                                // GL_TRIANGLES or GL_TRIANGLE_STRIP
+    GLsizei nstripindices_;                      // Indices in the strips, with the restarts
+    int proceduralsegments_;                     // Segments of a procedural sphere, or 0
+    bool usearena_;                              // Upload to the shared arena
+    std::shared_ptr<GeometryArena> arena_;       // Arena holding the geometry, if any
+    int arenablock_;                             // Handle of the geometry in arena_
+    std::vector<Lod> lods_;                      // Levels of detail, empty if not built
+    int lod_;                                    // Level drawn by render()
+    float boundsmin_[3];                         // Bounding box of the vertices
+    float boundsmax_[3];
+    float center_[3];                            // Bounding sphere of the vertices
+    float radius_;
+    std::vector<meshopt::Meshlet> meshlets_;     // Clusters of the full mesh, if built
+    std::vector<unsigned char> meshletvisible_;  // Result of the last cullMeshlets()
+    bool meshletculling_;                        // render() draws the visible meshlets only
+    std::vector<GLsizei> meshletcounts_;         // Arguments for glMultiDrawElementsBaseVertex()
+    std::vector<const void*> meshletoffsets_;
+    std::vector<GLint> meshletbasevertices_;
+    std::unique_ptr<Bvh> bvh_;                   // Built by pick(), reset by upload()
+    Residency residency_;                        // What is kept after an upload
+    std::vector<GLfloat> positions_;             // x y z of each vertex, for Positions
+    std::string sourcefile_;                     // OBJ file with the current geometry, if any
+    Loader sourceloader_;                        // How sourcefile_ was read
+    int sourceoptimizations_;
+    const primitives::Table* sourcetable_;       // Constant table with the geometry, if any
+    GLfloat sourcescale_[3];                     // Scale of the positions in sourcetable_
+    TriangleSoup* prevmesh_;                     // List of all meshes, for printMemoryReport()
+    TriangleSoup* nextmesh_;
+
+    static TriangleSoup* firstmesh_;
 };
@@ -0,0 +1,248 @@
+/*
+ * Conversion of float vertices to compact vertex formats
+ *
+ * This code is in the public domain.
+ */
+#include <GL/glew.h>
+
+#include "VertexFormat.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+uint16_t toUnorm16(float value) {
+    return static_cast<uint16_t>(std::lrint(std::min(std::max(value, 0.0f), 1.0f) * 65535.0f));
+}
+
+int16_t toSnorm16(float value) {
+    return static_cast<int16_t>(std::lrint(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f));
+}
+
+// A signed 10 bit normalized value, as a two's complement bit pattern
+uint32_t toSnorm10(float value) {
+    const long v = std::lrint(std::min(std::max(value, -1.0f), 1.0f) * 511.0f);
+    return static_cast<uint32_t>(v) & 0x3FFu;
+}
+
+/*
+ * Map a unit vector to the octahedron |x| + |y| + |z| = 1, and fold the lower half over the
+ * upper one, which gives a point in the square [-1, 1]^2.
+ */
+void octahedralEncode(const float* n, float& u, float& v) {
+    const float l1 = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+    if (l1 == 0.0f) {
+        u = 0.0f;
+        v = 0.0f;
+        return;
+    }
+    u = n[0] / l1;
+    v = n[1] / l1;
+    if (n[2] < 0.0f) {
+        const float fu = (1.0f - std::fabs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+        const float fv = (1.0f - std::fabs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+        u = fu;
+        v = fv;
+    }
+}
+
+// Find the range of 'count' components at 'first' of each vertex, as a scale and offset
+void findRange(const float* vertexdata, int numvertices, int first, int count, float* scale,
+               float* offset) {
+    for (int c = 0; c < count; c++) {
+        float lo = numvertices > 0 ? vertexdata[first + c] : 0.0f;
+        float hi = lo;
+        for (int i = 1; i < numvertices; i++) {
+            const float x = vertexdata[8 * static_cast<size_t>(i) + static_cast<size_t>(first + c)];
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+        offset[c] = lo;
+        scale[c] = hi > lo ? hi - lo : 1.0f;  // Flat ranges still need a valid scale
+    }
+}
+
+template <typename T>
+void put(unsigned char*& p, T value) {
+    memcpy(p, &value, sizeof(T));
+    p += sizeof(T);
+}
+
+}  // namespace
+
+VertexFormat VertexFormat::compact() {
+    VertexFormat format;
+    format.position = Position::Unorm16;
+    format.normal = Normal::Octahedral;
+    format.texcoord = Texcoord::Unorm16;
+    return format;
+}
+
+bool VertexFormat::isFloat() const {
+    return position == Position::Float && normal == Normal::Float && texcoord == Texcoord::Float;
+}
+
+int VertexFormat::normalOffset() const { return position == Position::Float ? 12 : 8; }
+
+int VertexFormat::texcoordOffset() const {
+    return normalOffset() + (normal == Normal::Float ? 12 : 4);
+}
+
+int VertexFormat::stride() const {
+    return texcoordOffset() + (texcoord == Texcoord::Float ? 8 : 4);
+}
+
+int VertexFormat::key() const {
+    return 9 * static_cast<int>(position) + 3 * static_cast<int>(normal) +
+           static_cast<int>(texcoord);
+}
+
+/* Set up the vertex attributes of the bound VAO to read from the bound GL_ARRAY_BUFFER */
+void VertexFormat::setAttributes() const {
+    // Specify how many attribute arrays we have in our VAO
+    glEnableVertexAttribArray(0);  // Vertex coordinates
+    glEnableVertexAttribArray(1);  // Normals
+    glEnableVertexAttribArray(2);  // Texture coordinates
+    // Specify how OpenGL should interpret the vertex buffer data:
+    // Attributes 0, 1, 2 (must match the lines above and the layout in the shader)
+    // Number of dimensions (3 means vec3 in the shader, 2 means vec2)
+    // Type GL_FLOAT, or a packed type
+    // Normalized for the integer types, so they arrive in [0, 1] or [-1, 1]
+    // Stride of one vertex (interleaved array, 32 bytes for 8 floats)
+    // Array buffer offset of the attribute within the first vertex
+    const GLsizei vertexstride = stride();
+    switch (position) {
+        case Position::Float:
+            glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, vertexstride, (void*)0);
+            break;
+        case Position::Unorm16:
+            glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, vertexstride, (void*)0);
+            break;
+        case Position::Half:
+            glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, vertexstride, (void*)0);
+            break;
+    }
+    const void* normaloffset = (void*)(size_t)normalOffset();
+    switch (normal) {
+        case Normal::Float:
+            glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, vertexstride, normaloffset);
+            break;
+        case Normal::Octahedral:
+            glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, vertexstride, normaloffset);
+            break;
+        case Normal::Int2101010:
+            glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, vertexstride,
+                                  normaloffset);
+            break;
+    }
+    const void* texcoordoffset = (void*)(size_t)texcoordOffset();
+    switch (texcoord) {
+        case Texcoord::Float:
+            glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, vertexstride, texcoordoffset);
+            break;
+        case Texcoord::Unorm16:
+            glVertexAttribPointer(2, 2, GL_UNSIGNED_SHORT, GL_TRUE, vertexstride,
+                                  texcoordoffset);
+            break;
+    }
+}
+
+
+void packVertices(const float* vertexdata, int numvertices, const VertexFormat& format,
+                  std::vector<unsigned char>& packed, VertexDecode& decode) {
+    decode = VertexDecode();
+    if (format.position == VertexFormat::Position::Unorm16) {
+        findRange(vertexdata, numvertices, 0, 3, decode.positionscale, decode.positionoffset);
+    }
+    if (format.texcoord == VertexFormat::Texcoord::Unorm16) {
+        findRange(vertexdata, numvertices, 6, 2, decode.texcoordscale, decode.texcoordoffset);
+    }
+
+    packed.resize(static_cast<size_t>(numvertices) * static_cast<size_t>(format.stride()));
+    unsigned char* p = packed.data();
+    for (int i = 0; i < numvertices; i++) {
+        const float* vertex = vertexdata + 8 * static_cast<size_t>(i);
+
+        switch (format.position) {
+            case VertexFormat::Position::Float:
+                put(p, vertex[0]);
+                put(p, vertex[1]);
+                put(p, vertex[2]);
+                break;
+            case VertexFormat::Position::Unorm16:
+                for (int c = 0; c < 3; c++) {
+                    put(p, toUnorm16((vertex[c] - decode.positionoffset[c]) /
+                                     decode.positionscale[c]));
+                }
+                put(p, uint16_t(0));
+                break;
+            case VertexFormat::Position::Half:
+                put(p, floatToHalf(vertex[0]));
+                put(p, floatToHalf(vertex[1]));
+                put(p, floatToHalf(vertex[2]));
+                put(p, uint16_t(0));
+                break;
+        }
+
+        switch (format.normal) {
+            case VertexFormat::Normal::Float:
+                put(p, vertex[3]);
+                put(p, vertex[4]);
+                put(p, vertex[5]);
+                break;
+            case VertexFormat::Normal::Octahedral: {
+                float u, v;
+                octahedralEncode(vertex + 3, u, v);
+                put(p, toSnorm16(u));
+                put(p, toSnorm16(v));
+                break;
+            }
+            case VertexFormat::Normal::Int2101010:
+                // x in the lowest bits, w (unused) in the top two
+                put(p, toSnorm10(vertex[3]) | toSnorm10(vertex[4]) << 10 |
+                           toSnorm10(vertex[5]) << 20);
+                break;
+        }
+
+        switch (format.texcoord) {
+            case VertexFormat::Texcoord::Float:
+                put(p, vertex[6]);
+                put(p, vertex[7]);
+                break;
+            case VertexFormat::Texcoord::Unorm16:
+                for (int c = 0; c < 2; c++) {
+                    put(p, toUnorm16((vertex[6 + c] - decode.texcoordoffset[c]) /
+                                     decode.texcoordscale[c]));
+                }
+                break;
+        }
+    }
+}
+
+uint16_t floatToHalf(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    const uint32_t magnitude = bits & 0x7FFFFFFFu;
+
+    if (magnitude >= 0x7F800000u) {  // Infinity, or NaN (kept quiet)
+        return static_cast<uint16_t>(sign | (magnitude > 0x7F800000u ? 0x7E00u : 0x7C00u));
+    }
+    if (magnitude >= 0x477FF000u) {  // 65520 and up round to infinity
+        return static_cast<uint16_t>(sign | 0x7C00u);
+    }
+    if (magnitude < 0x38800000u) {
+        // Below the smallest normal half, 2^-14: a denormal in steps of 2^-24. Scaling by
+        // a power of two is exact, so lrint() does the only rounding, to nearest even.
+        return static_cast<uint16_t>(sign | std::lrint(std::fabs(value) * 16777216.0f));
+    }
+    // Rebias the exponent from 127 to 15 and drop 13 mantissa bits, rounding to nearest even
+    uint32_t half = (magnitude - 0x38000000u) >> 13;
+    const uint32_t rest = magnitude & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
@@ -0,0 +1,84 @@
+/*
+ * Compact vertex formats for the interleaved vertices of TriangleSoup.
+ *
+ * Usage: A VertexFormat selects how each attribute is stored on the GPU. The default is the
+ *        original layout of 8 floats (32 bytes) per vertex. VertexFormat::compact() gives
+ *        16 bytes per vertex:
+ *          - positions as unorm16, relative to the bounding box of the mesh (8 bytes, padded)
+ *            or as half floats (8 bytes, padded);
+ *          - normals as octahedral snorm16 (4 bytes) or GL_INT_2_10_10_10_REV (4 bytes);
+ *          - texcoords as unorm16, relative to their range in the mesh (4 bytes).
+ *        packVertices() converts float vertices to a format. Positions and texcoords stored
+ *        as unorm16 need a scale and offset to decode, which packVertices() returns in a
+ *        VertexDecode for the shader (see meshvertex.glsl). Octahedral normals are decoded in
+ *        the shader as well. All other formats are decoded by the vertex fetch hardware.
+ *        setAttributes() sets up the vertex attributes 0, 1 and 2 of the bound VAO for the
+ *        format (position, normal and texcoord).
+ *
+ * References: Q. Meyer et al., "On Floating-Point Normal Vectors", EGSR 2010 (octahedral
+ *             normal encoding).
+ *
+ * This code is in the public domain.
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct VertexFormat {
+    enum class Position {
+        Float,    // 3 floats, 12 bytes
+        Unorm16,  // 3 unorm16 relative to the bounding box, padded to 8 bytes
+        Half      // 3 half floats, padded to 8 bytes
+    };
+    enum class Normal {
+        Float,       // 3 floats, 12 bytes
+        Octahedral,  // 2 snorm16 with the octahedral mapping, 4 bytes
+        Int2101010   // GL_INT_2_10_10_10_REV, 4 bytes
+    };
+    enum class Texcoord {
+        Float,   // 2 floats, 8 bytes
+        Unorm16  // 2 unorm16 relative to the range of the texcoords, 4 bytes
+    };
+
+    Position position = Position::Float;
+    Normal normal = Normal::Float;
+    Texcoord texcoord = Texcoord::Float;
+
+    // returns the 16 byte format with unorm16 positions, octahedral normals and unorm16 texcoords
+    static VertexFormat compact();
+
+    // returns true for the original layout of 8 floats
+    bool isFloat() const;
+
+    // returns the size of one vertex in bytes
+    int stride() const;
+
+    // returns a number in [0, 27) that is different for each format, to index maps by format
+    int key() const;
+
+    // returns the byte offsets of the attributes within a vertex
+    int normalOffset() const;
+    int texcoordOffset() const;
+
+    /* Set up the attributes of the bound VAO to read this format from the bound vertex buffer */
+    void setAttributes() const;
+};
+
+// Scale and offset that map unorm16 values in [0, 1] back to positions and texcoords
+struct VertexDecode {
+    float positionscale[3] = {1.0f, 1.0f, 1.0f};
+    float positionoffset[3] = {0.0f, 0.0f, 0.0f};
+    float texcoordscale[2] = {1.0f, 1.0f};
+    float texcoordoffset[2] = {0.0f, 0.0f};
+};
+
+/*
+ * Convert 'numvertices' interleaved float vertices (x y z nx ny nz s t) to 'format'.
+ * 'decode' is set to identity unless the format stores positions or texcoords as unorm16.
+ */
+void packVertices(const float* vertexdata, int numvertices, const VertexFormat& format,
+                  std::vector<unsigned char>& packed, VertexDecode& decode);
+
+/* Convert a float to a half float, rounding to nearest even */
+uint16_t floatToHalf(float value);
@@ -0,0 +1,38 @@
+#version 330 core
+
+// Vertex shader for TriangleSoup meshes in any VertexFormat, see VertexFormat.hpp.
+// TriangleSoup::setDecodeUniforms() sets the uniforms to match the format of the mesh.
+
+layout(location = 0) in vec3 Position;
+layout(location = 1) in vec3 Normal;    // Only .xy is stored for octahedral normals
+layout(location = 2) in vec2 TexCoord;
+out vec3 interpolatedColor;
+out vec2 st;  // Decoded texture coordinates, for fragment shaders that use a Texture
+
+// Positions and texcoords stored as unorm16 are in [0, 1] over their range in the mesh
+uniform vec3 positionScale = vec3(1.0);
+uniform vec3 positionOffset = vec3(0.0);
+uniform vec2 texcoordScale = vec2(1.0);
+uniform vec2 texcoordOffset = vec2(0.0);
+uniform bool octahedralNormals = false;
+
+// From mesh coordinates to clip space
+uniform mat4 transform = mat4(1.0);
+
+// Unfold a point in [-1, 1]^2 back from the octahedron to a unit vector
+vec3 octahedralDecode(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main() {
+	vec3 position = positionOffset + positionScale * Position;
+	vec3 normal = octahedralNormals ? octahedralDecode(Normal.xy) : normalize(Normal);
+	st = texcoordOffset + texcoordScale * TexCoord;
+
+	gl_Position = transform * vec4(position, 1.0);
+	interpolatedColor = 0.5 * normal + 0.5;  // Show the normals until there is lighting
+}
@@ -0,0 +1,70 @@
+#version 330 core
+
+// Vertex shader for spheres from TriangleSoup::createProceduralSphere(), which have no vertex
+// buffer. Each vertex is computed from gl_VertexID, with the same rings and texture
+// coordinates as TriangleSoup::createSphere(). The vertices are drawn as one triangle strip,
+// a band of latitude at a time, with two copies of the first and last vertex of each band so
+// the triangles between the bands are degenerate. The caps are bands to the pole.
+// The instance attributes are those of instancevertex.glsl, and the segments of an instance
+// replace 'sphereSegments' if they are not 0. Vertices past the end of a sphere with fewer
+// segments than the draw was made for all go to the same point, so they draw nothing.
+
+layout(location = 3) in vec4 InstancePositionScale;  // Translation in .xyz, scale in .w
+layout(location = 4) in vec4 InstanceRotation;       // Unit quaternion (x, y, z, w)
+layout(location = 5) in vec4 InstanceColor;          // White unless the buffer has colours
+layout(location = 6) in uint InstanceSegments;       // 0 for sphereSegments
+out vec3 interpolatedColor;
+out vec2 st;  // Texture coordinates, for fragment shaders that use a Texture
+
+// Set by TriangleSoup::setDecodeUniforms()
+uniform int sphereSegments = 8;
+uniform float sphereRadius = 1.0;
+
+// From mesh coordinates to clip space
+uniform mat4 transform = mat4(1.0);
+
+const float PI = 3.14159265358979;
+
+// Rotate a vector by a unit quaternion
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() {
+	int vsegs = max(InstanceSegments > 0u ? int(InstanceSegments) : sphereSegments, 2);
+	int hsegs = 2 * vsegs;
+	int bandvertices = 2 * hsegs + 6;
+	int band = gl_VertexID / bandvertices;
+	if (band >= vsegs) {
+		gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+		interpolatedColor = vec3(0.0);
+		st = vec2(0.0);
+		return;
+	}
+
+	// Alternate between the ring above the band (even) and the ring below it (odd). Ring -1
+	// is the top pole, and ring vsegs - 1 the bottom pole.
+	int k = clamp(gl_VertexID - band * bandvertices - 2, 0, 2 * hsegs + 1);
+	int i = k / 2;
+	int ring = band - 1 + k % 2;
+	vec3 normal;
+	if (ring < 0) {
+		normal = vec3(0.0, 0.0, 1.0);
+		st = vec2(0.5, 1.0);
+	} else if (ring == vsegs - 1) {
+		normal = vec3(0.0, 0.0, -1.0);
+		st = vec2(0.5, 0.0);
+	} else {
+		float theta = float(ring + 1) / float(vsegs) * PI;
+		float phi = float(i) / float(hsegs) * 2.0 * PI;
+		normal = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));
+		st = vec2(float(i) / float(hsegs), 1.0 - float(ring + 1) / float(vsegs));
+	}
+	vec3 position = sphereRadius * normal;
+
+	position = InstancePositionScale.xyz + InstancePositionScale.w * rotate(InstanceRotation, position);
+	normal = rotate(InstanceRotation, normal);
+
+	gl_Position = transform * vec4(position, 1.0);
+	interpolatedColor = InstanceColor.rgb * (0.5 * normal + 0.5);  // Normals tinted per instance
+}